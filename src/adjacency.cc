@@ -0,0 +1,135 @@
+#include "adjacency.h"
+#include "parallel.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+namespace {
+
+const uint32_t kNoSide = 0xffffffffu;
+
+// Both triangles on an edge, as the corner each one starts it from.
+struct EdgeSlot {
+	uint64_t key = 0;
+	uint32_t sides[2] = { kNoSide, kNoSide };
+};
+
+uint64_t mixKey(uint64_t key)
+{
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ull;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebull;
+	return key ^ (key >> 31);
+}
+
+// One id per distinct position, the lowest vertex index there.
+std::vector<unsigned int> weldPositions(const std::vector<glm::vec3>& vertices)
+{
+	std::vector<unsigned int> order(vertices.size());
+	std::iota(order.begin(), order.end(), 0u);
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		const glm::vec3& p = vertices[a];
+		const glm::vec3& q = vertices[b];
+		if (p.x != q.x)
+			return p.x < q.x;
+		if (p.y != q.y)
+			return p.y < q.y;
+		if (p.z != q.z)
+			return p.z < q.z;
+		return a < b;
+	});
+	std::vector<unsigned int> welded(vertices.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		bool same = i > 0 && vertices[order[i]] == vertices[order[i - 1]];
+		welded[order[i]] = same ? welded[order[i - 1]] : order[i];
+	}
+	return welded;
+}
+
+void buildLevelAdjacency(const unsigned int* indices, unsigned int index_count,
+                         const std::vector<unsigned int>& welded, unsigned int* adjacency)
+{
+	size_t triangles = index_count / 3;
+
+	// Corner i of a triangle starts the edge to corner i + 1. The key is the
+	// edge's two position ids either way round; 0 for a collapsed edge,
+	// which has no neighbour.
+	std::vector<uint64_t> keys(index_count);
+	parallelFor(triangles, 4096, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			for (unsigned int i = 0; i < 3; i++) {
+				uint64_t a = welded[indices[3 * t + i]], b = welded[indices[3 * t + (i + 1) % 3]];
+				keys[3 * t + i] = a == b ? 0 : std::min(a, b) << 32 | std::max(a, b);
+			}
+		}
+	});
+
+	// Without a neighbour an edge gets this triangle's own far corner.
+	auto farCorner = [](size_t corner) { return corner - corner % 3 + (corner % 3 + 2) % 3; };
+	parallelFor(index_count, 16384, [&](size_t begin, size_t end) {
+		for (size_t corner = begin; corner < end; corner++) {
+			adjacency[2 * corner] = indices[corner];
+			adjacency[2 * corner + 1] = indices[farCorner(corner)];
+		}
+	});
+
+	// Every shard reads all the keys but only keeps its own, so no two
+	// threads write the same table, or the same corners once each table
+	// is walked to pair its edges' sides up. Open addressing, at most half
+	// full as an edge usually has two sides.
+	size_t shards = workerCount();
+	auto shardOf = [shards](uint64_t hash) { return size_t(hash >> 32) % shards; };
+	parallelFor(shards, 1, [&](size_t begin, size_t end) {
+		for (size_t shard = begin; shard < end; shard++) {
+			size_t count = 0;
+			for (uint64_t key : keys)
+				if (key && shardOf(mixKey(key)) == shard)
+					count++;
+			size_t capacity = 16;
+			while (capacity < count)
+				capacity *= 2;
+			std::vector<EdgeSlot> table(capacity);
+			for (size_t corner = 0; corner < keys.size(); corner++) {
+				uint64_t key = keys[corner], hash = mixKey(key);
+				if (!key || shardOf(hash) != shard)
+					continue;
+				size_t slot = hash & (capacity - 1);
+				while (table[slot].key && table[slot].key != key)
+					slot = (slot + 1) & (capacity - 1);
+				EdgeSlot& edge = table[slot];
+				edge.key = key;
+				// A third triangle on the edge is left out.
+				if (edge.sides[0] == kNoSide)
+					edge.sides[0] = corner;
+				else if (edge.sides[1] == kNoSide)
+					edge.sides[1] = corner;
+			}
+			for (const EdgeSlot& edge : table) {
+				if (edge.sides[1] == kNoSide)
+					continue;
+				adjacency[2 * size_t(edge.sides[0]) + 1] = indices[farCorner(edge.sides[1])];
+				adjacency[2 * size_t(edge.sides[1]) + 1] = indices[farCorner(edge.sides[0])];
+			}
+		}
+	});
+}
+
+}
+
+void buildAdjacency(Mesh& mesh)
+{
+	PROFILE_ZONE("buildAdjacency");
+	std::vector<unsigned int> welded = weldPositions(mesh.vertices);
+	mesh.adjacency.clear();
+	for (LODLevel& level : mesh.lods) {
+		level.adjacency_offset = mesh.adjacency.size();
+		if (level.index_count == 0)
+			continue;
+		mesh.adjacency.resize(mesh.adjacency.size() + 2 * size_t(level.index_count));
+		buildLevelAdjacency(&mesh.indices[level.index_offset], level.index_count, welded,
+		                    &mesh.adjacency[level.adjacency_offset]);
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef NPR_ADJACENCY_H
+#define NPR_ADJACENCY_H
+
+#include "mesh.h"
+
+/*
+ * Fills mesh.adjacency with a GL_TRIANGLES_ADJACENCY copy of every level
+ * of detail: per triangle its three corners, each followed by the far
+ * corner of the triangle across the next edge. Triangles are neighbours
+ * if they share an edge's positions, so UV and normal seams don't cut the
+ * surface; an edge with no neighbour (or a third triangle on it) gets the
+ * triangle's own far corner, which reads as a fold.
+ *
+ * Edges are matched through a hash split into one shard per thread, each
+ * shard built and read without locks. Run after buildMeshlets, which
+ * reorders the triangles.
+ */
+void buildAdjacency(Mesh& mesh);
+
+#endif
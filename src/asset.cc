@@ -0,0 +1,102 @@
+#include "asset.h"
+#include "pack.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sys/stat.h>
+
+namespace {
+
+struct MountedPack {
+	AssetPack pack;
+	std::string location;  // resolved path of the pack
+	std::string stamp;
+};
+
+std::vector<std::unique_ptr<MountedPack>>& mountedPacks()
+{
+	static std::vector<std::unique_ptr<MountedPack>> packs;
+	return packs;
+}
+
+std::string fileStamp(const struct stat& st)
+{
+	char stamp[64];
+	snprintf(stamp, sizeof(stamp), "%lld %lld.%09ld", (long long)st.st_size,
+	         (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+	return stamp;
+}
+
+// Only for files that aren't on disk: a file there is the one the path
+// names, and the one being edited if it's watched, whatever a pack holds.
+const PackEntry* findInPacks(const std::string& path, const MountedPack*& owner)
+{
+	const std::vector<std::unique_ptr<MountedPack>>& packs = mountedPacks();
+	struct stat st;
+	if (packs.empty() || stat(path.c_str(), &st) == 0)
+		return nullptr;
+	for (size_t start = 0; start != std::string::npos;) {
+		std::string name = path.substr(start);
+		for (auto pack = packs.rbegin(); pack != packs.rend(); ++pack)
+			if (const PackEntry* entry = (*pack)->pack.find(name)) {
+				owner = pack->get();
+				return entry;
+			}
+		size_t slash = path.find('/', start);
+		start = slash == std::string::npos ? slash : slash + 1;
+	}
+	return nullptr;
+}
+
+}
+
+bool mountAssetPack(const std::string& path)
+{
+	std::unique_ptr<MountedPack> mounted(new MountedPack);
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || !mounted->pack.open(path))
+		return false;
+	char* resolved = realpath(path.c_str(), nullptr);
+	mounted->location = resolved ? resolved : path;
+	mounted->stamp = mounted->location + " " + fileStamp(st);
+	free(resolved);
+	mountedPacks().push_back(std::move(mounted));
+	return true;
+}
+
+bool readAsset(const std::string& path, AssetData& asset)
+{
+	const MountedPack* owner = nullptr;
+	if (const PackEntry* entry = findInPacks(path, owner)) {
+		if (!owner->pack.read(*entry, asset.buffer_, asset.data_)) {
+			printf("%s is corrupt in %s\n", path.c_str(), owner->pack.path().c_str());
+			return false;
+		}
+		asset.size_ = entry->raw_size;
+		return true;
+	}
+	if (!asset.file_.open(path))
+		return false;
+	asset.data_ = asset.file_.data();
+	asset.size_ = asset.file_.size();
+	return true;
+}
+
+bool assetInfo(const std::string& path, std::string& key, std::string& stamp)
+{
+	const MountedPack* owner = nullptr;
+	if (const PackEntry* entry = findInPacks(path, owner)) {
+		key = owner->location + ":" + owner->pack.name(*entry);
+		stamp = owner->stamp;
+		return true;
+	}
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+	char* resolved = realpath(path.c_str(), nullptr);
+	key = resolved ? resolved : path;
+	free(resolved);
+	stamp = fileStamp(st);
+	return true;
+}
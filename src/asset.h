@@ -0,0 +1,42 @@
+#ifndef NPR_ASSET_H
+#define NPR_ASSET_H
+
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Bytes of one asset, borrowed from a pack or a mapped file, or expanded
+// into a buffer. Valid while the object lives.
+class AssetData {
+public:
+	const unsigned char* data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	friend bool readAsset(const std::string& path, AssetData& asset);
+
+	MappedFile file_;
+	std::vector<unsigned char> buffer_;
+	const unsigned char* data_ = nullptr;
+	size_t size_ = 0;
+};
+
+// Makes a pack's entries visible to readAsset. Call before loading
+// anything; later packs take precedence.
+bool mountAssetPack(const std::string& path);
+
+/*
+ * Reads an asset from the file system or, if it isn't there, the mounted
+ * packs. Pack entries are named relative to the asset directory they were
+ * built from, so "../assets/obj/bunny.obj" finds "obj/bunny.obj": the path
+ * is tried whole and then with leading directories stripped one at a time.
+ */
+bool readAsset(const std::string& path, AssetData& asset);
+
+// Identifies an asset for caches: key names it and stamp changes whenever
+// its contents may have.
+bool assetInfo(const std::string& path, std::string& key, std::string& stamp);
+
+#endif
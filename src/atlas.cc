@@ -0,0 +1,167 @@
+#include "atlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Own copy of the packer; imgui_draw.cpp keeps its copy static as well.
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+
+namespace {
+
+int log2Floor(int value)
+{
+	int log = 0;
+	while ((value >> (log + 1)) > 0)
+		log++;
+	return log;
+}
+
+// Packs in units of padding texels so every rectangle starts aligned.
+bool tryPack(std::vector<stbrp_rect>& rects, int width_units, int height_units)
+{
+	std::vector<stbrp_node> nodes(width_units);
+	stbrp_context context;
+	stbrp_init_target(&context, width_units, height_units, nodes.data(), nodes.size());
+	return stbrp_pack_rects(&context, rects.data(), rects.size()) == 1;
+}
+
+}
+
+const AtlasEntry* TextureAtlas::find(const std::string& name) const
+{
+	for (const AtlasEntry& entry : entries)
+		if (entry.name == name)
+			return &entry;
+	return nullptr;
+}
+
+int TextureAtlas::mipLevels() const
+{
+	return std::max(log2Floor(std::max(padding, 1)), 1);
+}
+
+bool buildAtlas(const std::vector<Image>& images, const std::vector<std::string>& names,
+                int padding, int max_size, TextureAtlas& atlas, Image& pixels)
+{
+	padding = std::max(padding, 1);
+	std::vector<stbrp_rect> rects(images.size());
+	long long area = 0;
+	int widest = 1, tallest = 1;
+	for (size_t i = 0; i < images.size(); i++) {
+		rects[i].id = i;
+		rects[i].w = (images[i].width + 2 * padding + padding - 1) / padding;
+		rects[i].h = (images[i].height + 2 * padding + padding - 1) / padding;
+		area += (long long)rects[i].w * rects[i].h;
+		widest = std::max<int>(widest, rects[i].w);
+		tallest = std::max<int>(tallest, rects[i].h);
+	}
+
+	// Grow a power of two target, wide before tall, until everything fits.
+	int width = 1, height = 1;
+	auto grow = [&]() {
+		if (width <= height)
+			width *= 2;
+		else
+			height *= 2;
+		if (width > max_size || height > max_size) {
+			printf("Textures don't fit in a %dx%d atlas\n", max_size, max_size);
+			return false;
+		}
+		return true;
+	};
+	while ((long long)width * height < area || width < widest * padding || height < tallest * padding)
+		if (!grow())
+			return false;
+	while (!tryPack(rects, width / padding, height / padding))
+		if (!grow())
+			return false;
+
+	atlas.width = width;
+	atlas.height = height;
+	atlas.padding = padding;
+	atlas.entries.resize(images.size());
+	pixels.width = width;
+	pixels.height = height;
+	pixels.pixels.assign(size_t(width) * height * 4, 0);
+	for (const stbrp_rect& rect : rects) {
+		const Image& image = images[rect.id];
+		AtlasEntry& entry = atlas.entries[rect.id];
+		entry.name = names[rect.id];
+		entry.x = rect.x * padding + padding;
+		entry.y = rect.y * padding + padding;
+		entry.width = image.width;
+		entry.height = image.height;
+
+		// Copy with the edges repeated out to the padded rectangle.
+		int x0 = rect.x * padding, y0 = rect.y * padding;
+		for (int y = y0; y < y0 + rect.h * padding; y++) {
+			int sy = std::min(std::max(y - entry.y, 0), image.height - 1);
+			for (int x = x0; x < x0 + rect.w * padding; x++) {
+				int sx = std::min(std::max(x - entry.x, 0), image.width - 1);
+				memcpy(&pixels.pixels[(size_t(y) * width + x) * 4],
+				       &image.pixels[(size_t(sy) * image.width + sx) * 4], 4);
+			}
+		}
+	}
+	return true;
+}
+
+bool saveAtlasLayout(const std::string& path, const TextureAtlas& atlas)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+	fprintf(file, "atlas %d %d %d\n", atlas.width, atlas.height, atlas.padding);
+	for (const AtlasEntry& entry : atlas.entries)
+		fprintf(file, "%d %d %d %d %s\n", entry.x, entry.y, entry.width, entry.height, entry.name.c_str());
+	return fclose(file) == 0;
+}
+
+bool loadAtlasLayout(const std::string& path, TextureAtlas& atlas)
+{
+	FILE* file = fopen(path.c_str(), "r");
+	if (!file) {
+		printf("%s could not be opened.\n", path.c_str());
+		return false;
+	}
+	atlas.entries.clear();
+	bool ok = fscanf(file, "atlas %d %d %d\n", &atlas.width, &atlas.height, &atlas.padding) == 3;
+	char name[1024];
+	AtlasEntry entry;
+	while (ok && fscanf(file, "%d %d %d %d %1023[^\n]\n", &entry.x, &entry.y, &entry.width, &entry.height, name) == 5) {
+		entry.name = name;
+		atlas.entries.push_back(entry);
+	}
+	ok = ok && feof(file);
+	fclose(file);
+	if (!ok)
+		printf("Not a correct atlas layout\n");
+	return ok;
+}
+
+bool remapUVs(const TextureAtlas& atlas, const AtlasEntry& entry,
+              std::vector<glm::vec2>& uvs, size_t begin, size_t end)
+{
+	if (begin >= end)
+		return true;
+	const float kEpsilon = 1e-4f;
+	glm::vec2 lo = uvs[begin], hi = uvs[begin];
+	for (size_t i = begin; i < end; i++) {
+		lo = glm::min(lo, uvs[i]);
+		hi = glm::max(hi, uvs[i]);
+	}
+	glm::vec2 tile = glm::floor(lo + kEpsilon);
+	bool fits = hi.x - tile.x <= 1.0f + kEpsilon && hi.y - tile.y <= 1.0f + kEpsilon;
+
+	glm::vec2 offset(float(entry.x) / atlas.width, float(entry.y) / atlas.height);
+	glm::vec2 scale(float(entry.width) / atlas.width, float(entry.height) / atlas.height);
+	for (size_t i = begin; i < end; i++) {
+		glm::vec2 uv = glm::clamp(uvs[i] - tile, glm::vec2(0.0f), glm::vec2(1.0f));
+		uvs[i] = offset + uv * scale;
+	}
+	return fits;
+}
@@ -0,0 +1,52 @@
+#ifndef NPR_ATLAS_H
+#define NPR_ATLAS_H
+
+#include "texture.h"
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Where one source image landed, in atlas texels from the bottom left and
+// excluding its padding.
+struct AtlasEntry {
+	std::string name;
+	int x = 0;
+	int y = 0;
+	int width = 0;
+	int height = 0;
+};
+
+struct TextureAtlas {
+	int width = 0;
+	int height = 0;
+	int padding = 0;
+	std::vector<AtlasEntry> entries;
+
+	const AtlasEntry* find(const std::string& name) const;
+	// Levels a mip chain of the atlas may have before neighbours bleed into
+	// each other; padding and placement keep that many levels apart.
+	int mipLevels() const;
+};
+
+/*
+ * Packs images into the smallest power of two atlas no larger than
+ * max_size with stbrp_pack_rects. Each image gets padding texels of
+ * repeated edge on every side and starts on a multiple of padding, so the
+ * first mipLevels() levels stay separate. Fills pixels with the packed
+ * image; returns false if the images don't fit.
+ */
+bool buildAtlas(const std::vector<Image>& images, const std::vector<std::string>& names,
+                int padding, int max_size, TextureAtlas& atlas, Image& pixels);
+
+// Plain text layout stored next to a baked atlas image.
+bool saveAtlasLayout(const std::string& path, const TextureAtlas& atlas);
+bool loadAtlasLayout(const std::string& path, TextureAtlas& atlas);
+
+// Rewrites uvs[begin, end) from one material's texture into its atlas
+// entry. The range is first shifted by whole tiles into [0, 1]; uvs that
+// tile more than once can't be atlased, are clamped and return false.
+bool remapUVs(const TextureAtlas& atlas, const AtlasEntry& entry,
+              std::vector<glm::vec2>& uvs, size_t begin, size_t end);
+
+#endif
@@ -0,0 +1,368 @@
+#include "batch.h"
+#include "edge_outline.h"
+#include "gl_debug.h"
+#include "gl_state.h"
+#include "gpu_timer.h"
+#include "headless.h"
+#include "image_io.h"
+#include "model.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "scene.h"
+#include "shader.h"
+#include "tam.h"
+#include "uniforms.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct Job {
+	std::string model;
+	unsigned int features = 0;
+	float yaw = 0.0f, pitch = 0.0f;
+	int width = 0, height = 0;
+	std::string output;
+	std::string texture;
+};
+
+enum JobStatus : int {
+	kJobPending,
+	kJobWritten,
+	kJobFailed,
+};
+
+struct JobResult {
+	std::atomic<int> status;
+	int worker;
+	float milliseconds;
+};
+
+// Lives in a MAP_SHARED mapping made before the fork, so every worker and
+// the parent see the same counter and results.
+struct BatchQueue {
+	std::atomic<int> next;
+	int count;
+	JobResult results[1];
+};
+
+bool parseJobs(const std::string& path, std::vector<Job>& jobs)
+{
+	std::ifstream file(path);
+	if (!file) {
+		printf("Cannot open %s\n", path.c_str());
+		return false;
+	}
+	std::string line;
+	for (int number = 1; std::getline(file, line); number++) {
+		std::istringstream stream(line);
+		std::string style, view, size;
+		Job job;
+		if (!(stream >> job.model) || job.model[0] == '#')
+			continue;
+		if (!(stream >> style >> view >> size >> job.output) ||
+		    sscanf(view.c_str(), "%f,%f", &job.yaw, &job.pitch) != 2 ||
+		    sscanf(size.c_str(), "%dx%d", &job.width, &job.height) != 2) {
+			printf("%s:%d: expected <model> <style> <yaw>,<pitch> <width>x<height> <output> [texture]\n",
+			       path.c_str(), number);
+			return false;
+		}
+		stream >> job.texture;
+		if (style != "-" && !parseShaderFeatures(style, job.features)) {
+			printf("%s:%d: bad style\n", path.c_str(), number);
+			return false;
+		}
+		jobs.push_back(job);
+	}
+	return true;
+}
+
+/*
+ * Everything one worker keeps between jobs: its context, the models it
+ * has loaded with their buffers, textures, programs and a target per
+ * image size.
+ */
+class Worker {
+public:
+	Worker(const BatchOptions& options) : options_(options), programs_(options.program_cache) {}
+	~Worker();
+
+	bool create();
+	bool render(const Job& job);
+
+private:
+	struct ResidentModel {
+		ModelData data;
+		SceneBuffers buffers;
+	};
+
+	ResidentModel* model(const std::string& path);
+	GLuint texture(const std::string& path);
+	OffscreenTarget* target(int width, int height);
+
+	const BatchOptions& options_;
+	HeadlessContext context_;
+	GLuint vertex_array_ = 0;
+	ProgramCache programs_;
+	EdgeOutline edges_;
+	UniformBuffer uniform_buffer_;
+	GLuint tam_texture_ = 0;
+	int tam_tones_ = 0;
+	std::map<std::string, std::unique_ptr<ResidentModel>> models_;
+	std::map<std::string, GLuint> textures_;
+	std::map<std::pair<int, int>, std::unique_ptr<OffscreenTarget>> targets_;
+};
+
+Worker::~Worker()
+{
+	// The context may never have been made.
+	if (!vertex_array_)
+		return;
+	for (auto& model : models_)
+		if (model.second)
+			deleteSceneBuffers(model.second->buffers);
+	for (auto& texture : textures_)
+		if (texture.second)
+			glDeleteTextures(1, &texture.second);
+	glDeleteTextures(1, &tam_texture_);
+	glDeleteVertexArrays(1, &vertex_array_);
+}
+
+bool Worker::create()
+{
+	if (!context_.create())
+		return false;
+	setupGLDebugOutput(false);
+	glState().sync();
+	glGenVertexArrays(1, &vertex_array_);
+	glState().bindVertexArray(vertex_array_);
+	if (!programs_.setSources(options_.vertex_source, options_.fragment_source,
+	                          options_.geometry_source))
+		return false;
+	uniform_buffer_.create();
+	TonalArtMap tonal_art_map;
+	buildTonalArtMap(kTAMSize, kTAMTones, tonal_art_map);
+	tam_texture_ = uploadTonalArtMap(tonal_art_map);
+	tam_tones_ = tonal_art_map.tones;
+	return true;
+}
+
+Worker::ResidentModel* Worker::model(const std::string& path)
+{
+	auto it = models_.find(path);
+	if (it != models_.end())
+		return it->second.get();
+	std::unique_ptr<ResidentModel> model(new ResidentModel);
+	if (!loadModel(path, model->data)) {
+		printf("Failed to load %s\n", path.c_str());
+		model.reset();
+	} else {
+		createSceneBuffers(model->buffers);
+		uploadMesh(model->data.mesh, model->buffers.vertex, model->buffers.uv,
+		           model->buffers.normal, model->buffers.element);
+	}
+	// Failures are remembered too, so later jobs don't retry the load.
+	return (models_[path] = std::move(model)).get();
+}
+
+GLuint Worker::texture(const std::string& path)
+{
+	if (path.empty())
+		return 0;
+	auto it = textures_.find(path);
+	if (it != textures_.end())
+		return it->second;
+	TextureOptions texture_options = options_.texture_options;
+	if (!GLEW_EXT_texture_compression_s3tc)
+		texture_options.compress = false;
+	return textures_[path] = loadTexture(path, texture_options);
+}
+
+OffscreenTarget* Worker::target(int width, int height)
+{
+	std::unique_ptr<OffscreenTarget>& target = targets_[std::make_pair(width, height)];
+	if (!target) {
+		target.reset(new OffscreenTarget);
+		// Multisampled like --headless.
+		if (!target->create(width, height, 4)) {
+			target.reset();
+			targets_.erase(std::make_pair(width, height));
+		}
+	}
+	return target.get();
+}
+
+bool Worker::render(const Job& job)
+{
+	PROFILE_ZONE("batch job");
+	ResidentModel* resident = model(job.model);
+	OffscreenTarget* offscreen = target(job.width, job.height);
+	SceneSettings settings;
+	if (!setScenePrograms(programs_, job.features, settings) || !resident || !offscreen)
+		return false;
+	if (job.features & kShaderEdges)
+		settings.edges = &edges_;
+	settings.hatching_texture = texture(job.texture);
+	settings.tonal_art_map = tam_texture_;
+
+	FrameBlock frame;
+	MaterialBlock material;
+	StyleBlock style;
+	glm::vec4 background;
+	defaultLook(frame, material, style, background);
+	style.tam_tones = tam_tones_;
+	settings.outline_size = style.outline_size;
+	glm::vec3 eye;
+	fitCamera(resident->data.mesh, float(job.width) / job.height, frame.projection, frame.view, eye,
+	          job.yaw, job.pitch);
+	frame.model = glm::mat4(1.0f);
+	frame.camera_position = eye;
+	frame.viewport_size = glm::vec2(job.width, job.height);
+	uniform_buffer_.set(frame);
+	uniform_buffer_.set(material);
+	uniform_buffer_.set(style);
+	uniform_buffer_.flush();
+
+	offscreen->bind();
+	clearScene(background);
+	GPUTimer untimed;
+	drawScene(resident->data, resident->buffers, settings, frame.projection * frame.view, eye, untimed);
+	Image image;
+	offscreen->read(image);
+	return saveImage(job.output, image);
+}
+
+int runWorker(int index, const std::vector<Job>& jobs, BatchQueue* queue, const BatchOptions& options)
+{
+	PROFILE_THREAD("batch worker");
+	// A worker without a context takes no jobs, so the others get them.
+	Worker worker(options);
+	if (!worker.create())
+		return 1;
+	for (;;) {
+		int job = queue->next.fetch_add(1);
+		if (job >= queue->count)
+			break;
+		JobResult& result = queue->results[job];
+		result.worker = index;
+		auto start = std::chrono::steady_clock::now();
+		bool written = worker.render(jobs[job]);
+		result.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		result.status = written ? kJobWritten : kJobFailed;
+	}
+	return 0;
+}
+
+// Nearest rank, like the GPU timings window.
+float percentile(const std::vector<float>& sorted, double fraction)
+{
+	size_t rank = size_t(std::ceil(fraction * sorted.size()));
+	return sorted[std::max(rank, size_t(1)) - 1];
+}
+
+}
+
+int runBatch(const std::string& jobs_path, const BatchOptions& options)
+{
+	std::vector<Job> jobs;
+	if (!parseJobs(jobs_path, jobs))
+		return -1;
+	if (jobs.empty()) {
+		printf("No jobs in %s\n", jobs_path.c_str());
+		return -1;
+	}
+	int workers = options.workers > 0 ? options.workers : int(workerCount());
+	workers = std::min(workers, int(jobs.size()));
+
+	size_t queue_size = sizeof(BatchQueue) + (jobs.size() - 1) * sizeof(JobResult);
+	void* mapping = mmap(nullptr, queue_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	BatchQueue* queue = static_cast<BatchQueue*>(mapping);
+	queue->next = 0;
+	queue->count = int(jobs.size());
+	for (size_t i = 0; i < jobs.size(); i++) {
+		queue->results[i].status = kJobPending;
+		queue->results[i].worker = -1;
+		queue->results[i].milliseconds = 0.0f;
+	}
+
+	printf("Rendering %zu jobs with %d workers\n", jobs.size(), workers);
+	fflush(stdout);
+	auto start = std::chrono::steady_clock::now();
+	std::vector<pid_t> children;
+	for (int i = 0; i < workers; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			// llvmpipe otherwise starts a rasterizer thread per core in
+			// every worker; the processes already cover the cores.
+			if (workers > 1)
+				setenv("LP_NUM_THREADS", "1", 0);
+			int status = runWorker(i, jobs, queue, options);
+			// The zones are in this process, not the parent's trace.
+			if (!options.profile_path.empty())
+				writeProfileTrace(options.profile_path + "." + std::to_string(i));
+			fflush(stdout);
+			_exit(status);
+		}
+		if (pid < 0) {
+			perror("fork");
+			break;
+		}
+		children.push_back(pid);
+	}
+	for (pid_t child : children) {
+		int status = 0;
+		waitpid(child, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			printf("Worker %d exited abnormally\n", int(child));
+	}
+	float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<float> latencies;
+	std::vector<int> per_worker(workers, 0);
+	int failed = 0;
+	for (int i = 0; i < queue->count; i++) {
+		const JobResult& result = queue->results[i];
+		if (result.status != kJobWritten) {
+			// Pending means its worker died on it or none could start.
+			printf("Failed: %s -> %s\n", jobs[i].model.c_str(), jobs[i].output.c_str());
+			failed++;
+			continue;
+		}
+		latencies.push_back(result.milliseconds);
+		per_worker[result.worker]++;
+	}
+	munmap(mapping, queue_size);
+
+	printf("%zu images in %.2f s, %.2f images/s\n", latencies.size(), seconds, latencies.size() / seconds);
+	if (!latencies.empty()) {
+		std::sort(latencies.begin(), latencies.end());
+		float sum = 0.0f;
+		for (float v : latencies)
+			sum += v;
+		printf("job ms: min %.1f  avg %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+		       latencies.front(), sum / latencies.size(), percentile(latencies, 0.5),
+		       percentile(latencies, 0.9), percentile(latencies, 0.99), latencies.back());
+	}
+	for (int i = 0; i < workers; i++)
+		printf("worker %d: %d jobs\n", i, per_worker[i]);
+	return failed == 0 && !children.empty() ? 0 : -1;
+}
@@ -0,0 +1,40 @@
+#ifndef NPR_BATCH_H
+#define NPR_BATCH_H
+
+#include "texture.h"
+
+#include <string>
+
+struct BatchOptions {
+	// Worker processes, 0 for one per core.
+	int workers = 0;
+	TextureOptions texture_options;
+	bool program_cache = true;
+	// The embedded shaders main builds the viewer's programs from.
+	std::string vertex_source;
+	std::string fragment_source;
+	std::string geometry_source;
+	// --profile: each worker writes its zones to <path>.<worker index>.
+	std::string profile_path;
+};
+
+/*
+ * --batch: renders every job in a job list the way --headless renders one.
+ * Each line is
+ *
+ *   <model> <style> <yaw>,<pitch> <width>x<height> <output> [hatching texture]
+ *
+ * with style as for --style ("-" for none) and the camera framed as in
+ * --headless, then turned yaw degrees around the model and pitch degrees
+ * up. Blank lines and lines starting with # are skipped.
+ *
+ * The workers are forked processes with their own EGL context, taking the
+ * next job off a counter in shared memory, so a slow job holds up nothing
+ * else. Each keeps every model, texture, program and target it has used,
+ * so jobs sorted by model load each once per worker. Prints images per
+ * second and job latency percentiles at the end; returns 0 if every job
+ * was written.
+ */
+int runBatch(const std::string& jobs_path, const BatchOptions& options);
+
+#endif
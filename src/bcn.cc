@@ -0,0 +1,480 @@
+#include "bcn.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// One 4x4 block, colour as structure of arrays for four-wide distance tests.
+struct Block {
+	alignas(16) float r[16];
+	alignas(16) float g[16];
+	alignas(16) float b[16];
+	unsigned char a[16];
+};
+
+struct Palette {
+	float r[4], g[4], b[4];
+};
+
+int expand5(int v) { return v << 3 | v >> 2; }
+int expand6(int v) { return v << 2 | v >> 4; }
+
+int quantize(float v, int max)
+{
+	return std::min(std::max(int(v * max / 255.0f + 0.5f), 0), max);
+}
+
+uint16_t pack565(const float color[3])
+{
+	return quantize(color[0], 31) << 11 | quantize(color[1], 63) << 5 | quantize(color[2], 31);
+}
+
+void unpack565(uint16_t c, float color[3])
+{
+	color[0] = expand5(c >> 11);
+	color[1] = expand6(c >> 5 & 63);
+	color[2] = expand5(c & 31);
+}
+
+// Four colour mode: the endpoints and the colours a third of the way in.
+Palette buildPalette(uint16_t c0, uint16_t c1)
+{
+	float e0[3], e1[3];
+	unpack565(c0, e0);
+	unpack565(c1, e1);
+	Palette p;
+	float* channels[3] = { p.r, p.g, p.b };
+	for (int c = 0; c < 3; c++) {
+		channels[c][0] = e0[c];
+		channels[c][1] = e1[c];
+		channels[c][2] = (2.0f * e0[c] + e1[c]) / 3.0f;
+		channels[c][3] = (e0[c] + 2.0f * e1[c]) / 3.0f;
+	}
+	return p;
+}
+
+// Nearest palette entry for every pixel; returns the summed squared error.
+float selectIndices(const Block& block, const Palette& p, unsigned char indices[16])
+{
+#if defined(__SSE2__)
+	__m128 total = _mm_setzero_ps();
+	for (int i = 0; i < 16; i += 4) {
+		__m128 r = _mm_load_ps(block.r + i);
+		__m128 g = _mm_load_ps(block.g + i);
+		__m128 b = _mm_load_ps(block.b + i);
+		__m128 best = _mm_set1_ps(1e30f);
+		__m128i best_index = _mm_setzero_si128();
+		for (int k = 0; k < 4; k++) {
+			__m128 dr = _mm_sub_ps(r, _mm_set1_ps(p.r[k]));
+			__m128 dg = _mm_sub_ps(g, _mm_set1_ps(p.g[k]));
+			__m128 db = _mm_sub_ps(b, _mm_set1_ps(p.b[k]));
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+			best = _mm_min_ps(best, d);
+			best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)),
+			                          _mm_andnot_si128(closer, best_index));
+		}
+		total = _mm_add_ps(total, best);
+		alignas(16) int32_t lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), best_index);
+		for (int j = 0; j < 4; j++)
+			indices[i + j] = lanes[j];
+	}
+	alignas(16) float sums[4];
+	_mm_store_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float best = 1e30f;
+		for (int k = 0; k < 4; k++) {
+			float dr = block.r[i] - p.r[k], dg = block.g[i] - p.g[k], db = block.b[i] - p.b[k];
+			float d = dr * dr + dg * dg + db * db;
+			if (d < best) {
+				best = d;
+				indices[i] = k;
+			}
+		}
+		total += best;
+	}
+	return total;
+#endif
+}
+
+struct ColorCandidate {
+	uint16_t c0 = 0, c1 = 0;
+	unsigned char indices[16];
+	float error = 1e30f;
+};
+
+bool tryEndpoints(const Block& block, uint16_t c0, uint16_t c1, ColorCandidate& best)
+{
+	ColorCandidate candidate;
+	candidate.c0 = c0;
+	candidate.c1 = c1;
+	candidate.error = selectIndices(block, buildPalette(c0, c1), candidate.indices);
+	if (candidate.error >= best.error)
+		return false;
+	best = candidate;
+	return true;
+}
+
+// Least squares endpoints for fixed indices. Fails when every pixel uses
+// the same weight, which leaves the system singular.
+bool refineEndpoints(const Block& block, const unsigned char indices[16], float e0[3], float e1[3])
+{
+	static const float kWeight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0, bb = 0, ab = 0;
+	float ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		float w0 = kWeight0[indices[i]], w1 = 1.0f - w0;
+		aa += w0 * w0;
+		bb += w1 * w1;
+		ab += w0 * w1;
+		float x[3] = { block.r[i], block.g[i], block.b[i] };
+		for (int c = 0; c < 3; c++) {
+			ax[c] += w0 * x[c];
+			bx[c] += w1 * x[c];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if (std::abs(det) < 1e-6f)
+		return false;
+	for (int c = 0; c < 3; c++) {
+		e0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / det, 0.0f), 255.0f);
+		e1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / det, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+// Endpoint pairs whose two-thirds blend lands closest to each 8-bit value,
+// so flat blocks come out nearly exact despite 5:6:5 endpoints.
+struct SingleColor {
+	unsigned char e0[256], e1[256];
+
+	explicit SingleColor(int bits)
+	{
+		int max = (1 << bits) - 1;
+		for (int v = 0; v < 256; v++) {
+			float best = 1e30f;
+			for (int a = 0; a <= max; a++)
+				for (int b = 0; b <= max; b++) {
+					float ea = bits == 5 ? expand5(a) : expand6(a);
+					float eb = bits == 5 ? expand5(b) : expand6(b);
+					float error = std::abs((2.0f * ea + eb) / 3.0f - v) + 0.001f * std::abs(a - b);
+					if (error < best) {
+						best = error;
+						e0[v] = a;
+						e1[v] = b;
+					}
+				}
+		}
+	}
+};
+
+void encodeColor(const Block& block, EncodeQuality quality, unsigned char* out)
+{
+	static const SingleColor single5(5), single6(6);
+	ColorCandidate best;
+
+	bool flat = true;
+	for (int i = 1; i < 16 && flat; i++)
+		flat = block.r[i] == block.r[0] && block.g[i] == block.g[0] && block.b[i] == block.b[0];
+	if (flat) {
+		int r = block.r[0], g = block.g[0], b = block.b[0];
+		tryEndpoints(block, single5.e0[r] << 11 | single6.e0[g] << 5 | single5.e0[b],
+		             single5.e1[r] << 11 | single6.e1[g] << 5 | single5.e1[b], best);
+	} else {
+		float e0[3], e1[3];
+		if (quality == EncodeQuality::Fast) {
+			// Bounding box, inset a little since the extremes are rarely used.
+			float lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+			for (int i = 0; i < 16; i++) {
+				float x[3] = { block.r[i], block.g[i], block.b[i] };
+				for (int c = 0; c < 3; c++) {
+					lo[c] = std::min(lo[c], x[c]);
+					hi[c] = std::max(hi[c], x[c]);
+				}
+			}
+			for (int c = 0; c < 3; c++) {
+				float inset = (hi[c] - lo[c]) / 16.0f;
+				e0[c] = hi[c] - inset;
+				e1[c] = lo[c] + inset;
+			}
+		} else {
+			// Endpoints at the extremes along the principal axis.
+			float mean[3] = { 0, 0, 0 };
+			for (int i = 0; i < 16; i++) {
+				mean[0] += block.r[i] / 16.0f;
+				mean[1] += block.g[i] / 16.0f;
+				mean[2] += block.b[i] / 16.0f;
+			}
+			float cov[6] = { 0, 0, 0, 0, 0, 0 };
+			for (int i = 0; i < 16; i++) {
+				float d[3] = { block.r[i] - mean[0], block.g[i] - mean[1], block.b[i] - mean[2] };
+				cov[0] += d[0] * d[0];
+				cov[1] += d[0] * d[1];
+				cov[2] += d[0] * d[2];
+				cov[3] += d[1] * d[1];
+				cov[4] += d[1] * d[2];
+				cov[5] += d[2] * d[2];
+			}
+			float axis[3] = { 1.0f, 1.0f, 1.0f };
+			for (int iteration = 0; iteration < 8; iteration++) {
+				float next[3] = {
+					cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+					cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+					cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+				};
+				float length = std::max(std::max(std::abs(next[0]), std::abs(next[1])), std::abs(next[2]));
+				if (length < 1e-6f)
+					break;
+				for (int c = 0; c < 3; c++)
+					axis[c] = next[c] / length;
+			}
+			float length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+			float lo = 1e30f, hi = -1e30f;
+			for (int i = 0; i < 16; i++) {
+				float t = ((block.r[i] - mean[0]) * axis[0] + (block.g[i] - mean[1]) * axis[1] +
+				           (block.b[i] - mean[2]) * axis[2]) / length2;
+				lo = std::min(lo, t);
+				hi = std::max(hi, t);
+			}
+			for (int c = 0; c < 3; c++) {
+				e0[c] = std::min(std::max(mean[c] + hi * axis[c], 0.0f), 255.0f);
+				e1[c] = std::min(std::max(mean[c] + lo * axis[c], 0.0f), 255.0f);
+			}
+		}
+		tryEndpoints(block, pack565(e0), pack565(e1), best);
+
+		int refinements = quality == EncodeQuality::Fast ? 0 : quality == EncodeQuality::Normal ? 1 : 4;
+		for (int i = 0; i < refinements; i++)
+			if (!refineEndpoints(block, best.indices, e0, e1) ||
+			    !tryEndpoints(block, pack565(e0), pack565(e1), best))
+				break;
+
+		if (quality == EncodeQuality::High) {
+			// Nudge each quantized endpoint channel by one step while that
+			// keeps lowering the error.
+			static const uint16_t kSteps[3] = { 1 << 11, 1 << 5, 1 };
+			static const uint16_t kMasks[3] = { 31 << 11, 63 << 5, 31 };
+			bool improved = true;
+			for (int pass = 0; pass < 8 && improved; pass++) {
+				improved = false;
+				for (int endpoint = 0; endpoint < 2; endpoint++)
+					for (int c = 0; c < 3; c++)
+						for (int sign = -1; sign <= 1; sign += 2) {
+							uint16_t value = endpoint == 0 ? best.c0 : best.c1;
+							int field = (value & kMasks[c]) / kSteps[c] + sign;
+							if (field < 0 || field > kMasks[c] / kSteps[c])
+								continue;
+							value = (value & ~kMasks[c]) | field * kSteps[c];
+							if (endpoint == 0)
+								improved |= tryEndpoints(block, value, best.c1, best);
+							else
+								improved |= tryEndpoints(block, best.c0, value, best);
+						}
+			}
+		}
+	}
+
+	// Four colour mode needs c0 > c1; swapping the endpoints maps each
+	// index to its partner, which is index ^ 1.
+	if (best.c0 < best.c1) {
+		std::swap(best.c0, best.c1);
+		for (int i = 0; i < 16; i++)
+			best.indices[i] ^= 1;
+	} else if (best.c0 == best.c1) {
+		memset(best.indices, 0, sizeof(best.indices));
+	}
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= uint32_t(best.indices[i]) << (2 * i);
+	out[0] = best.c0 & 0xFF;
+	out[1] = best.c0 >> 8;
+	out[2] = best.c1 & 0xFF;
+	out[3] = best.c1 >> 8;
+	memcpy(out + 4, &bits, 4);
+}
+
+void alphaPalette(int a0, int a1, int palette[8])
+{
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1) {
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+	} else {
+		for (int i = 2; i < 6; i++)
+			palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+int selectAlpha(const unsigned char alpha[16], int a0, int a1, unsigned char indices[16])
+{
+	int palette[8];
+	alphaPalette(a0, a1, palette);
+	int total = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 1 << 30;
+		for (int k = 0; k < 8; k++) {
+			int d = std::abs(alpha[i] - palette[k]);
+			if (d < best) {
+				best = d;
+				indices[i] = k;
+			}
+		}
+		total += best * best;
+	}
+	return total;
+}
+
+void encodeAlpha(const unsigned char alpha[16], EncodeQuality quality, unsigned char* out)
+{
+	int lo = 255, hi = 0, inner_lo = 255, inner_hi = 0;
+	for (int i = 0; i < 16; i++) {
+		lo = std::min<int>(lo, alpha[i]);
+		hi = std::max<int>(hi, alpha[i]);
+		if (alpha[i] != 0 && alpha[i] != 255) {
+			inner_lo = std::min<int>(inner_lo, alpha[i]);
+			inner_hi = std::max<int>(inner_hi, alpha[i]);
+		}
+	}
+
+	int a0 = hi, a1 = lo;
+	unsigned char indices[16];
+	int error = selectAlpha(alpha, a0, a1, indices);
+	if (quality != EncodeQuality::Fast && error > 0) {
+		// Six value mode spends two entries on exact 0 and 255, which wins
+		// for cut-out edges.
+		if (inner_lo > inner_hi)
+			inner_lo = inner_hi = lo;
+		unsigned char inner_indices[16];
+		int inner_error = selectAlpha(alpha, inner_lo, inner_hi, inner_indices);
+		if (inner_error < error) {
+			a0 = inner_lo;
+			a1 = inner_hi;
+			memcpy(indices, inner_indices, sizeof(indices));
+		}
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= uint64_t(indices[i]) << (3 * i);
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = bits >> (8 * i) & 0xFF;
+}
+
+size_t blockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+}
+
+size_t blockCompressedSize(int width, int height, BlockFormat format)
+{
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+void encodeBlocks(const unsigned char* rgba, int width, int height, BlockFormat format,
+                  EncodeQuality quality, unsigned char* out)
+{
+	int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+	size_t block_size = blockBytes(format);
+	parallelFor(blocks_y, 4, [&](size_t begin, size_t end) {
+		Block block;
+		for (size_t by = begin; by < end; by++)
+			for (int bx = 0; bx < blocks_x; bx++) {
+				for (int i = 0; i < 16; i++) {
+					int x = std::min(bx * 4 + i % 4, width - 1);
+					int y = std::min(int(by) * 4 + i / 4, height - 1);
+					const unsigned char* pixel = rgba + (size_t(y) * width + x) * 4;
+					block.r[i] = pixel[0];
+					block.g[i] = pixel[1];
+					block.b[i] = pixel[2];
+					block.a[i] = pixel[3];
+				}
+				unsigned char* dst = out + (by * blocks_x + bx) * block_size;
+				if (format == BlockFormat::BC3) {
+					encodeAlpha(block.a, quality, dst);
+					dst += 8;
+				}
+				encodeColor(block, quality, dst);
+			}
+	});
+}
+
+void decodeBlocks(const unsigned char* blocks, int width, int height, BlockFormat format,
+                  unsigned char* rgba)
+{
+	int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+	size_t block_size = blockBytes(format);
+	for (int by = 0; by < blocks_y; by++)
+		for (int bx = 0; bx < blocks_x; bx++) {
+			const unsigned char* block = blocks + (size_t(by) * blocks_x + bx) * block_size;
+			int alpha[8] = { 255, 255, 255, 255, 255, 255, 255, 255 };
+			uint64_t alpha_bits = 0;
+			if (format == BlockFormat::BC3) {
+				alphaPalette(block[0], block[1], alpha);
+				for (int i = 0; i < 6; i++)
+					alpha_bits |= uint64_t(block[2 + i]) << (8 * i);
+				block += 8;
+			}
+
+			uint16_t c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+			float e0[3], e1[3];
+			unpack565(c0, e0);
+			unpack565(c1, e1);
+			int colors[4][4];
+			for (int c = 0; c < 3; c++) {
+				int a = e0[c], b = e1[c];
+				colors[0][c] = a;
+				colors[1][c] = b;
+				if (c0 > c1 || format == BlockFormat::BC3) {
+					colors[2][c] = (2 * a + b) / 3;
+					colors[3][c] = (a + 2 * b) / 3;
+				} else {
+					colors[2][c] = (a + b) / 2;
+					colors[3][c] = 0;
+				}
+			}
+			uint32_t bits = block[4] | block[5] << 8 | block[6] << 16 | uint32_t(block[7]) << 24;
+			for (int i = 0; i < 16; i++) {
+				int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+				if (x >= width || y >= height)
+					continue;
+				unsigned char* pixel = rgba + (size_t(y) * width + x) * 4;
+				const int* color = colors[bits >> (2 * i) & 3];
+				pixel[0] = color[0];
+				pixel[1] = color[1];
+				pixel[2] = color[2];
+				pixel[3] = alpha[alpha_bits >> (3 * i) & 7];
+			}
+		}
+}
+
+double computePSNR(const unsigned char* a, const unsigned char* b, size_t pixels, int channels)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < pixels; i++)
+		for (int c = 0; c < channels; c++) {
+			double d = double(a[i * 4 + c]) - b[i * 4 + c];
+			sum += d * d;
+		}
+	double mse = sum / (double(pixels) * channels);
+	if (mse == 0.0)
+		return INFINITY;
+	return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,32 @@
+#ifndef NPR_BCN_H
+#define NPR_BCN_H
+
+#include <cstddef>
+
+enum class BlockFormat {
+	BC1,  // RGB, 8 bytes per 4x4 block
+	BC3,  // BC1 colour plus interpolated alpha, 16 bytes per block
+};
+
+enum class EncodeQuality {
+	Fast,    // bounding box endpoints
+	Normal,  // principal axis endpoints with a least squares refinement
+	High,    // Normal plus a local search over the quantized endpoints
+};
+
+size_t blockCompressedSize(int width, int height, BlockFormat format);
+
+// Compresses 8-bit RGBA rows into blocks, in the same row order, with block
+// rows split across worker threads. Edge blocks repeat the last row and
+// column. out must hold blockCompressedSize bytes.
+void encodeBlocks(const unsigned char* rgba, int width, int height, BlockFormat format,
+                  EncodeQuality quality, unsigned char* out);
+
+// Expands blocks back to RGBA, mainly to measure encoding error.
+void decodeBlocks(const unsigned char* blocks, int width, int height, BlockFormat format,
+                  unsigned char* rgba);
+
+// Peak signal to noise ratio in dB over the first channels of each pixel.
+double computePSNR(const unsigned char* a, const unsigned char* b, size_t pixels, int channels);
+
+#endif
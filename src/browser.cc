@@ -0,0 +1,370 @@
+#include "browser.h"
+#include "asset.h"
+#include "cache.h"
+#include "config.h"
+#include "gl_state.h"
+#include "mapped_file.h"
+#include "model.h"
+#include "profiler.h"
+#include "scene.h"
+#include "imgui.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+namespace {
+
+void collect(const std::string& root, const std::string& relative,
+             std::vector<std::pair<std::string, std::string>>& models)
+{
+	std::string directory = relative.empty() ? root : root + "/" + relative;
+	DIR* dir = opendir(directory.c_str());
+	if (!dir)
+		return;
+	std::vector<std::string> names;
+	while (dirent* entry = readdir(dir))
+		if (entry->d_name[0] != '.')
+			names.push_back(entry->d_name);
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+
+	for (const std::string& name : names) {
+		std::string child = relative.empty() ? name : relative + "/" + name;
+		struct stat st;
+		if (stat((root + "/" + child).c_str(), &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			collect(root, child, models);
+		else if (S_ISREG(st.st_mode) && isModelFile(name))
+			models.push_back({ root + "/" + child, child });
+	}
+}
+
+GLuint createThumbnailTexture()
+{
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glState().bindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, kThumbnailSize, kThumbnailSize, 0,
+	             GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return texture;
+}
+
+}
+
+AssetBrowser::AssetBrowser()
+{
+	thread_ = std::thread(&AssetBrowser::work, this);
+}
+
+AssetBrowser::~AssetBrowser()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	wake_.notify_all();
+	thread_.join();
+
+	for (Entry& entry : entries_)
+		if (entry.texture)
+			glState().deleteTextures(1, &entry.texture);
+	if (framebuffer_) {
+		glState().deleteFramebuffers(1, &framebuffer_);
+		glDeleteRenderbuffers(1, &depth_buffer_);
+		glState().deleteBuffers(4, buffers_);
+	}
+}
+
+void AssetBrowser::scan(const std::vector<std::string>& directories)
+{
+	directories_ = directories;
+	std::vector<std::pair<std::string, std::string>> models;
+	for (const std::string& directory : directories)
+		collect(directory, "", models);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		jobs_.clear();
+		results_.clear();
+		generation_++;
+	}
+	wake_.notify_all();
+
+	// Keep the thumbnails of models that are still there.
+	std::vector<Entry> entries(models.size());
+	for (size_t i = 0; i < models.size(); i++) {
+		entries[i].path = models[i].first;
+		entries[i].name = models[i].second;
+		for (Entry& old : entries_)
+			if (old.path == entries[i].path) {
+				std::swap(entries[i].texture, old.texture);
+				entries[i].style = old.style;
+				entries[i].done = old.done;
+				break;
+			}
+	}
+	for (Entry& old : entries_)
+		if (old.texture)
+			glState().deleteTextures(1, &old.texture);
+	entries_.swap(entries);
+	if (has_style_)
+		queueStale();
+}
+
+void AssetBrowser::setStyle(uint64_t style)
+{
+	// Sliders change the style every frame while dragged; wait for them
+	// to settle rather than rendering every intermediate look.
+	if (!has_style_) {
+		has_style_ = true;
+		style_ = pending_style_ = style;
+		queueStale();
+	} else if (style != pending_style_) {
+		pending_style_ = style;
+		style_time_ = ImGui::GetTime();
+	}
+}
+
+void AssetBrowser::queueStale()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (size_t i = 0; i < entries_.size(); i++) {
+			Entry& entry = entries_[i];
+			if (entry.queued || (entry.done && entry.style == style_))
+				continue;
+			jobs_.push_back({ i, generation_, entry.path, style_ });
+			entry.queued = true;
+		}
+	}
+	wake_.notify_all();
+}
+
+void AssetBrowser::work()
+{
+	PROFILE_THREAD("asset browser");
+	// File contents are hashed once per version of the file.
+	struct FileHash {
+		std::string stamp;
+		uint64_t hash;
+	};
+	std::unordered_map<std::string, FileHash> hashes;
+	std::string directory = cacheDirectory("thumbnails");
+
+	while (true) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		// Don't run ahead of the GL thread, each result may hold a mesh.
+		wake_.wait(lock, [this] {
+			return quit_ || !saves_.empty() ||
+			       (!jobs_.empty() && results_.size() < size_t(kThumbnailsPerFrame));
+		});
+		if (quit_)
+			return;
+
+		if (!saves_.empty()) {
+			Save save = std::move(saves_.front());
+			saves_.pop_front();
+			lock.unlock();
+			if (!directory.empty())
+				saveBMP(directory + "/" + hexString(save.key) + ".bmp", save.image);
+			continue;
+		}
+
+		Job job = jobs_.front();
+		jobs_.pop_front();
+		lock.unlock();
+
+		Result result;
+		result.entry = job.entry;
+		result.generation = job.generation;
+		result.style = job.style;
+		result.key = 0;
+
+		std::string key, stamp;
+		bool known = false;
+		if (assetInfo(job.path, key, stamp)) {
+			auto found = hashes.find(key);
+			if (found != hashes.end() && found->second.stamp == stamp) {
+				result.key = found->second.hash;
+				known = true;
+			} else {
+				AssetData asset;
+				if (readAsset(job.path, asset)) {
+					result.key = hashBytes(asset.data(), asset.size());
+					hashes[key] = { stamp, result.key };
+					known = true;
+				}
+			}
+		}
+
+		if (known) {
+			result.key = hashBytes(&job.style, sizeof(job.style), result.key);
+			MappedFile file;
+			if (directory.empty() ||
+			    !file.open(directory + "/" + hexString(result.key) + ".bmp") ||
+			    !decodeBMP(file.data(), file.size(), result.image) ||
+			    result.image.width != kThumbnailSize || result.image.height != kThumbnailSize) {
+				result.image = Image();
+				result.mesh.reset(new Mesh);
+				if (!loadMesh(job.path, *result.mesh))
+					result.mesh.reset();
+			}
+		}
+
+		lock.lock();
+		results_.push_back(std::move(result));
+	}
+}
+
+void AssetBrowser::render(const Mesh& mesh, GLuint texture, const RenderCallback& callback, Image& pixels)
+{
+	if (!framebuffer_) {
+		glGenFramebuffers(1, &framebuffer_);
+		glGenRenderbuffers(1, &depth_buffer_);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer_);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, kThumbnailSize, kThumbnailSize);
+		glGenBuffers(4, buffers_);
+	}
+	uploadMesh(mesh, buffers_[0], buffers_[1], buffers_[2], buffers_[3]);
+
+	GLStateCache& state = glState();
+	GLStateSnapshot saved = state.save();
+	state.bindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer_);
+	state.viewport(0, 0, kThumbnailSize, kThumbnailSize);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	glm::mat4 projection, view;
+	glm::vec3 eye;
+	fitCamera(mesh, 1.0f, projection, view, eye);
+	callback(projection, view, eye);
+
+	for (GLuint i = 0; i < 3; i++) {
+		glEnableVertexAttribArray(i);
+		state.bindBuffer(GL_ARRAY_BUFFER, buffers_[i]);
+		glVertexAttribPointer(i, i == 1 ? 2 : 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	}
+	glDrawElements(GL_TRIANGLES, mesh.lods[0].index_count, GL_UNSIGNED_INT,
+	               (void*)(mesh.lods[0].index_offset * sizeof(unsigned int)));
+	for (GLuint i = 0; i < 3; i++)
+		glDisableVertexAttribArray(i);
+
+	pixels.width = kThumbnailSize;
+	pixels.height = kThumbnailSize;
+	pixels.pixels.resize(size_t(kThumbnailSize) * kThumbnailSize * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, kThumbnailSize, kThumbnailSize, GL_RGBA, GL_UNSIGNED_BYTE, pixels.pixels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	state.restore(saved);
+}
+
+void AssetBrowser::update(const RenderCallback& callback)
+{
+	PROFILE_ZONE("AssetBrowser::update");
+	if (pending_style_ != style_ && ImGui::GetTime() - style_time_ >= kThumbnailStyleDelay) {
+		style_ = pending_style_;
+		queueStale();
+	}
+
+	std::vector<Result> results;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		while (!results_.empty() && results.size() < size_t(kThumbnailsPerFrame)) {
+			results.push_back(std::move(results_.front()));
+			results_.pop_front();
+		}
+	}
+	if (results.empty())
+		return;
+	wake_.notify_all();
+
+	bool stale = false;
+	for (Result& result : results) {
+		if (result.generation != generation_)
+			continue;
+		Entry& entry = entries_[result.entry];
+		entry.queued = false;
+		entry.done = true;
+		entry.style = result.style;
+		stale = stale || result.style != style_;
+		if (result.image.pixels.empty() && !result.mesh)
+			continue;  // unreadable, keep whatever was shown before
+
+		if (!entry.texture)
+			entry.texture = createThumbnailTexture();
+		if (result.mesh) {
+			Save save;
+			save.key = result.key;
+			render(*result.mesh, entry.texture, callback, save.image);
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				saves_.push_back(std::move(save));
+			}
+			wake_.notify_all();
+		} else {
+			glState().bindTexture(GL_TEXTURE_2D, entry.texture);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kThumbnailSize, kThumbnailSize,
+			                GL_RGBA, GL_UNSIGNED_BYTE, result.image.pixels.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		}
+	}
+	// The style moved on while these were in flight.
+	if (stale)
+		queueStale();
+}
+
+bool AssetBrowser::draw(std::string& path)
+{
+	PROFILE_ZONE("AssetBrowser::draw");
+	bool picked = false;
+	ImGui::Begin("assets");
+	if (ImGui::Button("rescan"))
+		scan(directories_);
+	if (entries_.empty())
+		ImGui::Text("No models found");
+
+	float cell = kThumbnailSize + 2.0f * ImGui::GetStyle().FramePadding.x + ImGui::GetStyle().ItemSpacing.x;
+	int columns = std::max(int(ImGui::GetContentRegionAvail().x / cell), 1);
+	for (size_t i = 0; i < entries_.size(); i++) {
+		const Entry& entry = entries_[i];
+		ImGui::PushID(int(i));
+		if (i % columns != 0)
+			ImGui::SameLine();
+		ImGui::BeginGroup();
+		bool clicked;
+		ImVec2 size(kThumbnailSize, kThumbnailSize);
+		if (entry.texture) {
+			// Textures are bottom row first.
+			clicked = ImGui::ImageButton((ImTextureID)(intptr_t)entry.texture, size,
+			                             ImVec2(0.0f, 1.0f), ImVec2(1.0f, 0.0f));
+		} else {
+			clicked = ImGui::Button(entry.done ? "unreadable" : "...", ImVec2(size.x + 2.0f * ImGui::GetStyle().FramePadding.x,
+			                                                                   size.y + 2.0f * ImGui::GetStyle().FramePadding.y));
+		}
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("%s", entry.path.c_str());
+		ImGui::PushTextWrapPos(ImGui::GetCursorPosX() + kThumbnailSize);
+		ImGui::TextWrapped("%s", entry.name.c_str());
+		ImGui::PopTextWrapPos();
+		ImGui::EndGroup();
+		ImGui::PopID();
+		if (clicked) {
+			path = entry.path;
+			picked = true;
+		}
+	}
+	ImGui::End();
+	return picked;
+}
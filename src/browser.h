@@ -0,0 +1,113 @@
+#ifndef NPR_BROWSER_H
+#define NPR_BROWSER_H
+
+#include "mesh.h"
+#include "texture.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/*
+ * ImGui window listing the models under some directories, each with a
+ * thumbnail in the current shading style.
+ *
+ * A worker thread hashes the files, looks thumbnails up in the disk cache
+ * (keyed by file contents and style) and loads meshes for the ones that
+ * are missing. The GL thread renders or uploads at most
+ * kThumbnailsPerFrame of them per frame, so browsing never stalls the
+ * viewer, and hands rendered pixels back to the worker to be cached.
+ */
+class AssetBrowser {
+public:
+	AssetBrowser();
+	~AssetBrowser();
+	AssetBrowser(const AssetBrowser&) = delete;
+	AssetBrowser& operator=(const AssetBrowser&) = delete;
+
+	// Lists model files under directories, recursively.
+	void scan(const std::vector<std::string>& directories);
+
+	// Hash of everything that changes how thumbnails look. Thumbnails are
+	// redone once it has held still for kThumbnailStyleDelay seconds.
+	void setStyle(uint64_t style);
+
+	// Sets the matrix and camera uniforms of the bound program; every
+	// other uniform is left as the frame set it.
+	typedef std::function<void(const glm::mat4& projection, const glm::mat4& view,
+	                           const glm::vec3& eye)> RenderCallback;
+
+	// Renders or uploads a few thumbnails. Call with the scene program in
+	// use and its style uniforms set; binds framebuffer 0 again after.
+	void update(const RenderCallback& render);
+
+	// Draws the window. Returns true and sets path when a model is picked.
+	bool draw(std::string& path);
+
+private:
+	struct Entry {
+		std::string path;
+		std::string name;
+		GLuint texture = 0;
+		uint64_t style = 0;   // the thumbnail was made with
+		bool done = false;    // has a thumbnail, or failed to load
+		bool queued = false;
+	};
+
+	// Work for the thread and what comes back: a cached thumbnail to
+	// upload, a mesh to render, or pixels to save.
+	struct Job {
+		size_t entry;
+		unsigned int generation;
+		std::string path;
+		uint64_t style;
+	};
+	struct Result {
+		size_t entry;
+		unsigned int generation;
+		uint64_t style;
+		uint64_t key;
+		Image image;
+		std::unique_ptr<Mesh> mesh;
+	};
+	struct Save {
+		uint64_t key;
+		Image image;
+	};
+
+	void work();
+	void queueStale();
+	void render(const Mesh& mesh, GLuint texture, const RenderCallback& callback, Image& pixels);
+
+	// Entries are indexed by jobs; rescans bump generation_ so results for
+	// the old list get dropped.
+	std::vector<std::string> directories_;
+	std::vector<Entry> entries_;
+	unsigned int generation_ = 0;
+	bool has_style_ = false;
+	uint64_t style_ = 0;
+	uint64_t pending_style_ = 0;
+	double style_time_ = 0.0;
+
+	GLuint framebuffer_ = 0;
+	GLuint depth_buffer_ = 0;
+	GLuint buffers_[4] = {0, 0, 0, 0};
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::deque<Job> jobs_;
+	std::deque<Result> results_;
+	std::deque<Save> saves_;
+	bool quit_ = false;
+};
+
+#endif
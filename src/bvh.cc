@@ -0,0 +1,453 @@
+#include "bvh.h"
+#include "config.h"
+#include "parallel.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int kBins = 16;
+const unsigned int kLeafSize = 4;
+// Subtrees above this many triangles are built on their own thread, as
+// long as there are idle cores; the root binning pass goes wide too.
+const unsigned int kParallelThreshold = 1 << 15;
+const float kInfinity = std::numeric_limits<float>::infinity();
+
+struct AABB {
+	glm::vec3 lo = glm::vec3(kInfinity);
+	glm::vec3 hi = glm::vec3(-kInfinity);
+
+	void grow(const glm::vec3& p) { lo = glm::min(lo, p); hi = glm::max(hi, p); }
+	void grow(const AABB& box) { lo = glm::min(lo, box.lo); hi = glm::max(hi, box.hi); }
+	float area() const
+	{
+		glm::vec3 e = glm::max(hi - lo, glm::vec3(0.0f));
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+};
+
+// Everything the builder reads about a triangle, kept together and moved
+// by the partition so every pass walks memory linearly.
+struct PrimRef {
+	AABB box;
+	glm::vec3 centroid;
+	unsigned int id;
+};
+
+struct Bin {
+	AABB bounds;
+	unsigned int count = 0;
+};
+
+struct BuildNode {
+	AABB bounds;
+	unsigned int first = 0, count = 0;
+	std::unique_ptr<BuildNode> left, right;
+};
+
+class Builder {
+public:
+	explicit Builder(std::vector<PrimRef>& prims)
+		: prims_(prims)
+	{
+	}
+
+	// width is how many subtrees are being built concurrently at this level.
+	void build(BuildNode* node, unsigned int first, unsigned int count, unsigned int width);
+
+private:
+	void bounds(unsigned int first, unsigned int count, bool wide, AABB& box, AABB& centroid_box) const;
+	void binning(unsigned int first, unsigned int count, bool wide,
+	             const AABB& centroid_box, Bin (*bins)[kBins]) const;
+
+	std::vector<PrimRef>& prims_;
+};
+
+int binOf(float c, float lo, float scale)
+{
+	int b = (int)((c - lo) * scale);
+	return std::min(std::max(b, 0), kBins - 1);
+}
+
+void Builder::bounds(unsigned int first, unsigned int count, bool wide, AABB& box, AABB& centroid_box) const
+{
+	std::mutex merge;
+	auto pass = [&](size_t begin, size_t end) {
+		AABB local, local_centroids;
+		for (size_t i = first + begin; i < first + end; i++) {
+			local.grow(prims_[i].box);
+			local_centroids.grow(prims_[i].centroid);
+		}
+		std::lock_guard<std::mutex> lock(merge);
+		box.grow(local);
+		centroid_box.grow(local_centroids);
+	};
+	if (wide)
+		parallelFor(count, kParallelThreshold / 4, pass);
+	else
+		pass(0, count);
+}
+
+// Bins all three axes in one walk over the triangles.
+void Builder::binning(unsigned int first, unsigned int count, bool wide,
+                      const AABB& centroid_box, Bin (*bins)[kBins]) const
+{
+	glm::vec3 lo = centroid_box.lo;
+	glm::vec3 extent = centroid_box.hi - centroid_box.lo;
+	glm::vec3 scale;
+	for (int axis = 0; axis < 3; axis++)
+		scale[axis] = extent[axis] > 0.0f ? kBins / extent[axis] : 0.0f;
+	std::mutex merge;
+	auto pass = [&](size_t begin, size_t end) {
+		Bin local[3][kBins];
+		for (size_t i = first + begin; i < first + end; i++) {
+			const PrimRef& prim = prims_[i];
+			for (int axis = 0; axis < 3; axis++) {
+				Bin& bin = local[axis][binOf(prim.centroid[axis], lo[axis], scale[axis])];
+				bin.bounds.grow(prim.box);
+				bin.count++;
+			}
+		}
+		std::lock_guard<std::mutex> lock(merge);
+		for (int axis = 0; axis < 3; axis++) {
+			for (int b = 0; b < kBins; b++) {
+				bins[axis][b].bounds.grow(local[axis][b].bounds);
+				bins[axis][b].count += local[axis][b].count;
+			}
+		}
+	};
+	if (wide)
+		parallelFor(count, kParallelThreshold / 4, pass);
+	else
+		pass(0, count);
+}
+
+void Builder::build(BuildNode* node, unsigned int first, unsigned int count, unsigned int width)
+{
+	bool wide = width == 1 && count >= kParallelThreshold;
+	AABB centroid_box;
+	bounds(first, count, wide, node->bounds, centroid_box);
+	node->first = first;
+	node->count = count;
+	if (count <= kLeafSize)
+		return;
+
+	// Binned SAH: evaluate kBins - 1 candidate planes on each axis.
+	float best_cost = node->bounds.area() * count;
+	int best_axis = -1, best_split = 0;
+	Bin all_bins[3][kBins];
+	binning(first, count, wide, centroid_box, all_bins);
+	for (int axis = 0; axis < 3; axis++) {
+		if (centroid_box.hi[axis] - centroid_box.lo[axis] <= 0.0f)
+			continue;
+		const Bin* bins = all_bins[axis];
+
+		float right_area[kBins];
+		unsigned int right_count[kBins];
+		AABB box;
+		unsigned int n = 0;
+		for (int i = kBins - 1; i > 0; i--) {
+			box.grow(bins[i].bounds);
+			n += bins[i].count;
+			right_area[i] = box.area();
+			right_count[i] = n;
+		}
+		box = AABB();
+		n = 0;
+		for (int i = 0; i < kBins - 1; i++) {
+			box.grow(bins[i].bounds);
+			n += bins[i].count;
+			if (n == 0 || right_count[i + 1] == 0)
+				continue;
+			float cost = box.area() * n + right_area[i + 1] * right_count[i + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = i + 1;
+			}
+		}
+	}
+
+	unsigned int middle;
+	if (best_axis >= 0) {
+		float lo = centroid_box.lo[best_axis];
+		float scale = kBins / (centroid_box.hi[best_axis] - lo);
+		auto split = std::partition(prims_.begin() + first, prims_.begin() + first + count,
+			[&](const PrimRef& prim) { return binOf(prim.centroid[best_axis], lo, scale) < best_split; });
+		middle = split - prims_.begin();
+	} else if (count > 4 * kLeafSize) {
+		// Too many triangles for a leaf but SAH found no useful plane
+		// (e.g. coincident centroids): halve the list.
+		middle = first + count / 2;
+	} else {
+		return;
+	}
+
+	node->left.reset(new BuildNode);
+	node->right.reset(new BuildNode);
+	unsigned int left_count = middle - first;
+	if (count >= kParallelThreshold && width < workerCount()) {
+		std::thread worker(&Builder::build, this, node->left.get(), first, left_count, 2 * width);
+		build(node->right.get(), middle, count - left_count, 2 * width);
+		worker.join();
+	} else {
+		build(node->left.get(), first, left_count, width);
+		build(node->right.get(), middle, count - left_count, width);
+	}
+}
+
+unsigned int flatten(const BuildNode* node, std::vector<BVHNode>& nodes)
+{
+	unsigned int index = nodes.size();
+	nodes.emplace_back();
+	nodes[index].lo = node->bounds.lo;
+	nodes[index].hi = node->bounds.hi;
+	if (!node->left) {
+		nodes[index].offset = node->first;
+		nodes[index].count = node->count;
+		return index;
+	}
+	flatten(node->left.get(), nodes);
+	unsigned int right = flatten(node->right.get(), nodes);
+	nodes[index].offset = right;
+	nodes[index].count = 0;
+	return index;
+}
+
+// Slab test; returns the entry distance, or infinity if the box is missed
+// or lies beyond max_t.
+inline float hitBox(const BVHNode& node, const glm::vec3& origin, const glm::vec3& inv_dir, float max_t)
+{
+#if defined(__SSE2__)
+	// The fourth lane of each load is offset/count; zeroing inv_dir there
+	// and masking the lane out keeps it from affecting the result.
+	const __m128 lane3 = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+	__m128 o = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+	__m128 inv = _mm_set_ps(0.0f, inv_dir.z, inv_dir.y, inv_dir.x);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.lo.x), o), inv);
+	__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.hi.x), o), inv);
+	__m128 tmin = _mm_min_ps(t1, t2);
+	__m128 tmax = _mm_max_ps(t1, t2);
+	tmin = _mm_or_ps(_mm_andnot_ps(lane3, tmin), _mm_and_ps(lane3, _mm_setzero_ps()));
+	tmax = _mm_or_ps(_mm_andnot_ps(lane3, tmax), _mm_and_ps(lane3, _mm_set1_ps(max_t)));
+	tmin = _mm_max_ps(tmin, _mm_shuffle_ps(tmin, tmin, _MM_SHUFFLE(1, 0, 3, 2)));
+	tmin = _mm_max_ps(tmin, _mm_shuffle_ps(tmin, tmin, _MM_SHUFFLE(2, 3, 0, 1)));
+	tmax = _mm_min_ps(tmax, _mm_shuffle_ps(tmax, tmax, _MM_SHUFFLE(1, 0, 3, 2)));
+	tmax = _mm_min_ps(tmax, _mm_shuffle_ps(tmax, tmax, _MM_SHUFFLE(2, 3, 0, 1)));
+	float enter = _mm_cvtss_f32(tmin);
+	float leave = _mm_cvtss_f32(tmax);
+#else
+	glm::vec3 t1 = (node.lo - origin) * inv_dir;
+	glm::vec3 t2 = (node.hi - origin) * inv_dir;
+	glm::vec3 near = glm::min(t1, t2);
+	glm::vec3 far = glm::max(t1, t2);
+	float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+	float leave = std::min(std::min(far.x, far.y), std::min(far.z, max_t));
+#endif
+	return enter <= leave ? enter : kInfinity;
+}
+
+}
+
+void BVH::build(const Mesh& mesh, const LODLevel& lod)
+{
+	PROFILE_ZONE("BVH::build");
+	nodes_.clear();
+	corners_.clear();
+	triangle_ids_.clear();
+	unsigned int count = lod.index_count / 3;
+	if (count == 0)
+		return;
+
+	const unsigned int* indices = &mesh.indices[lod.index_offset];
+	std::vector<PrimRef> prims(count);
+	parallelFor(count, 4096, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			for (int k = 0; k < 3; k++)
+				prims[t].box.grow(mesh.vertices[indices[3 * t + k]]);
+			prims[t].centroid = 0.5f * (prims[t].box.lo + prims[t].box.hi);
+			prims[t].id = t;
+		}
+	});
+
+	BuildNode root;
+	Builder builder(prims);
+	builder.build(&root, 0, count, 1);
+
+	nodes_.reserve(2 * count / kLeafSize + 1);
+	flatten(&root, nodes_);
+
+	corners_.resize(3 * count);
+	triangle_ids_.resize(count);
+	parallelFor(count, 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			triangle_ids_[i] = prims[i].id;
+			for (int k = 0; k < 3; k++)
+				corners_[3 * i + k] = mesh.vertices[indices[3 * prims[i].id + k]];
+		}
+	});
+}
+
+PickResult BVH::intersect(const Ray& ray) const
+{
+	PickResult result;
+	if (nodes_.empty())
+		return result;
+
+	// Huge rather than infinite reciprocals keep 0 * inv finite in the
+	// slab test for axis-aligned rays.
+	glm::vec3 inv_dir;
+	for (int i = 0; i < 3; i++)
+		inv_dir[i] = std::fabs(ray.direction[i]) > 1e-30f ? 1.0f / ray.direction[i] : 1e30f;
+
+	float best = kInfinity;
+	unsigned int best_index = 0;
+	float best_u = 0.0f, best_v = 0.0f;
+
+	// Degenerate meshes can build trees deeper than any fixed stack, so it
+	// moves to the heap if the inline one fills up.
+	unsigned int inline_stack[64];
+	std::vector<unsigned int> spilled;
+	unsigned int* stack = inline_stack;
+	size_t capacity = 64, top = 0;
+	auto push = [&](unsigned int index) {
+		if (top == capacity) {
+			if (spilled.empty())
+				spilled.assign(inline_stack, inline_stack + top);
+			spilled.resize(2 * capacity);
+			stack = spilled.data();
+			capacity = spilled.size();
+		}
+		stack[top++] = index;
+	};
+	if (hitBox(nodes_[0], ray.origin, inv_dir, best) < kInfinity)
+		push(0);
+	while (top > 0) {
+		const BVHNode& node = nodes_[stack[--top]];
+		if (node.count > 0) {
+			for (unsigned int i = node.offset; i < node.offset + node.count; i++) {
+				// Moller-Trumbore, two sided so picking works on any face.
+				const glm::vec3& a = corners_[3 * i];
+				glm::vec3 e1 = corners_[3 * i + 1] - a;
+				glm::vec3 e2 = corners_[3 * i + 2] - a;
+				glm::vec3 p = glm::cross(ray.direction, e2);
+				float det = glm::dot(e1, p);
+				if (std::fabs(det) < 1e-12f)
+					continue;
+				float inv_det = 1.0f / det;
+				glm::vec3 s = ray.origin - a;
+				float u = glm::dot(s, p) * inv_det;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+				glm::vec3 q = glm::cross(s, e1);
+				float v = glm::dot(ray.direction, q) * inv_det;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+				float t = glm::dot(e2, q) * inv_det;
+				if (t > 0.0f && t < best) {
+					best = t;
+					best_index = i;
+					best_u = u;
+					best_v = v;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first; push it last.
+		unsigned int left = &node - &nodes_[0] + 1;
+		unsigned int right = node.offset;
+		float t_left = hitBox(nodes_[left], ray.origin, inv_dir, best);
+		float t_right = hitBox(nodes_[right], ray.origin, inv_dir, best);
+		if (t_left > t_right) {
+			std::swap(left, right);
+			std::swap(t_left, t_right);
+		}
+		if (t_right < kInfinity)
+			push(right);
+		if (t_left < kInfinity)
+			push(left);
+	}
+
+	if (best < kInfinity) {
+		result.hit = true;
+		result.triangle = triangle_ids_[best_index];
+		result.barycentric = glm::vec3(1.0f - best_u - best_v, best_u, best_v);
+		result.distance = best;
+		result.position = ray.origin + best * ray.direction;
+	}
+	return result;
+}
+
+Ray rayFromPixel(const glm::vec2& pixel, const glm::mat4& model_view,
+                 const glm::mat4& projection, const glm::uvec4& viewport)
+{
+	glm::vec4 vp = glm::vec4(viewport);
+	glm::vec3 near = glm::unProject(glm::vec3(pixel, 0.0f), model_view, projection, vp);
+	glm::vec3 far = glm::unProject(glm::vec3(pixel, 1.0f), model_view, projection, vp);
+	Ray ray;
+	ray.origin = near;
+	ray.direction = glm::normalize(far - near);
+	return ray;
+}
+
+void pickBone(const std::vector<BoneSegment>& bones, const Ray& ray, PickResult& pick)
+{
+	pick.bone = -1;
+	float best = kInfinity;
+	for (size_t i = 0; i < bones.size(); i++) {
+		glm::vec3 axis = bones[i].end - bones[i].start;
+		float length = glm::length(axis);
+		if (length <= 0.0f)
+			continue;
+		axis /= length;
+
+		// Infinite cylinder around the axis, clipped to the segment.
+		glm::vec3 oc = ray.origin - bones[i].start;
+		glm::vec3 d_perp = ray.direction - glm::dot(ray.direction, axis) * axis;
+		glm::vec3 o_perp = oc - glm::dot(oc, axis) * axis;
+		float a = glm::dot(d_perp, d_perp);
+		float b = 2.0f * glm::dot(d_perp, o_perp);
+		float c = glm::dot(o_perp, o_perp) - kCylinderRadius * kCylinderRadius;
+		if (a < 1e-12f)
+			continue;
+		float disc = b * b - 4.0f * a * c;
+		if (disc < 0.0f)
+			continue;
+		float root = std::sqrt(disc);
+		for (float t : { (-b - root) / (2.0f * a), (-b + root) / (2.0f * a) }) {
+			if (t <= 0.0f || t >= best)
+				continue;
+			float along = glm::dot(oc + t * ray.direction, axis);
+			if (along < 0.0f || along > length)
+				continue;
+			best = t;
+			pick.bone = i;
+			break;
+		}
+	}
+	if (pick.bone >= 0 || !pick.hit)
+		return;
+
+	float nearest = kInfinity;
+	for (size_t i = 0; i < bones.size(); i++) {
+		glm::vec3 axis = bones[i].end - bones[i].start;
+		float length2 = glm::dot(axis, axis);
+		float s = length2 > 0.0f ? glm::dot(pick.position - bones[i].start, axis) / length2 : 0.0f;
+		s = std::min(std::max(s, 0.0f), 1.0f);
+		float d = glm::length(pick.position - (bones[i].start + s * axis));
+		if (d < nearest) {
+			nearest = d;
+			pick.bone = i;
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef NPR_BVH_H
+#define NPR_BVH_H
+
+#include "mesh.h"
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+ * Flattened BVH node, 32 bytes so two share a cache line. Interior nodes
+ * have count == 0, their left child right after them and the right child
+ * at offset. Leaves hold count triangles starting at offset.
+ */
+struct BVHNode {
+	glm::vec3 lo;
+	unsigned int offset;
+	glm::vec3 hi;
+	unsigned int count;
+};
+
+struct Ray {
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+struct PickResult {
+	bool hit = false;
+	unsigned int triangle = 0;       // index into the level's triangles
+	glm::vec3 barycentric;           // weights of the triangle's corners
+	glm::vec3 position;
+	float distance = 0.0f;
+	int bone = -1;
+};
+
+// A bone as drawn by the skinning viewer: a cylinder of kCylinderRadius
+// around the segment from start to end.
+struct BoneSegment {
+	glm::vec3 start;
+	glm::vec3 end;
+};
+
+/*
+ * Bounding volume hierarchy over one level of a mesh, built with binned
+ * SAH splits. Large subtrees are built on worker threads; the result is
+ * flattened into depth-first order with triangles copied next to each
+ * other in leaf order.
+ */
+class BVH {
+public:
+	void build(const Mesh& mesh, const LODLevel& lod);
+
+	// Nearest hit along the ray in model space, or hit == false.
+	PickResult intersect(const Ray& ray) const;
+
+	size_t nodeCount() const { return nodes_.size(); }
+	bool empty() const { return nodes_.empty(); }
+
+private:
+	std::vector<BVHNode> nodes_;
+	std::vector<glm::vec3> corners_;          // three per triangle, leaf order
+	std::vector<unsigned int> triangle_ids_;  // leaf order to level triangle
+};
+
+// Ray through a window pixel, with y measured from the bottom, in the
+// space that model_view maps from.
+Ray rayFromPixel(const glm::vec2& pixel, const glm::mat4& model_view,
+                 const glm::mat4& projection, const glm::uvec4& viewport);
+
+// Nearest bone whose cylinder the ray enters. If none is hit but pick is a
+// mesh hit, falls back to the bone closest to the hit point. Sets
+// pick.bone to -1 when there are no bones.
+void pickBone(const std::vector<BoneSegment>& bones, const Ray& ray, PickResult& pick);
+
+#endif
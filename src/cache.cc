@@ -0,0 +1,78 @@
+#include "cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+bool makeDirectories(const std::string& path)
+{
+	for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+		std::string prefix = path.substr(0, slash);
+		if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+			return false;
+		if (slash == std::string::npos)
+			return true;
+	}
+}
+
+}
+
+std::string cacheDirectory(const std::string& subdir)
+{
+	std::string root;
+	const char* xdg = getenv("XDG_CACHE_HOME");
+	const char* home = getenv("HOME");
+	if (xdg && xdg[0] == '/')
+		root = xdg;
+	else if (home && home[0])
+		root = std::string(home) + "/.cache";
+	else
+		return "";
+
+	std::string path = root + "/npr/" + subdir;
+	if (!makeDirectories(path)) {
+		printf("Cannot create cache directory %s\n", path.c_str());
+		return "";
+	}
+	return path;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+uint64_t hashString(const std::string& text, uint64_t seed)
+{
+	return hashBytes(text.data(), text.size(), seed);
+}
+
+std::string hexString(uint64_t value)
+{
+	char buffer[17];
+	snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+	return buffer;
+}
+
+bool writeFileAtomic(const std::string& path, const void* data, size_t size)
+{
+	std::string temporary = path + ".tmp" + std::to_string(getpid());
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(data, 1, size, file) == size;
+	ok = fclose(file) == 0 && ok;
+	if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
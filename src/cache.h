@@ -0,0 +1,23 @@
+#ifndef NPR_CACHE_H
+#define NPR_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// $XDG_CACHE_HOME/npr/<subdir>, falling back to ~/.cache/npr/<subdir>.
+// Created on first use; returns an empty string if that fails.
+std::string cacheDirectory(const std::string& subdir);
+
+// 64-bit FNV-1a. Chain calls through seed to hash several pieces.
+const uint64_t kHashSeed = 14695981039346656037ull;
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = kHashSeed);
+uint64_t hashString(const std::string& text, uint64_t seed = kHashSeed);
+
+std::string hexString(uint64_t value);
+
+// Writes to a temporary file and renames it into place, so readers never
+// see a partial cache entry.
+bool writeFileAtomic(const std::string& path, const void* data, size_t size);
+
+#endif
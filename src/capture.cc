@@ -0,0 +1,322 @@
+#include "capture.h"
+#include "image_io.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+// <prefix>_<n>.<extension>, the first n from start that isn't taken.
+std::string nextFreePath(const std::string& prefix, const std::string& extension, unsigned int& n)
+{
+	std::string path;
+	do {
+		char number[16];
+		snprintf(number, sizeof(number), "_%04u.", n++);
+		path = prefix + number + extension;
+	} while (access(path.c_str(), F_OK) == 0);
+	return path;
+}
+
+// Full range BT.601 4:2:0 with centered chroma, what C420jpeg means. The
+// image is bottom row first, the frame top row first.
+void toYUV420(const Image& image, std::vector<unsigned char>& yuv)
+{
+	int width = image.width, height = image.height;
+	int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+	yuv.resize(size_t(width) * height + 2 * size_t(chroma_width) * chroma_height);
+	unsigned char* y_plane = yuv.data();
+	unsigned char* u_plane = y_plane + size_t(width) * height;
+	unsigned char* v_plane = u_plane + size_t(chroma_width) * chroma_height;
+	auto pixel = [&](int x, int y) {
+		return &image.pixels[(size_t(height - 1 - std::min(y, height - 1)) * width + std::min(x, width - 1)) * 4];
+	};
+	// 16.16 fixed point.
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			const unsigned char* p = pixel(x, y);
+			y_plane[size_t(y) * width + x] = (19595 * p[0] + 38470 * p[1] + 7471 * p[2] + 32768) >> 16;
+		}
+	for (int y = 0; y < chroma_height; y++)
+		for (int x = 0; x < chroma_width; x++) {
+			int r = 0, g = 0, b = 0;
+			for (int dy = 0; dy < 2; dy++)
+				for (int dx = 0; dx < 2; dx++) {
+					const unsigned char* p = pixel(2 * x + dx, 2 * y + dy);
+					r += p[0];
+					g += p[1];
+					b += p[2];
+				}
+			// Sums of four, so the coefficients are quartered.
+			int u = (-2765 * r - 5428 * g + 8192 * b + (128 << 16) + 32768) >> 16;
+			int v = (8192 * r - 6860 * g - 1332 * b + (128 << 16) + 32768) >> 16;
+			u_plane[size_t(y) * chroma_width + x] = std::min(std::max(u, 0), 255);
+			v_plane[size_t(y) * chroma_width + x] = std::min(std::max(v, 0), 255);
+		}
+}
+
+}
+
+ScreenCapture::~ScreenCapture()
+{
+	// finish() has normally stopped them; this is for early returns.
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	wake_.notify_all();
+	for (std::thread& encoder : encoders_)
+		encoder.join();
+	if (stream_)
+		fclose(stream_);
+}
+
+bool ScreenCapture::create(const CaptureOptions& options)
+{
+	options_ = options;
+	captures_ = queued_ = next_write_ = 0;
+	stream_width_ = stream_height_ = 0;
+	saved_ = dropped_ = 0;
+	encode_ms_ = last_saved_ = 0.0f;
+	// Exported frames are copied out as they're mapped; nothing to encode.
+	bool encoding = !options_.exporter;
+	if (encoding && options_.extension == "y4m") {
+		std::string path = nextFreePath(options_.prefix, options_.extension, count_);
+		stream_ = fopen(path.c_str(), "wb");
+		if (!stream_) {
+			printf("Cannot write %s\n", path.c_str());
+			return false;
+		}
+		printf("Recording to %s\n", path.c_str());
+	} else if (encoding && !options_.announce) {
+		printf("Recording to %s_*.%s\n", options_.prefix.c_str(), options_.extension.c_str());
+	}
+	for (Slot& slot : slots_)
+		glGenBuffers(1, &slot.buffer);
+	quit_ = false;
+	for (int i = 0; encoding && i < std::max(options_.encoders, 1); i++)
+		encoders_.emplace_back(&ScreenCapture::encode, this);
+	return true;
+}
+
+bool ScreenCapture::capture(int width, int height)
+{
+	PROFILE_ZONE("ScreenCapture::capture");
+	if (captures_ == 0)
+		start_ = std::chrono::steady_clock::now();
+	Slot* free_slot = nullptr;
+	for (Slot& slot : slots_)
+		if (!slot.fence && slot.buffer)
+			free_slot = &slot;
+	if (!free_slot || (options_.policy == CapturePolicy::Drop && waiting() >= size_t(kCaptureQueue))) {
+		dropped_++;
+		return false;
+	}
+
+	Slot& slot = *free_slot;
+	slot.index = captures_++;
+	slot.width = width;
+	slot.height = height;
+	if (!stream_ && !options_.exporter)
+		slot.path = nextFreePath(options_.prefix, options_.extension, count_);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	size_t size = size_t(width) * height * 4;
+	if (slot.size != size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		slot.size = size;
+	}
+	// Returns at once; the copy happens when the GPU gets to it.
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	return true;
+}
+
+void ScreenCapture::queue(Slot& slot)
+{
+	Frame frame;
+	frame.path = slot.path;
+	frame.image.width = slot.width;
+	frame.image.height = slot.height;
+	unsigned char* target = nullptr;
+	if (options_.exporter) {
+		target = options_.exporter->begin(slot.width, slot.height);
+	} else {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!spare_pixels_.empty()) {
+				frame.image.pixels.swap(spare_pixels_.back());
+				spare_pixels_.pop_back();
+			}
+		}
+		frame.image.pixels.resize(slot.size);
+		target = frame.image.pixels.data();
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const void* pixels = target ? glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT) : nullptr;
+	bool mapped = pixels != nullptr;
+	if (mapped) {
+		memcpy(target, pixels, slot.size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+	if (!mapped) {
+		if (target)
+			printf("Cannot map the readback for frame %u\n", slot.index);
+		dropped_++;
+		return;
+	}
+	if (options_.exporter) {
+		options_.exporter->publish();
+		saved_++;
+		last_saved_ = std::chrono::duration<float>(std::chrono::steady_clock::now() - start_).count();
+		return;
+	}
+	{
+		// Numbered only once queued, so the stream has no gaps to wait on.
+		std::lock_guard<std::mutex> lock(mutex_);
+		frame.sequence = queued_++;
+		frames_.push_back(std::move(frame));
+	}
+	wake_.notify_one();
+}
+
+void ScreenCapture::poll()
+{
+	PROFILE_ZONE("ScreenCapture::poll");
+	// Oldest first, so frames reach the stream in the order they were drawn.
+	for (;;) {
+		Slot* oldest = nullptr;
+		for (Slot& slot : slots_)
+			if (slot.fence && (!oldest || slot.index < oldest->index))
+				oldest = &slot;
+		if (!oldest)
+			return;
+		GLenum status = glClientWaitSync(oldest->fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return;
+		queue(*oldest);
+	}
+}
+
+void ScreenCapture::finish()
+{
+	for (;;) {
+		Slot* oldest = nullptr;
+		for (Slot& slot : slots_)
+			if (slot.fence && (!oldest || slot.index < oldest->index))
+				oldest = &slot;
+		if (!oldest)
+			break;
+		glClientWaitSync(oldest->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+		queue(*oldest);
+	}
+	for (Slot& slot : slots_) {
+		if (slot.buffer)
+			glDeleteBuffers(1, &slot.buffer);
+		slot = Slot();
+	}
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		idle_.wait(lock, [this] { return frames_.empty() && encoding_ == 0; });
+		quit_ = true;
+	}
+	wake_.notify_all();
+	for (std::thread& encoder : encoders_)
+		encoder.join();
+	encoders_.clear();
+	if (stream_) {
+		fclose(stream_);
+		stream_ = nullptr;
+	}
+}
+
+float ScreenCapture::throughput() const
+{
+	float seconds = last_saved_;
+	return seconds > 0.0f ? saved_ / seconds : 0.0f;
+}
+
+size_t ScreenCapture::waiting()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return frames_.size();
+}
+
+// Called with the lock held; drops it while converting and writing.
+bool ScreenCapture::writeStream(const Frame& frame, std::unique_lock<std::mutex>& lock)
+{
+	lock.unlock();
+	std::vector<unsigned char> yuv;
+	toYUV420(frame.image, yuv);
+	lock.lock();
+	written_.wait(lock, [&] { return next_write_ == frame.sequence; });
+	lock.unlock();
+
+	bool ok = true;
+	if (!stream_width_) {
+		stream_width_ = frame.image.width;
+		stream_height_ = frame.image.height;
+		// The rate is nominal: a frame per frame drawn, which vsync makes 60.
+		fprintf(stream_, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", stream_width_, stream_height_);
+	}
+	if (frame.image.width != stream_width_ || frame.image.height != stream_height_) {
+		// The window was resized; a stream can't change size.
+		ok = false;
+	} else {
+		fputs("FRAME\n", stream_);
+		ok = fwrite(yuv.data(), 1, yuv.size(), stream_) == yuv.size();
+	}
+
+	lock.lock();
+	next_write_++;
+	written_.notify_all();
+	return ok;
+}
+
+void ScreenCapture::encode()
+{
+	PROFILE_THREAD("capture encoder");
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;) {
+		wake_.wait(lock, [this] { return quit_ || !frames_.empty(); });
+		if (frames_.empty())
+			return;
+		Frame frame = std::move(frames_.front());
+		frames_.pop_front();
+		encoding_++;
+
+		auto start = std::chrono::steady_clock::now();
+		bool ok;
+		if (stream_) {
+			ok = writeStream(frame, lock);
+			lock.unlock();
+		} else {
+			lock.unlock();
+			ok = saveImage(frame.path, frame.image);
+		}
+		auto end = std::chrono::steady_clock::now();
+		encode_ms_ = std::chrono::duration<float, std::milli>(end - start).count();
+		if (ok) {
+			saved_++;
+			last_saved_ = std::chrono::duration<float>(end - start_).count();
+			if (options_.announce)
+				printf("Saved %s\n", frame.path.c_str());
+		} else {
+			dropped_++;
+		}
+
+		lock.lock();
+		if (spare_pixels_.size() < size_t(kCaptureQueue))
+			spare_pixels_.push_back(std::move(frame.image.pixels));
+		encoding_--;
+		if (frames_.empty() && encoding_ == 0)
+			idle_.notify_all();
+	}
+}
@@ -0,0 +1,133 @@
+#ifndef NPR_CAPTURE_H
+#define NPR_CAPTURE_H
+
+#include "config.h"
+#include "frame_export.h"
+#include "texture.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+
+// What capture() does once kCaptureQueue frames are waiting for the
+// encoders: drop the new one, or queue it anyway and let memory grow.
+enum class CapturePolicy {
+	Drop,
+	Queue,
+};
+
+struct CaptureOptions {
+	// Images are <prefix>_<n>.<extension>, numbered on from whatever is
+	// already there, in any format saveImage writes. "y4m" instead makes
+	// one YUV4MPEG2 (4:2:0) stream, <prefix>_<n>.y4m, of every frame in
+	// order.
+	std::string prefix = "screenshot";
+	std::string extension = "jpg";
+	int encoders = 1;
+	CapturePolicy policy = CapturePolicy::Drop;
+	// Print each image written; a recording only says where it went.
+	bool announce = true;
+	// Copy frames straight from the pack buffer into this ring instead of
+	// encoding anything; prefix and extension are unused.
+	FrameExport* exporter = nullptr;
+};
+
+/*
+ * Frame capture that never stalls the frame, for J screenshots, recording
+ * and --export. capture() starts glReadPixels into one of a ring of
+ * kCaptureBuffers pixel pack buffers and fences it; poll(), a frame or two
+ * later, maps the ones that have signalled, oldest first, and copies them
+ * out for a pool of encoder threads, or into a FrameExport ring for other
+ * processes. When every buffer is still in flight the capture is dropped
+ * rather than waited for, and past kCaptureQueue waiting frames the policy
+ * decides.
+ */
+class ScreenCapture {
+public:
+	ScreenCapture() = default;
+	~ScreenCapture();
+	ScreenCapture(const ScreenCapture&) = delete;
+	ScreenCapture& operator=(const ScreenCapture&) = delete;
+
+	// Starts the encoder threads, and the counts over. Returns false if the
+	// stream can't be opened. Can be called again after finish().
+	bool create(const CaptureOptions& options);
+
+	// Reads the framebuffer bound for reading. Returns false if it was
+	// dropped.
+	bool capture(int width, int height);
+
+	// Queues finished readbacks for encoding; once a frame.
+	void poll();
+
+	// Waits for everything captured to be written and closes the stream.
+	// Call while the context is still current.
+	void finish();
+
+	unsigned int saved() const { return saved_; }
+	unsigned int dropped() const { return dropped_; }
+	// Milliseconds the last encode and write took on an encoder thread.
+	float encodeTime() const { return encode_ms_; }
+	// Frames written per second since the first capture.
+	float throughput() const;
+	size_t waiting();
+
+private:
+	struct Slot {
+		GLuint buffer = 0;
+		size_t size = 0;
+		GLsync fence = nullptr;
+		unsigned int index = 0;
+		int width = 0;
+		int height = 0;
+		std::string path;
+	};
+	struct Frame {
+		unsigned int sequence = 0;
+		std::string path;
+		Image image;
+	};
+
+	void queue(Slot& slot);
+	void encode();
+	bool writeStream(const Frame& frame, std::unique_lock<std::mutex>& lock);
+
+	CaptureOptions options_;
+	unsigned int count_ = 0;
+	unsigned int captures_ = 0;
+	unsigned int queued_ = 0;
+	Slot slots_[kCaptureBuffers];
+	std::chrono::steady_clock::time_point start_;
+
+	// The Y4M stream, written in sequence order by whichever encoder has
+	// the next frame.
+	FILE* stream_ = nullptr;
+	int stream_width_ = 0;
+	int stream_height_ = 0;
+	unsigned int next_write_ = 0;
+
+	std::vector<std::thread> encoders_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable written_;
+	std::condition_variable idle_;
+	std::deque<Frame> frames_;
+	// Pixels of encoded frames, reused so a readback doesn't fault in
+	// fresh pages for every copy.
+	std::vector<std::vector<unsigned char>> spare_pixels_;
+	int encoding_ = 0;
+	bool quit_ = false;
+	std::atomic<unsigned int> saved_{0};
+	std::atomic<unsigned int> dropped_{0};
+	std::atomic<float> encode_ms_{0.0f};
+	std::atomic<float> last_saved_{0.0f};
+};
+
+#endif
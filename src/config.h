@@ -14,6 +14,52 @@ const float kNear = 0.1f;
 const float kFar = 1000.0f;
 const float kFov = 45.0f;
 
+// Level of detail: how many levels to bake, how many pixels of projected
+// simplification error are tolerated, and the switching margin.
+const int kNumLODs = 5;
+const float kLODPixelError = 1.0f;
+const float kLODHysteresis = 0.25f;
+
+// Meshlet size limits, as used by mesh shading hardware.
+const int kMeshletMaxVertices = 64;
+const int kMeshletMaxTriangles = 124;
+
+// Tonal art map hatching: tone count, finest tile size and how dark the
+// darkest tone gets.
+const int kTAMTones = 6;
+const int kTAMSize = 256;
+const float kTAMMaxDarkness = 0.85f;
+
+// Texture atlases: texels of edge padding around each image and the
+// largest atlas to build.
+const int kAtlasPadding = 8;
+const int kAtlasMaxSize = 8192;
+
+// Asset browser thumbnails: size in pixels, how many get rendered or
+// uploaded per frame at most, and how long the style has to stay put
+// before they are redone, in seconds.
+const int kThumbnailSize = 128;
+const int kThumbnailsPerFrame = 2;
+const double kThumbnailStyleDelay = 0.5;
+
+// Hot reload: seconds a watched file must be left alone after a change
+// before it is reloaded, so a save that takes several writes loads once.
+const double kReloadDelay = 0.2;
+
+// GPU timings: frames of timer queries in flight before their results
+// are read, so reading never waits on the GPU, and frames of history kept
+// for the panel and CSV export.
+const int kGPUTimerFrames = 4;
+const int kGPUTimerHistory = 300;
+
+// Screenshots and recording: pixel pack buffers being read back at once,
+// and frames waiting for the encoders before the policy kicks in.
+const int kCaptureBuffers = 4;
+const int kCaptureQueue = 8;
+// Frames in the --export shared memory ring; a consumer has this many
+// frames' time to read one in place before it's overwritten.
+const int kFrameExportSlots = 3;
+
 // Floor info.
 const float kFloorEps = 0.5 * (0.025 + 0.0175);
 const float kFloorXMin = -100.0f;
@@ -0,0 +1,126 @@
+#include "edge_outline.h"
+#include "gl_state.h"
+#include "shader.h"
+#include "uniforms.h"
+
+#include <stdio.h>
+
+namespace {
+
+// One triangle past the corners covers the viewport without attributes.
+const char* kEdgeVertexShader = R"zzz(
+#version 330 core
+void main() {
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)zzz";
+
+const char* kEdgeFragmentShader =
+#include "shaders/edges.frag"
+;
+
+// Clear of the units the scene's textures use.
+const GLuint kEdgeTextureUnit = 2;
+
+}
+
+EdgeOutline::~EdgeOutline()
+{
+	if (framebuffer_) {
+		glState().deleteFramebuffers(1, &framebuffer_);
+		glState().deleteTextures(3, textures_);
+	}
+	if (program_)
+		glDeleteProgram(program_);
+}
+
+bool EdgeOutline::begin()
+{
+	if (!program_ && !broken_) {
+		program_ = buildProgram(kEdgeVertexShader, kEdgeFragmentShader, uniformBlockSource());
+		broken_ = !program_ || !bindUniformBlocks(program_);
+		if (program_) {
+			GLuint current = glState().save().program;
+			glState().useProgram(program_);
+			glUniform1i(glGetUniformLocation(program_, "scene_color"), kEdgeTextureUnit);
+			glUniform1i(glGetUniformLocation(program_, "scene_normal"), kEdgeTextureUnit + 1);
+			glUniform1i(glGetUniformLocation(program_, "scene_depth"), kEdgeTextureUnit + 2);
+			glState().useProgram(current);
+		}
+	}
+	const GLint* viewport = glState().save().viewport;
+	if (broken_ || !resize(viewport[2], viewport[3]))
+		return false;
+
+	previous_ = glState().save().draw_framebuffer;
+	glState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+	// Transparent and without a normal where nothing is drawn.
+	const GLfloat none[4] = {0.0f, 0.0f, 0.0f, 0.0f}, far = 1.0f;
+	glClearBufferfv(GL_COLOR, 0, none);
+	glClearBufferfv(GL_COLOR, 1, none);
+	glClearBufferfv(GL_DEPTH, 0, &far);
+	return true;
+}
+
+void EdgeOutline::end()
+{
+	GLStateCache& state = glState();
+	state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, previous_);
+	state.useProgram(program_);
+	for (GLuint i = 0; i < 3; i++) {
+		state.activeTexture(GL_TEXTURE0 + kEdgeTextureUnit + i);
+		state.bindTexture(GL_TEXTURE_2D, textures_[i]);
+	}
+	state.activeTexture(GL_TEXTURE0);
+	// The target was cleared already; the model's depth goes through as is.
+	state.depthFunc(GL_ALWAYS);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	state.depthFunc(GL_LESS);
+}
+
+bool EdgeOutline::resize(int width, int height)
+{
+	if (width == width_ && height == height_ && framebuffer_)
+		return true;
+	if (!framebuffer_) {
+		glGenFramebuffers(1, &framebuffer_);
+		glGenTextures(3, textures_);
+	}
+	width_ = width;
+	height_ = height;
+
+	// Nearest: the filter reads exact texels either side of an edge.
+	GLStateCache& state = glState();
+	const GLenum formats[3][3] = {
+		{ GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE },
+		{ GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT },
+		{ GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT },
+	};
+	state.activeTexture(GL_TEXTURE0 + kEdgeTextureUnit);
+	for (int i = 0; i < 3; i++) {
+		state.bindTexture(GL_TEXTURE_2D, textures_[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, formats[i][0], width, height, 0, formats[i][1], formats[i][2], nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	state.activeTexture(GL_TEXTURE0);
+
+	GLuint previous = state.save().draw_framebuffer;
+	state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures_[0], 0);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, textures_[1], 0);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures_[2], 0);
+	const GLenum targets[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, targets);
+	bool complete = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, previous);
+	if (!complete) {
+		printf("Cannot draw screen-space outlines at %dx%d\n", width, height);
+		// Try again if the size changes.
+		width_ = height_ = 0;
+	}
+	return complete;
+}
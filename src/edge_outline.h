@@ -0,0 +1,42 @@
+#ifndef NPR_EDGE_OUTLINE_H
+#define NPR_EDGE_OUTLINE_H
+
+#include <GL/glew.h>
+
+/*
+ * The screen-space outline, instead of the inverted hull. The shaded pass
+ * draws into color, normal and depth textures (the EDGES program writes
+ * the normals to a second target) and one full-screen pass runs a Sobel
+ * filter over depth and normals and composites the model and its edges
+ * into the framebuffer that was bound. Costs the same whatever the
+ * triangle count, and creases on hard-edged meshes come out too.
+ */
+class EdgeOutline {
+public:
+	EdgeOutline() = default;
+	~EdgeOutline();
+	EdgeOutline(const EdgeOutline&) = delete;
+	EdgeOutline& operator=(const EdgeOutline&) = delete;
+
+	// Sizes the textures to the viewport, binds them and clears them. The
+	// program is built the first time. Returns false, and leaves the
+	// framebuffer alone, if the driver won't take either.
+	bool begin();
+	// Draws the edge pass into the framebuffer bound before begin(), with
+	// the depth the model had.
+	void end();
+
+private:
+	bool resize(int width, int height);
+
+	GLuint program_ = 0;
+	bool broken_ = false;
+	int width_ = 0;
+	int height_ = 0;
+	GLuint framebuffer_ = 0;
+	// Color, normals and depth.
+	GLuint textures_[3] = {0, 0, 0};
+	GLuint previous_ = 0;
+};
+
+#endif
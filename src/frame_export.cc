@@ -0,0 +1,97 @@
+#include "frame_export.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+FrameExport::~FrameExport()
+{
+	close();
+}
+
+bool FrameExport::create(const std::string& name, int max_width, int max_height)
+{
+	name_ = "/" + name;
+	uint32_t slot_size = frameRingAlign(size_t(max_width) * max_height * 4);
+	size_ = frameRingSize(kFrameExportSlots, slot_size);
+	// A new object every run, so consumers of an old one see it closed
+	// rather than its pages changing size under them.
+	shm_unlink(name_.c_str());
+	int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		printf("Cannot create shared memory %s: %s\n", name_.c_str(), strerror(errno));
+		return false;
+	}
+	// Pages are only backed once written, so room for the largest frame
+	// costs nothing until it's drawn.
+	if (ftruncate(fd, size_) != 0) {
+		printf("Cannot size shared memory %s: %s\n", name_.c_str(), strerror(errno));
+		::close(fd);
+		shm_unlink(name_.c_str());
+		return false;
+	}
+	ring_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (ring_ == MAP_FAILED) {
+		printf("Cannot map shared memory %s: %s\n", name_.c_str(), strerror(errno));
+		ring_ = nullptr;
+		shm_unlink(name_.c_str());
+		return false;
+	}
+
+	// ftruncate zeroed it.
+	header_ = static_cast<FrameRingHeader*>(ring_);
+	header_->version = kFrameRingVersion;
+	header_->slots = kFrameExportSlots;
+	header_->slot_size = slot_size;
+	header_->max_width = max_width;
+	header_->max_height = max_height;
+	header_->magic.store(kFrameRingMagic);
+	printf("Exporting frames up to %dx%d to shared memory %s\n", max_width, max_height, name_.c_str());
+	return true;
+}
+
+unsigned char* FrameExport::begin(int width, int height)
+{
+	if (!header_ || uint32_t(width) > header_->max_width || uint32_t(height) > header_->max_height)
+		return nullptr;
+	uint32_t index = sequence_ % header_->slots;
+	writing_ = frameRingSlot(ring_, index);
+	// Odd: a consumer still reading the frame that was here sees it torn.
+	writing_->sequence.store(2 * (sequence_ + 1) - 1);
+	std::atomic_thread_fence(std::memory_order_release);
+	writing_->width = width;
+	writing_->height = height;
+	writing_->stride = width * 4;
+	writing_->format = kFrameRGBA8BottomUp;
+	return frameRingPixels(ring_, index);
+}
+
+void FrameExport::publish()
+{
+	if (!writing_)
+		return;
+	sequence_++;
+	writing_->timestamp_ns = frameRingNow();
+	writing_->sequence.store(2 * sequence_);
+	writing_ = nullptr;
+	header_->sequence.store(sequence_);
+	if (header_->waiters.load())
+		frameRingWake(header_->sequence);
+}
+
+void FrameExport::close()
+{
+	if (!ring_)
+		return;
+	// Sleepers wake without a new frame and see it closed.
+	header_->closed.store(1);
+	frameRingWake(header_->sequence);
+	munmap(ring_, size_);
+	shm_unlink(name_.c_str());
+	ring_ = nullptr;
+	header_ = nullptr;
+}
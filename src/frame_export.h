@@ -0,0 +1,48 @@
+#ifndef NPR_FRAME_EXPORT_H
+#define NPR_FRAME_EXPORT_H
+
+#include "frame_ring.h"
+
+#include <string>
+
+/*
+ * The producer side of frame_ring.h: a POSIX shared memory ring of
+ * kFrameExportSlots frames up to a fixed size, which other processes on
+ * the machine map by name and read without copying. Pixels are written
+ * straight into the next slot and published; a consumer that falls behind
+ * skips frames and never holds the producer up.
+ */
+class FrameExport {
+public:
+	FrameExport() = default;
+	~FrameExport();
+	FrameExport(const FrameExport&) = delete;
+	FrameExport& operator=(const FrameExport&) = delete;
+
+	// Makes /<name>, replacing one a crashed run left. Prints why and
+	// returns false if it can't.
+	bool create(const std::string& name, int max_width, int max_height);
+
+	// The next slot's pixels, marked as being written, or nullptr if the
+	// frame is bigger than the ring was made for.
+	unsigned char* begin(int width, int height);
+	// Publishes what begin() returned and wakes waiting consumers.
+	void publish();
+
+	// Marks the ring closed and unlinks the name; mapped consumers keep
+	// what they have.
+	void close();
+
+	unsigned int published() const { return sequence_; }
+	unsigned int consumersWaiting() const { return header_ ? header_->waiters.load() : 0; }
+
+private:
+	std::string name_;
+	void* ring_ = nullptr;
+	size_t size_ = 0;
+	FrameRingHeader* header_ = nullptr;
+	FrameSlot* writing_ = nullptr;
+	uint32_t sequence_ = 0;
+};
+
+#endif
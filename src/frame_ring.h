@@ -0,0 +1,123 @@
+#ifndef NPR_FRAME_RING_H
+#define NPR_FRAME_RING_H
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * Layout of the shared memory --export writes frames into, for consumers
+ * in other processes; tools/frametap.cc is a small one. The producer
+ * shm_open()s /<name> and lays out:
+ *
+ *   FrameRingHeader, padded to kFrameRingAlign
+ *   FrameSlot[slots], each padded to kFrameRingAlign
+ *   slots * slot_size bytes of pixels, kFrameRingAlign aligned
+ *
+ * Frame n (from 1) goes into slot (n - 1) % slots, then header.sequence
+ * becomes n and sleepers on it are woken through a shared futex. A slot's
+ * own sequence is odd while it's being written and 2n once frame n is in
+ * it, so a consumer reading in place checks it before and after: if it
+ * changed the frame was overwritten meanwhile and is torn. Consumers write
+ * nothing but the waiters count, and the producer never waits for them.
+ */
+
+const uint32_t kFrameRingMagic = 0x4e505246;  // "FRPN"
+const uint32_t kFrameRingVersion = 1;
+const size_t kFrameRingAlign = 4096;
+
+enum FrameFormat : uint32_t {
+	// 8 bits per channel, bottom row first as glReadPixels returns it.
+	kFrameRGBA8BottomUp = 1,
+};
+
+struct FrameRingHeader {
+	// Stored last, once the rest is filled in.
+	std::atomic<uint32_t> magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t slot_size;
+	uint32_t max_width;
+	uint32_t max_height;
+	// Last frame published, 0 before the first; the futex word.
+	std::atomic<uint32_t> sequence;
+	// Consumers sleeping on sequence, so the producer only makes the wake
+	// system call when someone is.
+	std::atomic<uint32_t> waiters;
+	// Set when the producer exits; the name is unlinked by then.
+	std::atomic<uint32_t> closed;
+};
+
+struct FrameSlot {
+	std::atomic<uint32_t> sequence;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t format;
+	uint32_t reserved;
+	// CLOCK_MONOTONIC when the frame was published.
+	uint64_t timestamp_ns;
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "the futex word has to be a plain 32-bit integer");
+
+inline size_t frameRingAlign(size_t size)
+{
+	return (size + kFrameRingAlign - 1) & ~(kFrameRingAlign - 1);
+}
+
+inline size_t frameRingSlotsOffset()
+{
+	return frameRingAlign(sizeof(FrameRingHeader));
+}
+
+inline size_t frameRingPixelsOffset(uint32_t slots)
+{
+	return frameRingSlotsOffset() + frameRingAlign(slots * sizeof(FrameSlot));
+}
+
+inline size_t frameRingSize(uint32_t slots, uint32_t slot_size)
+{
+	return frameRingPixelsOffset(slots) + size_t(slots) * slot_size;
+}
+
+inline FrameSlot* frameRingSlot(void* ring, uint32_t index)
+{
+	return reinterpret_cast<FrameSlot*>(static_cast<char*>(ring) + frameRingSlotsOffset()) + index;
+}
+
+inline unsigned char* frameRingPixels(void* ring, uint32_t index)
+{
+	const FrameRingHeader* header = static_cast<const FrameRingHeader*>(ring);
+	return static_cast<unsigned char*>(ring) + frameRingPixelsOffset(header->slots) +
+	       size_t(index) * header->slot_size;
+}
+
+inline uint64_t frameRingNow()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return uint64_t(now.tv_sec) * 1000000000u + now.tv_nsec;
+}
+
+// Shared (not FUTEX_PRIVATE) operations, the word lives in another
+// process's mapping too.
+inline void frameRingWake(std::atomic<uint32_t>& word)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Sleeps while word is still seen, at most timeout_ms.
+inline void frameRingWait(std::atomic<uint32_t>& word, uint32_t seen, int timeout_ms)
+{
+	timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, seen, &timeout, nullptr, 0);
+}
+
+#endif
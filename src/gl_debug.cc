@@ -0,0 +1,80 @@
+#include "gl_debug.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <cstdlib>
+
+namespace {
+
+const char* gl_debug_mode = "off";
+bool gl_error_polling = false;
+// The callback may come from a driver thread unless it's synchronous.
+std::atomic<unsigned int> gl_error_count(0);
+
+#ifdef NPR_GL_DEBUG
+const char* typeName(GLenum type)
+{
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	default: return "other";
+	}
+}
+
+void GLAPIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity,
+                             GLsizei length, const GLchar* message, const void* user)
+{
+	if (type == GL_DEBUG_TYPE_ERROR)
+		gl_error_count++;
+	fprintf(stderr, "GL %s %u: %.*s\n", typeName(type), id, int(length), message);
+}
+#endif
+
+}
+
+void setupGLDebugOutput(bool synchronous)
+{
+#ifdef NPR_GL_DEBUG
+	if (!GLEW_KHR_debug) {
+		gl_debug_mode = "glGetError";
+		gl_error_polling = true;
+		return;
+	}
+	glEnable(GL_DEBUG_OUTPUT);
+	if (synchronous)
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(debugMessage, nullptr);
+	// Notifications are chatter like buffer placement hints.
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	gl_debug_mode = synchronous ? "KHR_debug, synchronous" : "KHR_debug";
+#else
+	(void)synchronous;
+#endif
+}
+
+const char* glDebugMode()
+{
+	return gl_debug_mode;
+}
+
+unsigned int glErrorCount()
+{
+	return gl_error_count;
+}
+
+bool glErrorPolling()
+{
+	return gl_error_polling;
+}
+
+void checkGLError(const char* file, int line)
+{
+	GLenum error = glGetError();
+	if (error != GL_NO_ERROR) {
+		fprintf(stderr, "%s:%d: GL error %#x\n", file, line, error);
+		exit(EXIT_FAILURE);
+	}
+}
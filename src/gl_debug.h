@@ -0,0 +1,37 @@
+#ifndef NPR_GL_DEBUG_H
+#define NPR_GL_DEBUG_H
+
+#include <GL/glew.h>
+#include <debuggl.h>
+
+/*
+ * GL error checking, picked by the NPR_GL_DEBUG cmake option. With it the
+ * driver reports errors as they happen through a KHR_debug callback, and
+ * only where that's missing does CHECK_GL_ERROR fall back to a glGetError
+ * after the statement. Without it CHECK_GL_ERROR is just the statement.
+ */
+#undef CHECK_GL_ERROR
+#ifdef NPR_GL_DEBUG
+#define CHECK_GL_ERROR(statement) \
+	do { statement; if (glErrorPolling()) checkGLError(__FILE__, __LINE__); } while (0)
+#else
+#define CHECK_GL_ERROR(statement) do { statement; } while (0)
+#endif
+
+// Once the context is current. synchronous has the driver report from
+// inside the failing call, so a breakpoint in the callback shows who made
+// it, at the cost of the driver's own threading.
+void setupGLDebugOutput(bool synchronous);
+
+// For the overlay: "off", "glGetError", "KHR_debug" or
+// "KHR_debug, synchronous".
+const char* glDebugMode();
+
+// Errors the callback has seen.
+unsigned int glErrorCount();
+
+// For CHECK_GL_ERROR.
+bool glErrorPolling();
+void checkGLError(const char* file, int line);
+
+#endif
@@ -0,0 +1,306 @@
+#include "gl_state.h"
+
+namespace {
+
+GLuint getUnsigned(GLenum name)
+{
+	GLint value = 0;
+	glGetIntegerv(name, &value);
+	return GLuint(value);
+}
+
+}
+
+GLStateCache& glState()
+{
+	static GLStateCache cache;
+	return cache;
+}
+
+bool GLStateCache::changes(bool differs)
+{
+	counters_.calls++;
+	if (!differs)
+		counters_.redundant++;
+	return differs;
+}
+
+void GLStateCache::sync()
+{
+	GLStateSnapshot& s = state_;
+	s.depth_test = glIsEnabled(GL_DEPTH_TEST);
+	s.blend = glIsEnabled(GL_BLEND);
+	s.cull_face = glIsEnabled(GL_CULL_FACE);
+	s.multisample = glIsEnabled(GL_MULTISAMPLE);
+	s.scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+	s.depth_func = getUnsigned(GL_DEPTH_FUNC);
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &s.depth_mask);
+	s.blend_src_rgb = getUnsigned(GL_BLEND_SRC_RGB);
+	s.blend_dst_rgb = getUnsigned(GL_BLEND_DST_RGB);
+	s.blend_src_alpha = getUnsigned(GL_BLEND_SRC_ALPHA);
+	s.blend_dst_alpha = getUnsigned(GL_BLEND_DST_ALPHA);
+	s.blend_equation_rgb = getUnsigned(GL_BLEND_EQUATION_RGB);
+	s.blend_equation_alpha = getUnsigned(GL_BLEND_EQUATION_ALPHA);
+	s.cull_face_mode = getUnsigned(GL_CULL_FACE_MODE);
+	GLint polygon_mode[2] = { GL_FILL, GL_FILL };
+	glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+	s.polygon_mode = polygon_mode[0];
+	s.program = getUnsigned(GL_CURRENT_PROGRAM);
+	s.active_texture = getUnsigned(GL_ACTIVE_TEXTURE);
+	for (int i = 0; i < kCachedTextureUnits; i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		s.textures_2d[i] = getUnsigned(GL_TEXTURE_BINDING_2D);
+		s.textures_2d_array[i] = getUnsigned(GL_TEXTURE_BINDING_2D_ARRAY);
+		s.samplers[i] = getUnsigned(GL_SAMPLER_BINDING);
+	}
+	glActiveTexture(s.active_texture);
+	s.vertex_array = getUnsigned(GL_VERTEX_ARRAY_BINDING);
+	s.array_buffer = getUnsigned(GL_ARRAY_BUFFER_BINDING);
+	s.draw_framebuffer = getUnsigned(GL_DRAW_FRAMEBUFFER_BINDING);
+	s.read_framebuffer = getUnsigned(GL_READ_FRAMEBUFFER_BINDING);
+	glGetIntegerv(GL_VIEWPORT, s.viewport);
+	glGetIntegerv(GL_SCISSOR_BOX, s.scissor_box);
+}
+
+void GLStateCache::setEnabled(GLenum capability, bool enabled)
+{
+	bool* current = nullptr;
+	switch (capability) {
+	case GL_DEPTH_TEST: current = &state_.depth_test; break;
+	case GL_BLEND: current = &state_.blend; break;
+	case GL_CULL_FACE: current = &state_.cull_face; break;
+	case GL_MULTISAMPLE: current = &state_.multisample; break;
+	case GL_SCISSOR_TEST: current = &state_.scissor_test; break;
+	}
+	if (current && !changes(*current != enabled))
+		return;
+	if (current)
+		*current = enabled;
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
+
+void GLStateCache::depthFunc(GLenum func)
+{
+	if (!changes(state_.depth_func != func))
+		return;
+	state_.depth_func = func;
+	glDepthFunc(func);
+}
+
+void GLStateCache::depthMask(GLboolean mask)
+{
+	if (!changes(state_.depth_mask != mask))
+		return;
+	state_.depth_mask = mask;
+	glDepthMask(mask);
+}
+
+void GLStateCache::blendFuncSeparate(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha)
+{
+	GLStateSnapshot& s = state_;
+	if (!changes(s.blend_src_rgb != src_rgb || s.blend_dst_rgb != dst_rgb ||
+	             s.blend_src_alpha != src_alpha || s.blend_dst_alpha != dst_alpha))
+		return;
+	s.blend_src_rgb = src_rgb;
+	s.blend_dst_rgb = dst_rgb;
+	s.blend_src_alpha = src_alpha;
+	s.blend_dst_alpha = dst_alpha;
+	glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+}
+
+void GLStateCache::blendEquationSeparate(GLenum mode_rgb, GLenum mode_alpha)
+{
+	if (!changes(state_.blend_equation_rgb != mode_rgb || state_.blend_equation_alpha != mode_alpha))
+		return;
+	state_.blend_equation_rgb = mode_rgb;
+	state_.blend_equation_alpha = mode_alpha;
+	glBlendEquationSeparate(mode_rgb, mode_alpha);
+}
+
+void GLStateCache::cullFace(GLenum mode)
+{
+	if (!changes(state_.cull_face_mode != mode))
+		return;
+	state_.cull_face_mode = mode;
+	glCullFace(mode);
+}
+
+void GLStateCache::polygonMode(GLenum mode)
+{
+	if (!changes(state_.polygon_mode != mode))
+		return;
+	state_.polygon_mode = mode;
+	glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+	if (!changes(state_.program != program))
+		return;
+	state_.program = program;
+	glUseProgram(program);
+}
+
+void GLStateCache::activeTexture(GLenum unit)
+{
+	if (!changes(state_.active_texture != unit))
+		return;
+	state_.active_texture = unit;
+	glActiveTexture(unit);
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture)
+{
+	GLuint unit = state_.active_texture - GL_TEXTURE0;
+	GLuint* current = nullptr;
+	if (unit < GLuint(kCachedTextureUnits) && target == GL_TEXTURE_2D)
+		current = &state_.textures_2d[unit];
+	else if (unit < GLuint(kCachedTextureUnits) && target == GL_TEXTURE_2D_ARRAY)
+		current = &state_.textures_2d_array[unit];
+	if (current && !changes(*current != texture))
+		return;
+	if (current)
+		*current = texture;
+	glBindTexture(target, texture);
+}
+
+void GLStateCache::bindSampler(GLuint unit, GLuint sampler)
+{
+	if (unit < GLuint(kCachedTextureUnits)) {
+		if (!changes(state_.samplers[unit] != sampler))
+			return;
+		state_.samplers[unit] = sampler;
+	}
+	glBindSampler(unit, sampler);
+}
+
+void GLStateCache::bindVertexArray(GLuint vertex_array)
+{
+	if (!changes(state_.vertex_array != vertex_array))
+		return;
+	state_.vertex_array = vertex_array;
+	glBindVertexArray(vertex_array);
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+	if (target == GL_ARRAY_BUFFER) {
+		if (!changes(state_.array_buffer != buffer))
+			return;
+		state_.array_buffer = buffer;
+	}
+	glBindBuffer(target, buffer);
+}
+
+void GLStateCache::bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	bool draw = target != GL_READ_FRAMEBUFFER, read = target != GL_DRAW_FRAMEBUFFER;
+	if (!changes((draw && state_.draw_framebuffer != framebuffer) ||
+	             (read && state_.read_framebuffer != framebuffer)))
+		return;
+	if (draw)
+		state_.draw_framebuffer = framebuffer;
+	if (read)
+		state_.read_framebuffer = framebuffer;
+	glBindFramebuffer(target, framebuffer);
+}
+
+void GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	GLint* v = state_.viewport;
+	if (!changes(v[0] != x || v[1] != y || v[2] != width || v[3] != height))
+		return;
+	v[0] = x;
+	v[1] = y;
+	v[2] = width;
+	v[3] = height;
+	glViewport(x, y, width, height);
+}
+
+void GLStateCache::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	GLint* box = state_.scissor_box;
+	if (!changes(box[0] != x || box[1] != y || box[2] != width || box[3] != height))
+		return;
+	box[0] = x;
+	box[1] = y;
+	box[2] = width;
+	box[3] = height;
+	glScissor(x, y, width, height);
+}
+
+void GLStateCache::deleteTextures(GLsizei count, const GLuint* textures)
+{
+	for (GLsizei i = 0; i < count; i++) {
+		for (int unit = 0; unit < kCachedTextureUnits; unit++) {
+			if (state_.textures_2d[unit] == textures[i])
+				state_.textures_2d[unit] = 0;
+			if (state_.textures_2d_array[unit] == textures[i])
+				state_.textures_2d_array[unit] = 0;
+		}
+	}
+	glDeleteTextures(count, textures);
+}
+
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint* buffers)
+{
+	for (GLsizei i = 0; i < count; i++)
+		if (state_.array_buffer == buffers[i])
+			state_.array_buffer = 0;
+	glDeleteBuffers(count, buffers);
+}
+
+void GLStateCache::deleteVertexArrays(GLsizei count, const GLuint* vertex_arrays)
+{
+	for (GLsizei i = 0; i < count; i++)
+		if (state_.vertex_array == vertex_arrays[i])
+			state_.vertex_array = 0;
+	glDeleteVertexArrays(count, vertex_arrays);
+}
+
+void GLStateCache::deleteFramebuffers(GLsizei count, const GLuint* framebuffers)
+{
+	for (GLsizei i = 0; i < count; i++) {
+		if (state_.draw_framebuffer == framebuffers[i])
+			state_.draw_framebuffer = 0;
+		if (state_.read_framebuffer == framebuffers[i])
+			state_.read_framebuffer = 0;
+	}
+	glDeleteFramebuffers(count, framebuffers);
+}
+
+void GLStateCache::restore(const GLStateSnapshot& state)
+{
+	setEnabled(GL_DEPTH_TEST, state.depth_test);
+	setEnabled(GL_BLEND, state.blend);
+	setEnabled(GL_CULL_FACE, state.cull_face);
+	setEnabled(GL_MULTISAMPLE, state.multisample);
+	setEnabled(GL_SCISSOR_TEST, state.scissor_test);
+	depthFunc(state.depth_func);
+	depthMask(state.depth_mask);
+	blendFuncSeparate(state.blend_src_rgb, state.blend_dst_rgb, state.blend_src_alpha, state.blend_dst_alpha);
+	blendEquationSeparate(state.blend_equation_rgb, state.blend_equation_alpha);
+	cullFace(state.cull_face_mode);
+	polygonMode(state.polygon_mode);
+	useProgram(state.program);
+	for (int unit = 0; unit < kCachedTextureUnits; unit++) {
+		if (state_.textures_2d[unit] == state.textures_2d[unit] &&
+		    state_.textures_2d_array[unit] == state.textures_2d_array[unit])
+			continue;
+		activeTexture(GL_TEXTURE0 + unit);
+		bindTexture(GL_TEXTURE_2D, state.textures_2d[unit]);
+		bindTexture(GL_TEXTURE_2D_ARRAY, state.textures_2d_array[unit]);
+	}
+	for (int unit = 0; unit < kCachedTextureUnits; unit++)
+		bindSampler(unit, state.samplers[unit]);
+	activeTexture(state.active_texture);
+	bindVertexArray(state.vertex_array);
+	bindBuffer(GL_ARRAY_BUFFER, state.array_buffer);
+	bindFramebuffer(GL_DRAW_FRAMEBUFFER, state.draw_framebuffer);
+	bindFramebuffer(GL_READ_FRAMEBUFFER, state.read_framebuffer);
+	viewport(state.viewport[0], state.viewport[1], state.viewport[2], state.viewport[3]);
+	scissor(state.scissor_box[0], state.scissor_box[1], state.scissor_box[2], state.scissor_box[3]);
+}
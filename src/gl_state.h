@@ -0,0 +1,106 @@
+#ifndef NPR_GL_STATE_H
+#define NPR_GL_STATE_H
+
+#include <GL/glew.h>
+
+// Texture units whose bindings are shadowed; higher ones go straight through.
+const int kCachedTextureUnits = 8;
+
+// Everything GLStateCache shadows, starting out as GL's initial state.
+// Also what save() hands back, so putting state back after someone else
+// drew is a struct copy and a few compares instead of ~20 glGets.
+struct GLStateSnapshot {
+	bool depth_test = false;
+	bool blend = false;
+	bool cull_face = false;
+	bool multisample = true;
+	bool scissor_test = false;
+	GLenum depth_func = GL_LESS;
+	GLboolean depth_mask = GL_TRUE;
+	GLenum blend_src_rgb = GL_ONE, blend_dst_rgb = GL_ZERO;
+	GLenum blend_src_alpha = GL_ONE, blend_dst_alpha = GL_ZERO;
+	GLenum blend_equation_rgb = GL_FUNC_ADD, blend_equation_alpha = GL_FUNC_ADD;
+	GLenum cull_face_mode = GL_BACK;
+	GLenum polygon_mode = GL_FILL;
+	GLuint program = 0;
+	GLenum active_texture = GL_TEXTURE0;
+	GLuint textures_2d[kCachedTextureUnits] = {};
+	GLuint textures_2d_array[kCachedTextureUnits] = {};
+	GLuint samplers[kCachedTextureUnits] = {};
+	GLuint vertex_array = 0;
+	GLuint array_buffer = 0;
+	GLuint draw_framebuffer = 0;
+	GLuint read_framebuffer = 0;
+	GLint viewport[4] = {};
+	GLint scissor_box[4] = {};
+};
+
+struct GLStateCounters {
+	unsigned int calls = 0;
+	// Calls that would have set what was already there, so were dropped.
+	unsigned int redundant = 0;
+};
+
+/*
+ * Shadows the GL state the renderer and the ImGui backend change and drops
+ * calls that wouldn't change it. Only works if everything that touches
+ * this state goes through it (element array bindings belong to the vertex
+ * array and aren't shadowed); code that doesn't must call sync() after.
+ */
+class GLStateCache {
+public:
+	// Reads the real state back. Once the context is current, and after
+	// anything that went around the cache.
+	void sync();
+
+	// GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_MULTISAMPLE and
+	// GL_SCISSOR_TEST; anything else isn't filtered.
+	void enable(GLenum capability) { setEnabled(capability, true); }
+	void disable(GLenum capability) { setEnabled(capability, false); }
+	void setEnabled(GLenum capability, bool enabled);
+	void depthFunc(GLenum func);
+	void depthMask(GLboolean mask);
+	void blendFunc(GLenum src, GLenum dst) { blendFuncSeparate(src, dst, src, dst); }
+	void blendFuncSeparate(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha);
+	void blendEquation(GLenum mode) { blendEquationSeparate(mode, mode); }
+	void blendEquationSeparate(GLenum mode_rgb, GLenum mode_alpha);
+	void cullFace(GLenum mode);
+	void polygonMode(GLenum mode);
+	void useProgram(GLuint program);
+	void activeTexture(GLenum unit);
+	// On the active unit; GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY are shadowed.
+	void bindTexture(GLenum target, GLuint texture);
+	void bindSampler(GLuint unit, GLuint sampler);
+	void bindVertexArray(GLuint vertex_array);
+	// GL_ARRAY_BUFFER is shadowed, other targets go straight through.
+	void bindBuffer(GLenum target, GLuint buffer);
+	// GL_FRAMEBUFFER binds both the draw and the read framebuffer.
+	void bindFramebuffer(GLenum target, GLuint framebuffer);
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	// Deleting something bound unbinds it, and the name may come back from
+	// the next glGen*, so deletes have to come through here too.
+	void deleteTextures(GLsizei count, const GLuint* textures);
+	void deleteBuffers(GLsizei count, const GLuint* buffers);
+	void deleteVertexArrays(GLsizei count, const GLuint* vertex_arrays);
+	void deleteFramebuffers(GLsizei count, const GLuint* framebuffers);
+
+	const GLStateSnapshot& save() const { return state_; }
+	void restore(const GLStateSnapshot& state);
+
+	const GLStateCounters& counters() const { return counters_; }
+	void resetCounters() { counters_ = GLStateCounters(); }
+
+private:
+	// Counts the call; true if it would change anything.
+	bool changes(bool differs);
+
+	GLStateSnapshot state_;
+	GLStateCounters counters_;
+};
+
+// The one context's cache.
+GLStateCache& glState();
+
+#endif
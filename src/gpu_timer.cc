@@ -0,0 +1,222 @@
+#include "gpu_timer.h"
+#include "profiler.h"
+#include "imgui.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct Stats {
+	float min = 0.0f, avg = 0.0f, p99 = 0.0f;
+	int count = 0;
+};
+
+Stats computeStats(std::vector<float> values)
+{
+	Stats stats;
+	values.erase(std::remove_if(values.begin(), values.end(), [](float v) { return v < 0.0f; }), values.end());
+	if (values.empty())
+		return stats;
+	std::sort(values.begin(), values.end());
+	stats.count = values.size();
+	stats.min = values.front();
+	float sum = 0.0f;
+	for (float v : values)
+		sum += v;
+	stats.avg = sum / values.size();
+	// Nearest rank: the smallest value at or above 99% of the samples.
+	size_t rank = size_t(std::ceil(0.99 * values.size()));
+	stats.p99 = values[std::max(rank, size_t(1)) - 1];
+	return stats;
+}
+
+}
+
+GPUTimer::~GPUTimer()
+{
+	if (enabled_)
+		for (Slot& slot : slots_)
+			glDeleteQueries(2 + 2 * kGPUTimerMaxPasses, slot.queries);
+}
+
+bool GPUTimer::create()
+{
+	GLint bits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+	if (bits == 0) {
+		printf("GPU timer: no timestamp queries, timings are off\n");
+		return false;
+	}
+	for (Slot& slot : slots_)
+		glGenQueries(2 + 2 * kGPUTimerMaxPasses, slot.queries);
+	enabled_ = true;
+	return true;
+}
+
+int GPUTimer::passIndex(const char* pass)
+{
+	for (size_t i = 0; i < names_.size(); i++)
+		if (names_[i] == pass)
+			return i;
+	if (names_.size() >= size_t(kGPUTimerMaxPasses))
+		return -1;
+	names_.push_back(pass);
+	return names_.size() - 1;
+}
+
+void GPUTimer::collect(Slot& slot)
+{
+	GLuint64 times[2 + 2 * kGPUTimerMaxPasses];
+	int used = 2 + 2 * slot.count;
+	for (int i = 0; i < used; i++)
+		glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &times[i]);
+
+	Sample sample;
+	sample.frame = slot.frame;
+	sample.ms.assign(1 + names_.size(), -1.0f);
+	sample.ms[0] = (times[1] - times[0]) * 1e-6f;
+	for (int i = 0; i < slot.count; i++)
+		sample.ms[1 + slot.passes[i]] = (times[3 + 2 * i] - times[2 + 2 * i]) * 1e-6f;
+	history_.push_back(std::move(sample));
+	if (history_.size() > size_t(kGPUTimerHistory))
+		history_.pop_front();
+	slot.pending = false;
+}
+
+void GPUTimer::beginFrame()
+{
+	if (!enabled_)
+		return;
+	// Oldest first, starting with the slot about to be reused. Results come
+	// back in order, so the first that isn't ready ends the search.
+	for (int i = 0; i < kGPUTimerFrames; i++) {
+		Slot& slot = slots_[(current_ + i) % kGPUTimerFrames];
+		if (!slot.pending)
+			continue;
+		// The frame's end is its last query.
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+		collect(slot);
+	}
+
+	recording_ = timing_;
+	if (!recording_)
+		return;
+	Slot& slot = slots_[current_];
+	if (slot.pending)
+		dropped_++;
+	slot.pending = false;
+	slot.count = 0;
+	slot.frame = frame_++;
+	glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+}
+
+void GPUTimer::begin(const char* pass)
+{
+	if (!recording_)
+		return;
+	if (in_pass_)
+		end();
+	Slot& slot = slots_[current_];
+	int index = passIndex(pass);
+	if (index < 0 || slot.count == kGPUTimerMaxPasses)
+		return;
+	slot.passes[slot.count] = index;
+	glQueryCounter(slot.queries[2 + 2 * slot.count], GL_TIMESTAMP);
+	in_pass_ = true;
+}
+
+void GPUTimer::end()
+{
+	if (!recording_ || !in_pass_)
+		return;
+	Slot& slot = slots_[current_];
+	glQueryCounter(slot.queries[3 + 2 * slot.count], GL_TIMESTAMP);
+	slot.count++;
+	in_pass_ = false;
+}
+
+void GPUTimer::endFrame()
+{
+	if (!recording_)
+		return;
+	if (in_pass_)
+		end();
+	Slot& slot = slots_[current_];
+	glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+	slot.pending = true;
+	current_ = (current_ + 1) % kGPUTimerFrames;
+}
+
+void GPUTimer::draw()
+{
+	PROFILE_ZONE("GPUTimer::draw");
+	ImGui::Begin("GPU timings");
+	ImGui::Text("CPU %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+	if (!enabled_) {
+		ImGui::Text("No timer queries on this driver");
+		ImGui::End();
+		return;
+	}
+	// Software rasterizers flush their tiles at every query, so this costs
+	// more there than on a GPU.
+	ImGui::Checkbox("time passes", &timing_);
+	ImGui::SameLine();
+	ImGui::Text("%zu frames, %u dropped waiting on the GPU", history_.size(), dropped_);
+
+	std::vector<float> values(history_.size());
+	for (size_t pass = 0; pass <= names_.size(); pass++) {
+		for (size_t i = 0; i < history_.size(); i++)
+			values[i] = pass < history_[i].ms.size() ? history_[i].ms[pass] : -1.0f;
+		Stats stats = computeStats(values);
+		const char* name = pass == 0 ? "frame" : names_[pass - 1].c_str();
+		if (stats.count == 0) {
+			ImGui::Text("%-10s not drawn", name);
+			continue;
+		}
+		ImGui::Text("%-10s min %.3f  avg %.3f  p99 %.3f ms", name, stats.min, stats.avg, stats.p99);
+		// Frames that skipped the pass plot as zero.
+		for (float& v : values)
+			v = std::max(v, 0.0f);
+		ImGui::PushID(int(pass));
+		ImGui::PlotLines("", values.data(), values.size(), 0, nullptr, 0.0f, stats.p99 * 1.25f,
+		                 ImVec2(0.0f, 32.0f));
+		ImGui::PopID();
+	}
+
+	if (ImGui::Button("export CSV")) {
+		exported_ = exportCSV("gpu_timings.csv") ? "wrote gpu_timings.csv" : "couldn't write gpu_timings.csv";
+		printf("GPU timer: %s\n", exported_.c_str());
+	}
+	if (!exported_.empty()) {
+		ImGui::SameLine();
+		ImGui::Text("%s", exported_.c_str());
+	}
+	ImGui::End();
+}
+
+bool GPUTimer::exportCSV(const std::string& path) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+	fprintf(file, "frame,frame_ms");
+	for (const std::string& name : names_)
+		fprintf(file, ",%s_ms", name.c_str());
+	fprintf(file, "\n");
+	for (const Sample& sample : history_) {
+		fprintf(file, "%u", sample.frame);
+		for (size_t i = 0; i <= names_.size(); i++) {
+			if (i < sample.ms.size() && sample.ms[i] >= 0.0f)
+				fprintf(file, ",%.4f", sample.ms[i]);
+			else
+				fprintf(file, ",");
+		}
+		fprintf(file, "\n");
+	}
+	return fclose(file) == 0;
+}
@@ -0,0 +1,80 @@
+#ifndef NPR_GPU_TIMER_H
+#define NPR_GPU_TIMER_H
+
+#include "config.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// Passes a frame can time.
+const int kGPUTimerMaxPasses = 8;
+
+/*
+ * GPU time per render pass, from GL_TIMESTAMP queries around each pass and
+ * around the whole frame. Queries go round a ring of kGPUTimerFrames
+ * frames and are only read once the driver says they're available, so
+ * nothing waits on the GPU; a frame whose queries still aren't back when
+ * its slot comes round again is dropped rather than waited for.
+ *
+ * Passes are named with string literals and don't nest. One that isn't
+ * drawn in a frame (the outline while it's off) is left out of its stats.
+ */
+class GPUTimer {
+public:
+	GPUTimer() = default;
+	~GPUTimer();
+	GPUTimer(const GPUTimer&) = delete;
+	GPUTimer& operator=(const GPUTimer&) = delete;
+
+	// Once the context is current. Returns false, and timing stays off, if
+	// the driver has no timestamp bits.
+	bool create();
+
+	// Reads back whatever frames have finished, then starts this one.
+	void beginFrame();
+	void begin(const char* pass);
+	void end();
+	void endFrame();
+
+	// ImGui window with min/avg/p99 and a sparkline per pass.
+	void draw();
+
+	// One row per frame in the history, in milliseconds; passes a frame
+	// didn't draw are empty.
+	bool exportCSV(const std::string& path) const;
+
+private:
+	struct Slot {
+		// Frame begin and end, then begin and end of each pass.
+		GLuint queries[2 + 2 * kGPUTimerMaxPasses];
+		int passes[kGPUTimerMaxPasses];
+		int count = 0;
+		bool pending = false;
+		unsigned int frame = 0;
+	};
+	struct Sample {
+		unsigned int frame;
+		// Whole frame first, then by pass index; negative if not drawn.
+		std::vector<float> ms;
+	};
+
+	int passIndex(const char* pass);
+	void collect(Slot& slot);
+
+	bool enabled_ = false;
+	// The panel's switch, and whether this frame is being timed.
+	bool timing_ = true;
+	bool recording_ = false;
+	Slot slots_[kGPUTimerFrames];
+	int current_ = 0;
+	bool in_pass_ = false;
+	unsigned int frame_ = 0;
+	unsigned int dropped_ = 0;
+	std::vector<std::string> names_;
+	std::deque<Sample> history_;
+	std::string exported_;
+};
+
+#endif
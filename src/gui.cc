@@ -1,6 +1,8 @@
 #include "gui.h"
 #include "config.h"
-#include <jpegio.h>
+#include "imgui.h"
+#include "profiler.h"
+#include <chrono>
 #include <iostream>
 #include <debuggl.h>
 #include <glm/gtc/matrix_access.hpp>
@@ -31,8 +33,10 @@ void GUI::keyCallback(int key, int scancode, int action, int mods)
 		glfwSetWindowShouldClose(window_, GL_TRUE);
 		return ;
 	}
-	if (key == GLFW_KEY_J && action == GLFW_RELEASE) {
-		//FIXME save out a screenshot using SaveJPEG
+	if (key == GLFW_KEY_J && action != GLFW_RELEASE) {
+		// main reads the frame back; holding J repeats for a burst.
+		screenshot_ = true;
+		return ;
 	}
 
 	if (captureWASDUPDOWN(key, action))
@@ -55,6 +59,13 @@ void GUI::keyCallback(int key, int scancode, int action, int mods)
 	}
 }
 
+bool GUI::takeScreenshotRequest()
+{
+	bool requested = screenshot_;
+	screenshot_ = false;
+	return requested;
+}
+
 void GUI::mousePosCallback(double mouse_x, double mouse_y)
 {
 	last_x_ = current_x_;
@@ -83,17 +94,39 @@ void GUI::mousePosCallback(double mouse_x, double mouse_y)
 		tangent_ = glm::column(orientation_, 0);
 		up_ = glm::column(orientation_, 1);
 		look_ = glm::column(orientation_, 2);
-	} 
+	} else if (drag_bone && !ImGui::GetIO().WantCaptureMouse) {
+		pickAt(mouse_end);
+	}
 }
 
 void GUI::mouseButtonCallback(int button, int action, int mods)
 {
+	// Clicks on the ImGui windows are theirs; picking and dragging through
+	// them would move the selection or the camera too.
+	if (action == GLFW_PRESS && ImGui::GetIO().WantCaptureMouse)
+		return;
 	drag_state_ = (action == GLFW_PRESS);
 	current_button_ = button;
+	if (drag_state_ && button == GLFW_MOUSE_BUTTON_LEFT)
+		pickAt(glm::vec2(current_x_, current_y_));
+}
+
+void GUI::pickAt(const glm::vec2& pixel)
+{
+	if (!pick_bvh_)
+		return;
+	auto start = std::chrono::steady_clock::now();
+	glm::uvec4 viewport = glm::uvec4(0, 0, window_width_, window_height_);
+	Ray ray = rayFromPixel(pixel, view_matrix_ * model_matrix_, projection_matrix_, viewport);
+	pick_ = pick_bvh_->intersect(ray);
+	pickBone(bones_, ray, pick_);
+	auto end = std::chrono::steady_clock::now();
+	pick_ms_ = std::chrono::duration<float, std::milli>(end - start).count();
 }
 
 void GUI::updateMatrices()
 {
+	PROFILE_ZONE("GUI::updateMatrices");
 	// Compute our view, and projection matrices.
 	if (fps_mode_)
 		center_ = eye_ + camera_distance_ * look_;
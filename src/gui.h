@@ -1,6 +1,9 @@
 #ifndef SKINNING_GUI_H
 #define SKINNING_GUI_H
 
+#include "bvh.h"
+
+#include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <GLFW/glfw3.h>
@@ -27,6 +30,16 @@ public:
 	bool isCelShaded() const { return cel_shaded_; }
 	bool isGoochShaded() const { return gooch_shaded_; }
 
+	// Whether J was pressed, or repeated while held, since last asked.
+	bool takeScreenshotRequest();
+
+	// Left clicks and drags pick against this BVH (in model space) and the
+	// bones, if any.
+	void setPickTarget(const BVH* bvh) { pick_bvh_ = bvh; }
+	void setBones(const std::vector<BoneSegment>& bones) { bones_ = bones; }
+	const PickResult& getPick() const { return pick_; }
+	float getPickTime() const { return pick_ms_; }
+
 	glm::mat4 getProjection();
 	glm::mat4 getView();
 	glm::mat4 getModel();
@@ -41,6 +54,7 @@ private:
 	bool outline_ = false;
 	bool cel_shaded_ = false;
 	bool gooch_shaded_ = false;
+	bool screenshot_ = false;
 	int current_button_ = -1;
 	float roll_speed_ = 0.1;
 	float last_x_ = 0.0f, last_y_ = 0.0f, current_x_ = 0.0f, current_y_ = 0.0f;
@@ -62,7 +76,13 @@ private:
 	glm::mat4 projection_matrix_;
 	glm::mat4 model_matrix_ = glm::mat4(1.0f);
 
+	const BVH* pick_bvh_ = nullptr;
+	std::vector<BoneSegment> bones_;
+	PickResult pick_;
+	float pick_ms_ = 0.0f;
+
 	bool captureWASDUPDOWN(int key, int action);
+	void pickAt(const glm::vec2& pixel);
 
 };
 
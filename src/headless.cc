@@ -0,0 +1,225 @@
+#include "headless.h"
+#include "gl_state.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <EGL/eglext.h>
+
+namespace {
+
+bool hasExtension(const char* extensions, const char* name)
+{
+	size_t length = strlen(name);
+	for (const char* p = extensions; p && (p = strstr(p, name)); p += length)
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	return false;
+}
+
+// Displays worth trying, best first.
+std::vector<EGLDisplay> candidateDisplays()
+{
+	std::vector<EGLDisplay> displays;
+	const char* client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay && hasExtension(client, "EGL_MESA_platform_surfaceless")) {
+		EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		if (display != EGL_NO_DISPLAY)
+			displays.push_back(display);
+	}
+#endif
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display != EGL_NO_DISPLAY)
+		displays.push_back(display);
+	return displays;
+}
+
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	destroy();
+}
+
+void HeadlessContext::destroy()
+{
+	if (display_ == EGL_NO_DISPLAY)
+		return;
+	eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context_ != EGL_NO_CONTEXT)
+		eglDestroyContext(display_, context_);
+	if (surface_ != EGL_NO_SURFACE)
+		eglDestroySurface(display_, surface_);
+	eglTerminate(display_);
+	display_ = EGL_NO_DISPLAY;
+	context_ = EGL_NO_CONTEXT;
+	surface_ = EGL_NO_SURFACE;
+}
+
+bool HeadlessContext::createOn(EGLDisplay display)
+{
+	EGLint major = 0, minor = 0;
+	if (!eglInitialize(display, &major, &minor))
+		return false;
+	display_ = display;
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		destroy();
+		return false;
+	}
+
+	bool surfaceless = hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+	const EGLint config_attributes[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = nullptr;
+	EGLint configs = 0;
+	if (!eglChooseConfig(display, config_attributes, &config, 1, &configs) || configs == 0) {
+		destroy();
+		return false;
+	}
+
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifdef NPR_GL_DEBUG
+		EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+		EGL_NONE
+	};
+	context_ = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+	if (context_ == EGL_NO_CONTEXT) {
+		destroy();
+		return false;
+	}
+	// Everything is drawn into framebuffer objects; the pbuffer is only
+	// there to make the context current.
+	if (!surfaceless) {
+		const EGLint pbuffer_attributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface_ = eglCreatePbufferSurface(display, config, pbuffer_attributes);
+	}
+	if ((!surfaceless && surface_ == EGL_NO_SURFACE) ||
+	    !eglMakeCurrent(display, surface_, surface_, context_)) {
+		destroy();
+		return false;
+	}
+	return true;
+}
+
+bool HeadlessContext::create()
+{
+	for (int attempt = 0; attempt < 2 && display_ == EGL_NO_DISPLAY; attempt++) {
+		if (attempt == 1) {
+			// Nothing in hardware; Mesa's llvmpipe runs anywhere.
+			printf("No hardware EGL context, trying llvmpipe\n");
+			setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+		}
+		for (EGLDisplay display : candidateDisplays())
+			if (createOn(display))
+				break;
+	}
+	if (display_ == EGL_NO_DISPLAY) {
+		printf("Cannot create a GL 3.3 context through EGL\n");
+		return false;
+	}
+
+	// GLEW looks for a GLX display after loading the entry points and has
+	// none to find here, which doesn't matter to GL itself.
+	glewExperimental = GL_TRUE;
+	GLenum error = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	if (error == GLEW_ERROR_NO_GLX_DISPLAY)
+		error = GLEW_OK;
+#endif
+	if (error != GLEW_OK) {
+		printf("GLEW: %s\n", (const char*)glewGetErrorString(error));
+		destroy();
+		return false;
+	}
+	glGetError();  // clear GLEW's error for it
+	printf("Renderer: %s (headless)\n", (const char*)glGetString(GL_RENDERER));
+	printf("OpenGL version supported:%s\n", (const char*)glGetString(GL_VERSION));
+	return true;
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+	if (framebuffer_) {
+		glState().deleteFramebuffers(1, &framebuffer_);
+		glDeleteRenderbuffers(2, renderbuffers_);
+	}
+	if (resolve_framebuffer_) {
+		glState().deleteFramebuffers(1, &resolve_framebuffer_);
+		glDeleteRenderbuffers(1, &resolve_color_);
+	}
+}
+
+bool OffscreenTarget::create(int width, int height, int samples)
+{
+	GLint max_size = 0, max_samples = 0;
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_size);
+	glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+	if (width <= 0 || height <= 0 || width > max_size || height > max_size) {
+		printf("Cannot render %dx%d, the driver's limit is %d\n", width, height, max_size);
+		return false;
+	}
+	samples = std::min(samples, int(max_samples));
+	width_ = width;
+	height_ = height;
+
+	glGenFramebuffers(1, &framebuffer_);
+	glGenRenderbuffers(2, renderbuffers_);
+	glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[0]);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples > 1 ? samples : 0, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers_[0]);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[1]);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples > 1 ? samples : 0, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers_[1]);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	if (complete && samples > 1) {
+		glGenFramebuffers(1, &resolve_framebuffer_);
+		glGenRenderbuffers(1, &resolve_color_);
+		glState().bindFramebuffer(GL_FRAMEBUFFER, resolve_framebuffer_);
+		glBindRenderbuffer(GL_RENDERBUFFER, resolve_color_);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolve_color_);
+		complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	}
+	glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete)
+		printf("Cannot render %dx%d with %d samples\n", width, height, samples);
+	return complete;
+}
+
+void OffscreenTarget::bind()
+{
+	glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+	glState().viewport(0, 0, width_, height_);
+}
+
+void OffscreenTarget::read(Image& image)
+{
+	GLuint source = framebuffer_;
+	if (resolve_framebuffer_) {
+		glState().bindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+		glState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_framebuffer_);
+		glBlitFramebuffer(0, 0, width_, height_, 0, 0, width_, height_, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		source = resolve_framebuffer_;
+	}
+	image.width = width_;
+	image.height = height_;
+	image.pixels.resize(size_t(width_) * height_ * 4);
+	glState().bindFramebuffer(GL_READ_FRAMEBUFFER, source);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,69 @@
+#ifndef NPR_HEADLESS_H
+#define NPR_HEADLESS_H
+
+#include "texture.h"
+
+#include <EGL/egl.h>
+#include <GL/glew.h>
+
+/*
+ * A GL 3.3 core context with no window or display server, for --headless.
+ * Tries Mesa's surfaceless platform, then the default EGL display, with a
+ * pbuffer where the driver can't make a context current without a surface.
+ * If no hardware driver gives a context it tries again forcing Mesa's
+ * software rasterizer (llvmpipe).
+ */
+class HeadlessContext {
+public:
+	HeadlessContext() = default;
+	~HeadlessContext();
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	// Makes the context current and loads GL through GLEW. Prints why and
+	// returns false if there is no way to get one.
+	bool create();
+
+private:
+	bool createOn(EGLDisplay display);
+	void destroy();
+
+	EGLDisplay display_ = EGL_NO_DISPLAY;
+	EGLContext context_ = EGL_NO_CONTEXT;
+	EGLSurface surface_ = EGL_NO_SURFACE;
+};
+
+/*
+ * Color and depth renderbuffers of any size to draw into instead of a
+ * window. With samples > 1 it is multisampled like the window and
+ * resolved into a single sampled copy when read.
+ */
+class OffscreenTarget {
+public:
+	OffscreenTarget() = default;
+	~OffscreenTarget();
+	OffscreenTarget(const OffscreenTarget&) = delete;
+	OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+	// Returns false if the driver won't take the size or sample count.
+	bool create(int width, int height, int samples);
+
+	// Binds it for drawing and sets the viewport to cover it.
+	void bind();
+
+	// RGBA, bottom row first like glReadPixels. Leaves framebuffer 0 bound.
+	void read(Image& image);
+
+	int width() const { return width_; }
+	int height() const { return height_; }
+
+private:
+	int width_ = 0;
+	int height_ = 0;
+	GLuint framebuffer_ = 0;
+	GLuint renderbuffers_[2] = {0, 0};
+	GLuint resolve_framebuffer_ = 0;
+	GLuint resolve_color_ = 0;
+};
+
+#endif
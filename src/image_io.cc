@@ -0,0 +1,98 @@
+#include "image_io.h"
+#include "cache.h"
+#include "profiler.h"
+
+#include <stdio.h>
+#include <cctype>
+#include <cstdint>
+#include <vector>
+#include <jpegio.h>
+#include <zlib.h>
+
+namespace {
+
+std::string extension(const std::string& path)
+{
+	size_t dot = path.rfind('.');
+	if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+		return "";
+	std::string extension = path.substr(dot + 1);
+	for (char& c : extension)
+		c = tolower(c);
+	return extension;
+}
+
+void put32(std::vector<unsigned char>& out, uint32_t value)
+{
+	out.push_back(value >> 24);
+	out.push_back(value >> 16);
+	out.push_back(value >> 8);
+	out.push_back(value);
+}
+
+void putChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size)
+{
+	put32(out, size);
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + size);
+	put32(out, crc32(0, &out[start], out.size() - start));
+}
+
+// 8-bit RGB, every row Sub filtered: flat NPR shading then compresses
+// well even at zlib's fastest level.
+bool savePNG(const std::string& path, const Image& image)
+{
+	size_t row_size = size_t(image.width) * 3 + 1;
+	std::vector<unsigned char> rows(row_size * image.height);
+	for (int y = 0; y < image.height; y++) {
+		unsigned char* row = &rows[row_size * y];
+		const unsigned char* in = &image.pixels[size_t(image.height - 1 - y) * image.width * 4];
+		row[0] = 1;
+		for (int x = 0; x < image.width; x++)
+			for (int c = 0; c < 3; c++)
+				row[1 + x * 3 + c] = in[x * 4 + c] - (x > 0 ? in[(x - 1) * 4 + c] : 0);
+	}
+	uLongf compressed_size = compressBound(rows.size());
+	std::vector<unsigned char> compressed(compressed_size);
+	if (compress2(compressed.data(), &compressed_size, rows.data(), rows.size(), Z_BEST_SPEED) != Z_OK) {
+		printf("Cannot compress %s\n", path.c_str());
+		return false;
+	}
+
+	static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	std::vector<unsigned char> file(signature, signature + sizeof(signature));
+	std::vector<unsigned char> header;
+	put32(header, image.width);
+	put32(header, image.height);
+	header.insert(header.end(), { 8, 2, 0, 0, 0 });  // depth, RGB, deflate, filters, progressive
+	putChunk(file, "IHDR", header.data(), header.size());
+	putChunk(file, "IDAT", compressed.data(), compressed_size);
+	putChunk(file, "IEND", nullptr, 0);
+	return writeFileAtomic(path, file.data(), file.size());
+}
+
+}
+
+bool saveImage(const std::string& path, const Image& image)
+{
+	PROFILE_ZONE("saveImage");
+	std::string type = extension(path);
+	if (type == "bmp")
+		return saveBMP(path, image);
+	if (type == "jpg" || type == "jpeg") {
+		// SaveJPEG takes RGB the way glReadPixels returns it.
+		std::vector<unsigned char> rgb(size_t(image.width) * image.height * 3);
+		for (size_t i = 0, j = 0; j < rgb.size(); i += 4, j += 3) {
+			rgb[j] = image.pixels[i];
+			rgb[j + 1] = image.pixels[i + 1];
+			rgb[j + 2] = image.pixels[i + 2];
+		}
+		SaveJPEG(path, image.width, image.height, rgb.data());
+		return true;
+	}
+	if (type == "png")
+		return savePNG(path, image);
+	printf("Don't know how to write %s, use .bmp, .jpg or .png\n", path.c_str());
+	return false;
+}
@@ -0,0 +1,13 @@
+#ifndef NPR_IMAGE_IO_H
+#define NPR_IMAGE_IO_H
+
+#include "texture.h"
+
+#include <string>
+
+// Writes an RGBA image, bottom row first as read back from GL, in the
+// format its extension names: .bmp, .jpg/.jpeg or .png (alpha dropped
+// from the last two). Needs no GL context.
+bool saveImage(const std::string& path, const Image& image);
+
+#endif
@@ -0,0 +1,478 @@
+#include "lod.h"
+#include "config.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Symmetric 4x4 quadric, stored as its ten unique coefficients plus the
+// total plane weight so errors can be turned back into distances.
+struct Quadric {
+	double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+	double a11 = 0, a12 = 0, a13 = 0;
+	double a22 = 0, a23 = 0;
+	double a33 = 0;
+	double weight = 0;
+
+	void addPlane(const glm::dvec3& n, double d, double w)
+	{
+		a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+		a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+		a22 += w * n.z * n.z; a23 += w * n.z * d;
+		a33 += w * d * d;
+		weight += w;
+	}
+
+	void add(const Quadric& q)
+	{
+		a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+		a11 += q.a11; a12 += q.a12; a13 += q.a13;
+		a22 += q.a22; a23 += q.a23;
+		a33 += q.a33;
+		weight += q.weight;
+	}
+
+	double evaluate(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double e = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+		         + a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+		         + a22 * z * z + 2.0 * a23 * z
+		         + a33;
+		return std::max(e, 0.0);
+	}
+};
+
+struct Collapse {
+	double cost;
+	unsigned int from, to;
+	unsigned int from_stamp, to_stamp;
+
+	bool operator<(const Collapse& other) const { return cost > other.cost; }
+};
+
+// Border edges keep their shape by adding planes perpendicular to the
+// face along the edge, weighted well above the face planes.
+const double kBorderWeight = 10.0;
+// Reject collapses that rotate a surviving face by more than ~80 degrees.
+const double kFlipThreshold = 0.2;
+
+class Simplifier {
+public:
+	Simplifier(const Mesh& mesh, const LODLevel& base);
+
+	// Collapses edges until at most target triangles are left, or until no
+	// legal collapse remains.
+	void reduce(size_t target);
+	void emit(std::vector<unsigned int>& indices) const;
+
+	size_t triangleCount() const { return live_triangles_; }
+	// Largest collapse error so far, in model units.
+	double maxError() const { return max_error_; }
+
+private:
+	unsigned int posOf(unsigned int corner) const { return vertex_pos_[triangles_[corner]]; }
+	void pushEdges(unsigned int pos);
+	void rebuildQueue();
+	bool tryCollapse(unsigned int u, unsigned int v);
+	void neighbours(unsigned int pos, std::vector<unsigned int>& out) const;
+	double cost(unsigned int u, unsigned int v) const;
+
+	std::vector<glm::vec3> positions_;
+	std::vector<unsigned int> vertex_pos_;
+	std::vector<std::vector<unsigned int>> wedges_;
+	std::vector<std::vector<unsigned int>> pos_tris_;
+	std::vector<Quadric> quadrics_;
+	std::vector<unsigned int> stamp_;
+	std::vector<bool> pos_alive_;
+	std::vector<bool> border_;
+
+	std::vector<unsigned int> triangles_;
+	std::vector<bool> tri_alive_;
+	size_t live_triangles_ = 0;
+	double max_error_ = 0.0;
+
+	std::priority_queue<Collapse> queue_;
+	std::vector<unsigned int> scratch_u_, scratch_v_;
+};
+
+struct PositionHash {
+	size_t operator()(const glm::vec3& p) const
+	{
+		unsigned int bits[3];
+		memcpy(bits, &p, sizeof(bits));
+		return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+	}
+};
+
+struct PositionEqual {
+	bool operator()(const glm::vec3& a, const glm::vec3& b) const
+	{
+		return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+	}
+};
+
+Simplifier::Simplifier(const Mesh& mesh, const LODLevel& base)
+{
+	// Group attribute vertices sharing a position: those groups are what
+	// gets collapsed, the individual vertices are the wedges on each side
+	// of a seam.
+	std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> lookup;
+	lookup.reserve(mesh.vertices.size());
+	vertex_pos_.resize(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); i++) {
+		auto found = lookup.emplace(mesh.vertices[i], (unsigned int)positions_.size());
+		if (found.second) {
+			positions_.push_back(mesh.vertices[i]);
+			wedges_.emplace_back();
+		}
+		vertex_pos_[i] = found.first->second;
+		wedges_[found.first->second].push_back(i);
+	}
+
+	size_t num_positions = positions_.size();
+	pos_tris_.resize(num_positions);
+	quadrics_.resize(num_positions);
+	stamp_.assign(num_positions, 0);
+	pos_alive_.assign(num_positions, true);
+	border_.assign(num_positions, false);
+
+	triangles_.assign(mesh.indices.begin() + base.index_offset,
+	                  mesh.indices.begin() + base.index_offset + base.index_count);
+	size_t num_triangles = triangles_.size() / 3;
+	tri_alive_.assign(num_triangles, true);
+	live_triangles_ = num_triangles;
+
+	// Count position-level edges to find borders; attribute seams must not
+	// look like holes here.
+	std::unordered_map<unsigned long long, int> edge_count;
+	edge_count.reserve(num_triangles * 3);
+	for (size_t t = 0; t < num_triangles; t++) {
+		for (int k = 0; k < 3; k++) {
+			unsigned int a = posOf(3 * t + k);
+			unsigned int b = posOf(3 * t + (k + 1) % 3);
+			unsigned long long key = ((unsigned long long)std::min(a, b) << 32) | std::max(a, b);
+			edge_count[key]++;
+		}
+	}
+
+	for (size_t t = 0; t < num_triangles; t++) {
+		unsigned int p[3] = { posOf(3 * t), posOf(3 * t + 1), posOf(3 * t + 2) };
+		if (p[0] == p[1] || p[1] == p[2] || p[0] == p[2]) {
+			tri_alive_[t] = false;
+			live_triangles_--;
+			continue;
+		}
+		glm::dvec3 a(positions_[p[0]]), b(positions_[p[1]]), c(positions_[p[2]]);
+		glm::dvec3 n = glm::cross(b - a, c - a);
+		double area2 = glm::length(n);
+		if (area2 > 0.0)
+			n = n / area2;
+		double d = -glm::dot(n, a);
+		for (int k = 0; k < 3; k++) {
+			quadrics_[p[k]].addPlane(n, d, 0.5 * area2);
+			pos_tris_[p[k]].push_back(t);
+		}
+
+		for (int k = 0; k < 3; k++) {
+			unsigned int e0 = p[k], e1 = p[(k + 1) % 3];
+			unsigned long long key = ((unsigned long long)std::min(e0, e1) << 32) | std::max(e0, e1);
+			if (edge_count[key] != 1)
+				continue;
+			glm::dvec3 x0(positions_[e0]), x1(positions_[e1]);
+			glm::dvec3 edge = x1 - x0;
+			glm::dvec3 side = glm::cross(edge, n);
+			double len = glm::length(side);
+			if (len <= 0.0)
+				continue;
+			side = side / len;
+			double w = kBorderWeight * glm::dot(edge, edge);
+			quadrics_[e0].addPlane(side, -glm::dot(side, x0), w);
+			quadrics_[e1].addPlane(side, -glm::dot(side, x0), w);
+			border_[e0] = border_[e1] = true;
+		}
+	}
+
+	rebuildQueue();
+}
+
+double Simplifier::cost(unsigned int u, unsigned int v) const
+{
+	Quadric q = quadrics_[u];
+	q.add(quadrics_[v]);
+	return q.evaluate(positions_[v]);
+}
+
+void Simplifier::neighbours(unsigned int pos, std::vector<unsigned int>& out) const
+{
+	out.clear();
+	for (unsigned int t : pos_tris_[pos]) {
+		if (!tri_alive_[t])
+			continue;
+		for (int k = 0; k < 3; k++) {
+			unsigned int p = posOf(3 * t + k);
+			if (p != pos)
+				out.push_back(p);
+		}
+	}
+	std::sort(out.begin(), out.end());
+	out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+void Simplifier::pushEdges(unsigned int pos)
+{
+	std::vector<unsigned int> around;
+	neighbours(pos, around);
+	for (unsigned int other : around) {
+		queue_.push({ cost(pos, other), pos, other, stamp_[pos], stamp_[other] });
+		queue_.push({ cost(other, pos), other, pos, stamp_[other], stamp_[pos] });
+	}
+}
+
+void Simplifier::rebuildQueue()
+{
+	queue_ = std::priority_queue<Collapse>();
+	for (size_t t = 0; t < tri_alive_.size(); t++) {
+		if (!tri_alive_[t])
+			continue;
+		for (int k = 0; k < 3; k++) {
+			unsigned int a = posOf(3 * t + k);
+			unsigned int b = posOf(3 * t + (k + 1) % 3);
+			queue_.push({ cost(a, b), a, b, stamp_[a], stamp_[b] });
+			queue_.push({ cost(b, a), b, a, stamp_[b], stamp_[a] });
+		}
+	}
+}
+
+bool Simplifier::tryCollapse(unsigned int u, unsigned int v)
+{
+	// Triangles on the edge, and the link condition: u and v may only share
+	// the neighbours opposite that edge, otherwise the collapse pinches the
+	// surface into a non-manifold fin.
+	int shared = 0;
+	for (unsigned int t : pos_tris_[u]) {
+		if (!tri_alive_[t])
+			continue;
+		for (int k = 0; k < 3; k++)
+			if (posOf(3 * t + k) == v)
+				shared++;
+	}
+	if (shared == 0)
+		return false;
+	if (border_[u] && shared != 1)
+		return false;
+
+	neighbours(u, scratch_u_);
+	neighbours(v, scratch_v_);
+	int common = 0;
+	for (size_t i = 0, j = 0; i < scratch_u_.size() && j < scratch_v_.size();) {
+		if (scratch_u_[i] < scratch_v_[j]) {
+			i++;
+		} else if (scratch_v_[j] < scratch_u_[i]) {
+			j++;
+		} else {
+			common++;
+			i++;
+			j++;
+		}
+	}
+	if (common > shared)
+		return false;
+
+	// Every wedge of u in use must slide onto a distinct wedge of v that it
+	// already shares a triangle with. That keeps UV and normal seams on
+	// themselves and stops a vertex off a seam from being merged across it.
+	std::vector<std::pair<unsigned int, unsigned int>> remap;
+	for (unsigned int wedge : wedges_[u]) {
+		unsigned int target = ~0u;
+		bool used = false;
+		for (unsigned int t : pos_tris_[u]) {
+			if (!tri_alive_[t])
+				continue;
+			const unsigned int* tri = &triangles_[3 * t];
+			if (tri[0] != wedge && tri[1] != wedge && tri[2] != wedge)
+				continue;
+			used = true;
+			for (int k = 0; k < 3; k++) {
+				if (vertex_pos_[tri[k]] == v) {
+					target = tri[k];
+					break;
+				}
+			}
+			if (target != ~0u)
+				break;
+		}
+		if (!used)
+			continue;
+		if (target == ~0u)
+			return false;
+		for (const auto& entry : remap)
+			if (entry.second == target)
+				return false;
+		remap.emplace_back(wedge, target);
+	}
+
+	// Surviving faces must not flip or degenerate once u moves onto v.
+	const glm::vec3& target_position = positions_[v];
+	for (unsigned int t : pos_tris_[u]) {
+		if (!tri_alive_[t])
+			continue;
+		glm::vec3 p[3];
+		bool has_v = false;
+		int moved = -1;
+		for (int k = 0; k < 3; k++) {
+			unsigned int pos = posOf(3 * t + k);
+			p[k] = positions_[pos];
+			if (pos == v)
+				has_v = true;
+			if (pos == u)
+				moved = k;
+		}
+		if (has_v)
+			continue;
+		glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+		p[moved] = target_position;
+		glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+		float len_before = glm::length(before), len_after = glm::length(after);
+		if (len_after <= 0.0f || glm::dot(before, after) < kFlipThreshold * len_before * len_after)
+			return false;
+	}
+
+	// Commit: rewrite corners, drop the faces on the edge, merge quadrics.
+	for (unsigned int t : pos_tris_[u]) {
+		if (!tri_alive_[t])
+			continue;
+		unsigned int* tri = &triangles_[3 * t];
+		for (int k = 0; k < 3; k++) {
+			if (vertex_pos_[tri[k]] != u)
+				continue;
+			for (const auto& entry : remap)
+				if (entry.first == tri[k])
+					tri[k] = entry.second;
+		}
+		if (vertex_pos_[tri[0]] == vertex_pos_[tri[1]] ||
+		    vertex_pos_[tri[1]] == vertex_pos_[tri[2]] ||
+		    vertex_pos_[tri[0]] == vertex_pos_[tri[2]]) {
+			tri_alive_[t] = false;
+			live_triangles_--;
+		} else {
+			pos_tris_[v].push_back(t);
+		}
+	}
+	pos_tris_[u].clear();
+	pos_alive_[u] = false;
+
+	double error = cost(u, v);
+	quadrics_[v].add(quadrics_[u]);
+	if (quadrics_[v].weight > 0.0)
+		max_error_ = std::max(max_error_, std::sqrt(error / quadrics_[v].weight));
+	stamp_[v]++;
+
+	// Compact v's face list now and then so it does not fill with dead ids.
+	std::vector<unsigned int>& faces = pos_tris_[v];
+	if (faces.size() > 32) {
+		faces.erase(std::remove_if(faces.begin(), faces.end(),
+		            [this](unsigned int t) { return !tri_alive_[t]; }), faces.end());
+	}
+	return true;
+}
+
+void Simplifier::reduce(size_t target)
+{
+	bool progressed = true;
+	while (live_triangles_ > target) {
+		if (queue_.empty()) {
+			// Collapses rejected earlier may have become legal since; give
+			// them one more pass, and stop if nothing moves.
+			if (!progressed)
+				break;
+			progressed = false;
+			rebuildQueue();
+			continue;
+		}
+		Collapse collapse = queue_.top();
+		queue_.pop();
+		if (!pos_alive_[collapse.from] || !pos_alive_[collapse.to])
+			continue;
+		if (collapse.from_stamp != stamp_[collapse.from] || collapse.to_stamp != stamp_[collapse.to])
+			continue;
+		if (tryCollapse(collapse.from, collapse.to)) {
+			progressed = true;
+			pushEdges(collapse.to);
+		}
+	}
+}
+
+void Simplifier::emit(std::vector<unsigned int>& indices) const
+{
+	for (size_t t = 0; t < tri_alive_.size(); t++) {
+		if (!tri_alive_[t])
+			continue;
+		indices.push_back(triangles_[3 * t]);
+		indices.push_back(triangles_[3 * t + 1]);
+		indices.push_back(triangles_[3 * t + 2]);
+	}
+}
+
+}
+
+void buildLODChain(Mesh& mesh, int num_levels)
+{
+	PROFILE_ZONE("buildLODChain");
+	if (mesh.lods.empty() || mesh.bounds_radius <= 0.0f)
+		return;
+	mesh.lods.resize(1);
+	mesh.indices.resize(mesh.lods[0].index_offset + mesh.lods[0].index_count);
+
+	Simplifier simplifier(mesh, mesh.lods[0]);
+	size_t previous = simplifier.triangleCount();
+	for (int level = 1; level < num_levels; level++) {
+		simplifier.reduce(previous / 2);
+		size_t remaining = simplifier.triangleCount();
+		// Not worth a level if seams and borders pinned most of the mesh.
+		if (remaining == 0 || remaining > previous * 9 / 10)
+			break;
+
+		LODLevel lod;
+		lod.index_offset = mesh.indices.size();
+		simplifier.emit(mesh.indices);
+		lod.index_count = mesh.indices.size() - lod.index_offset;
+		lod.error = simplifier.maxError() / mesh.bounds_radius;
+		mesh.lods.push_back(lod);
+		previous = remaining;
+	}
+}
+
+float projectedRadius(const Mesh& mesh, const glm::mat4& model_view, int viewport_height)
+{
+	glm::vec4 center = model_view * glm::vec4(mesh.bounds_center, 1.0f);
+	float scale = glm::length(glm::vec3(model_view[0]));
+	float radius = mesh.bounds_radius * scale;
+	float distance = glm::length(glm::vec3(center));
+	if (distance <= radius)
+		return (float)viewport_height;
+	float half_fov = (float)(kFov * (M_PI / 180.0f)) * 0.5f;
+	return radius / (distance * std::tan(half_fov)) * 0.5f * viewport_height;
+}
+
+int LODSelector::select(const Mesh& mesh, float radius_pixels)
+{
+	int num_levels = mesh.lods.size();
+	int level = std::min(current_, num_levels - 1);
+	if (level < 0)
+		return current_ = 0;
+
+	auto pixelError = [&](int l) { return mesh.lods[l].error * radius_pixels; };
+	while (level > 0 && pixelError(level) > kLODPixelError * (1.0f + kLODHysteresis))
+		level--;
+	while (level + 1 < num_levels && pixelError(level + 1) < kLODPixelError * (1.0f - kLODHysteresis))
+		level++;
+	current_ = level;
+	return level;
+}
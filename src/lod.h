@@ -0,0 +1,39 @@
+#ifndef NPR_LOD_H
+#define NPR_LOD_H
+
+#include "mesh.h"
+
+#include <glm/glm.hpp>
+
+/*
+ * Quadric error metric simplification (Garland & Heckbert) restricted to
+ * half-edge collapses: a vertex is always merged onto one of its
+ * neighbours, so every level indexes the original vertex buffer and UV
+ * or normal seams are only ever collapsed along themselves.
+ *
+ * Appends up to num_levels - 1 coarser levels to mesh.lods, each with
+ * roughly half the triangles of the previous one. Stops early if the
+ * mesh cannot be reduced any further without breaking seams or borders.
+ */
+void buildLODChain(Mesh& mesh, int num_levels);
+
+// Radius in pixels of the mesh bounding sphere on a viewport of the given
+// height, using the kFov perspective from config.h.
+float projectedRadius(const Mesh& mesh, const glm::mat4& model_view, int viewport_height);
+
+/*
+ * Picks the coarsest level whose error, projected through the bounding
+ * sphere, stays under a pixel tolerance. The current level only changes
+ * once the error crosses the tolerance by the hysteresis margin, so the
+ * mesh does not pop back and forth at a boundary.
+ */
+class LODSelector {
+public:
+	int select(const Mesh& mesh, float radius_pixels);
+	int current() const { return current_; }
+
+private:
+	int current_ = 0;
+};
+
+#endif
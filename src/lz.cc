@@ -0,0 +1,144 @@
+#include "lz.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const int kMinMatch = 4;
+const int kHashBits = 16;
+const size_t kMaxOffset = 65535;
+// Matches don't start this close to the end; the tail goes out as literals.
+const size_t kTailLiterals = 12;
+
+uint32_t read32(const unsigned char* p)
+{
+	uint32_t value;
+	memcpy(&value, p, 4);
+	return value;
+}
+
+unsigned char* writeLength(unsigned char* out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		*out++ = 255;
+	*out++ = (unsigned char)length;
+	return out;
+}
+
+unsigned char* writeSequence(unsigned char* out, const unsigned char* literals, size_t literal_length,
+                             size_t offset, size_t match_length)
+{
+	unsigned char* token = out++;
+	*token = (unsigned char)((literal_length < 15 ? literal_length : 15) << 4);
+	if (literal_length >= 15)
+		out = writeLength(out, literal_length - 15);
+	memcpy(out, literals, literal_length);
+	out += literal_length;
+	if (match_length == 0)
+		return out;
+
+	out[0] = offset & 0xFF;
+	out[1] = offset >> 8;
+	out += 2;
+	size_t extra = match_length - kMinMatch;
+	*token |= (unsigned char)(extra < 15 ? extra : 15);
+	if (extra >= 15)
+		out = writeLength(out, extra - 15);
+	return out;
+}
+
+// Reads a 255-run length extension; false if it runs off the input.
+bool readLength(const unsigned char*& in, const unsigned char* end, size_t& length)
+{
+	unsigned char byte;
+	do {
+		if (in >= end)
+			return false;
+		byte = *in++;
+		length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+}
+
+size_t lzCompressBound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t lzCompress(const unsigned char* in, size_t size, unsigned char* out)
+{
+	unsigned char* op = out;
+	size_t anchor = 0;
+	if (size > kTailLiterals) {
+		std::vector<int64_t> table(size_t(1) << kHashBits, -1);
+		size_t limit = size - kTailLiterals;
+		size_t misses = 0;
+		for (size_t ip = 0; ip < limit;) {
+			uint32_t sequence = read32(in + ip);
+			uint32_t hash = (sequence * 2654435761u) >> (32 - kHashBits);
+			int64_t ref = table[hash];
+			table[hash] = ip;
+			if (ref < 0 || ip - ref > kMaxOffset || read32(in + ref) != sequence) {
+				// Skip faster through data that doesn't compress.
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+			size_t length = kMinMatch;
+			while (ip + length < limit && in[ref + length] == in[ip + length])
+				length++;
+			op = writeSequence(op, in + anchor, ip - anchor, ip - ref, length);
+			ip += length;
+			anchor = ip;
+			table[(read32(in + ip - 2) * 2654435761u) >> (32 - kHashBits)] = ip - 2;
+		}
+	}
+	op = writeSequence(op, in + anchor, size - anchor, 0, 0);
+	return op - out;
+}
+
+bool lzDecompress(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size)
+{
+	const unsigned char* ip = in;
+	const unsigned char* end = in + in_size;
+	size_t op = 0;
+	while (ip < end) {
+		unsigned char token = *ip++;
+		size_t literal_length = token >> 4;
+		if (literal_length == 15 && !readLength(ip, end, literal_length))
+			return false;
+		if (literal_length > size_t(end - ip) || literal_length > out_size - op)
+			return false;
+		memcpy(out + op, ip, literal_length);
+		ip += literal_length;
+		op += literal_length;
+		if (ip == end)
+			break;
+
+		if (end - ip < 2)
+			return false;
+		size_t offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		size_t match_length = token & 15;
+		if (match_length == 15 && !readLength(ip, end, match_length))
+			return false;
+		match_length += kMinMatch;
+		if (offset == 0 || offset > op || match_length > out_size - op)
+			return false;
+		unsigned char* dst = out + op;
+		const unsigned char* src = dst - offset;
+		if (offset >= match_length) {
+			memcpy(dst, src, match_length);
+		} else {
+			// Overlapping copy repeats the last offset bytes.
+			for (size_t i = 0; i < match_length; i++)
+				dst[i] = src[i];
+		}
+		op += match_length;
+	}
+	return op == out_size;
+}
@@ -0,0 +1,22 @@
+#ifndef NPR_LZ_H
+#define NPR_LZ_H
+
+#include <cstddef>
+
+/*
+ * Byte-oriented LZ77 codec in the style of LZ4: a token with literal and
+ * match lengths, the literals, then a 16-bit match offset. Compression is
+ * a single greedy pass over a hash of the next four bytes; decompression
+ * is a tight copy loop with every read and write bounds checked.
+ */
+
+// Worst case compressed size for size input bytes.
+size_t lzCompressBound(size_t size);
+
+// Returns the compressed size; out must hold lzCompressBound(size) bytes.
+size_t lzCompress(const unsigned char* in, size_t size, unsigned char* out);
+
+// Fails on corrupt input or if it doesn't expand to exactly out_size bytes.
+bool lzDecompress(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size);
+
+#endif
@@ -1,16 +1,40 @@
 #include <GL/glew.h>
-#include <dirent.h>
 
+#include "asset.h"
+#include "batch.h"
+#include "browser.h"
+#include "cache.h"
+#include "capture.h"
 #include "config.h"
+#include "edge_outline.h"
+#include "frame_export.h"
+#include "gl_debug.h"
+#include "gl_state.h"
+#include "gpu_timer.h"
 #include "gui.h"
+#include "headless.h"
+#include "image_io.h"
+#include "lod.h"
+#include "model.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "scene.h"
+#include "shader.h"
+#include "tam.h"
+#include "texture.h"
+#include "uniforms.h"
+#include "watch.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 
 #include <stdio.h>
 #include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <cstring>
 #include <vector>
@@ -22,7 +46,6 @@
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/io.hpp>
 #include <glm/glm.hpp>
-#include <debuggl.h>
 
 int window_width = 1200, window_height = 900;
 const std::string window_title = "non-photorealistic rendering";
@@ -53,6 +76,7 @@ void ErrorCallback(int error, const char* description) {
 
 GLFWwindow* init_glefw()
 {
+	PROFILE_ZONE("init_glefw");
 	if (!glfwInit())
 		exit(EXIT_FAILURE);
 	glfwSetErrorCallback(ErrorCallback);
@@ -61,6 +85,10 @@ GLFWwindow* init_glefw()
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_SAMPLES, 4);
+#ifdef NPR_GL_DEBUG
+	// Drivers only promise to say much through KHR_debug in a debug context.
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
 	auto ret = glfwCreateWindow(window_width, window_height, window_title.data(), nullptr, nullptr);
 	CHECK_SUCCESS(ret != nullptr);
 	glfwMakeContextCurrent(ret);
@@ -76,377 +104,405 @@ GLFWwindow* init_glefw()
 	return ret;
 }
 
-bool loadOBJ(
-	const char * path, 
-	std::vector<glm::vec3> & out_vertices, 
-	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
-){
-	printf("Loading OBJ file %s...\n", path);
-
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices; 
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
-
-
-	FILE * file = fopen(path, "r");
-	if( file == NULL ){
-		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-		getchar();
-		return false;
-	}
-
-	while( 1 ){
-
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
-
-		// else : parse lineHeader
-		
-		if (strcmp( lineHeader, "v" ) == 0){
-			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-			temp_vertices.push_back(vertex);
-		} else if (strcmp( lineHeader, "vt" ) == 0){
-			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y );
-			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-			temp_uvs.push_back(uv);
-		} else if ( strcmp( lineHeader, "vn" ) == 0 ){
-			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-			temp_normals.push_back(normal);
-		} else if ( strcmp( lineHeader, "f" ) == 0 ){
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
-			if (matches != 9){
-				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				fclose(file);
-				return false;
+int main(int argc, char* argv[])
+{
+	// Flags can go anywhere; what's left is the model and hatching texture.
+	TextureOptions texture_options;
+	std::vector<const char*> inputs;
+	std::vector<std::string> asset_directories;
+	bool program_cache = true;
+	bool synchronous_gl_debug = false;
+	std::string profile_path;
+	bool headless = false;
+	int headless_width = window_width, headless_height = window_height;
+	std::string output_path = "npr.bmp";
+	unsigned int headless_features = 0;
+	std::string batch_path;
+	std::string screenshot_format = "jpg";
+	CaptureOptions record_options;
+	record_options.prefix = "recording";
+	record_options.extension = "y4m";
+	record_options.encoders = std::max(int(workerCount()) - 1, 1);
+	record_options.announce = false;
+	bool record = false;
+	std::string export_name;
+	int batch_workers = 0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 18, "--texture-quality=") == 0) {
+			if (!parseTextureQuality(arg.substr(18), texture_options)) {
+				std::cerr << "Unknown texture quality " << arg.substr(18) << std::endl;
+				return -1;
+			}
+		} else if (arg.compare(0, 7, "--pack=") == 0) {
+			if (!mountAssetPack(arg.substr(7)))
+				return -1;
+		} else if (arg.compare(0, 9, "--assets=") == 0) {
+			asset_directories.push_back(arg.substr(9));
+		} else if (arg == "--no-program-cache") {
+			program_cache = false;
+		} else if (arg == "--sync-gl-debug") {
+			synchronous_gl_debug = true;
+		} else if (arg.compare(0, 10, "--profile=") == 0) {
+			profile_path = arg.substr(10);
+		} else if (arg == "--headless") {
+			headless = true;
+		} else if (arg.compare(0, 7, "--size=") == 0) {
+			if (sscanf(arg.c_str() + 7, "%dx%d", &headless_width, &headless_height) != 2) {
+				std::cerr << "Bad size " << arg.substr(7) << ", expected WIDTHxHEIGHT" << std::endl;
+				return -1;
 			}
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			uvIndices    .push_back(uvIndex[0]);
-			uvIndices    .push_back(uvIndex[1]);
-			uvIndices    .push_back(uvIndex[2]);
-			normalIndices.push_back(normalIndex[0]);
-			normalIndices.push_back(normalIndex[1]);
-			normalIndices.push_back(normalIndex[2]);
-		} else{
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
+		} else if (arg.compare(0, 9, "--output=") == 0) {
+			output_path = arg.substr(9);
+		} else if (arg.compare(0, 8, "--style=") == 0) {
+			if (!parseShaderFeatures(arg.substr(8), headless_features))
+				return -1;
+		} else if (arg.compare(0, 20, "--screenshot-format=") == 0) {
+			screenshot_format = arg.substr(20);
+			if (screenshot_format != "jpg" && screenshot_format != "png" && screenshot_format != "bmp") {
+				std::cerr << "Unknown screenshot format " << screenshot_format << std::endl;
+				return -1;
+			}
+		} else if (arg.compare(0, 9, "--record=") == 0) {
+			std::string path = arg.substr(9);
+			size_t dot = path.rfind('.');
+			std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+			if (extension != "y4m" && extension != "png" && extension != "jpg" && extension != "bmp") {
+				std::cerr << "Recording " << path << " needs an extension: .y4m, .png, .jpg or .bmp" << std::endl;
+				return -1;
+			}
+			record_options.prefix = path.substr(0, dot);
+			record_options.extension = extension;
+			record = true;
+		} else if (arg == "--record-policy=drop" || arg == "--record-policy=queue") {
+			record_options.policy = arg == "--record-policy=drop" ? CapturePolicy::Drop : CapturePolicy::Queue;
+		} else if (arg.compare(0, 9, "--export=") == 0) {
+			export_name = arg.substr(9);
+		} else if (arg.compare(0, 8, "--batch=") == 0) {
+			batch_path = arg.substr(8);
+		} else if (arg.compare(0, 10, "--workers=") == 0) {
+			batch_workers = atoi(arg.c_str() + 10);
+		} else {
+			inputs.push_back(argv[i]);
 		}
 	}
-
-	// For each vertex of each triangle
-	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertexIndices[i];
-		unsigned int uvIndex = uvIndices[i];
-		unsigned int normalIndex = normalIndices[i];
-		
-		// Get the attributes thanks to the index
-		glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-		glm::vec2 uv = temp_uvs[ uvIndex-1 ];
-		glm::vec3 normal = temp_normals[ normalIndex-1 ];
-		
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_uvs     .push_back(uv);
-		out_normals .push_back(normal);
-	}
-	fclose(file);
-	return true;
-}
-
-unsigned char * loadBMP(const char * imagepath, unsigned int& width, unsigned int& height){
-
-	printf("Reading image %s\n", imagepath);
-
-	// Data read from the header of the BMP file
-	unsigned char header[54];
-	unsigned int dataPos;
-	unsigned int imageSize;
-
-	// Actual RGB data
-	unsigned char * data;
-
-	// Open the file
-	FILE * file = fopen(imagepath,"rb");
-	if (!file){
-		printf("%s could not be opened.\n", imagepath);
-		getchar();
-		return 0;
-	}
-
-	// Read the header, i.e. the 54 first bytes
-
-	// If less than 54 bytes are read, problem
-	if ( fread(header, 1, 54, file)!=54 ){ 
-		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
-	}
-	// A BMP files always begins with "BM"
-	if ( header[0]!='B' || header[1]!='M' ){
-		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
+	// --batch forks its workers before anything has a context or threads.
+	if (!batch_path.empty()) {
+		BatchOptions options;
+		options.workers = batch_workers;
+		options.texture_options = texture_options;
+		options.program_cache = program_cache;
+		options.vertex_source = vertex_shader;
+		options.fragment_source = fragment_shader;
+		options.geometry_source = geometry_shader;
+		options.profile_path = profile_path;
+		return runBatch(batch_path, options);
 	}
-	// Make sure this is a 24bpp file
-	if ( *(int*)&(header[0x1E])!=0  )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
-	if ( *(int*)&(header[0x1C])!=24 )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
-
-	// Read the information about the image
-	dataPos    = *(int*)&(header[0x0A]);
-	imageSize  = *(int*)&(header[0x22]);
-	width      = *(int*)&(header[0x12]);
-	height     = *(int*)&(header[0x16]);
-
-	// Some BMP files are misformatted, guess missing information
-	if (imageSize==0)    imageSize=width*height*3; // 3 : one byte for each Red, Green and Blue component
-	if (dataPos==0) dataPos=54; // The BMP header is done that way
-	
-	// Create a buffer
-	data = new unsigned char [imageSize];
-
-	// Read the actual data from the file into the buffer
-	fread(data,1,imageSize,file);
-
-	// Everything is in memory now, the file can be closed.
-	fclose (file);
-	return data;
-}
-
-int main(int argc, char* argv[])
-{
-	if (argc < 2) {
+	if (inputs.size() < 1) {
 		std::cerr << "Input model file is missing" << std::endl;
-		std::cerr << "Usage: " << argv[0] << " <PMD file>" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " [--texture-quality=none|fast|normal|high] [--pack=assets.pack] [--assets=dir] [--no-program-cache] [--sync-gl-debug] [--profile=trace.json] [--screenshot-format=jpg|png|bmp] [--record=frames.y4m|png|jpg [--record-policy=drop|queue]] [--export=shm-name] [--headless [--size=WxH] [--output=image.bmp|jpg] [--style=cel,gooch,hatch,...,outline|edges|silhouette]] [--batch=jobs.txt [--workers=N]] <PMD file> [hatching texture]" << std::endl;
 		return -1;
 	}
-	GLFWwindow *window = init_glefw();
-	GUI gui(window);
+	PROFILE_THREAD("main");
+	// --headless renders one image through EGL; nothing below that needs a
+	// window runs.
+	GLFWwindow *window = nullptr;
+	HeadlessContext headless_context;
+	if (headless) {
+		if (!headless_context.create())
+			return -1;
+	} else {
+		window = init_glefw();
+	}
+	setupGLDebugOutput(synchronous_gl_debug);
+	// State changes go through glState() from here on.
+	glState().sync();
 
 	//dk what this is
 	GLuint VertexArrayID;
 	glGenVertexArrays(1, &VertexArrayID);
-	glBindVertexArray(VertexArrayID);
+	glState().bindVertexArray(VertexArrayID);
 
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals;
-	bool res = loadOBJ(argv[1], vertices, uvs, normals);
-
-	unsigned int width, height;
-	unsigned char * data = loadBMP(argv[2], width, height);
+	// Models load off the GL thread; the one on screen stays interactive
+	// until the next is ready to swap in.
+	std::unique_ptr<ModelData> model(new ModelData);
+	if (!loadModel(inputs[0], *model)) {
+		std::cerr << "Failed to load " << inputs[0] << std::endl;
+		return -1;
+	}
+	std::future<std::unique_ptr<ModelData>> next_model;
+	std::string next_model_path;
+	auto loadModelAsync = [&](const std::string& path) {
+		next_model_path = path;
+		next_model = std::async(std::launch::async, [path] {
+			PROFILE_THREAD("model loader");
+			std::unique_ptr<ModelData> loaded(new ModelData);
+			if (!loadModel(path, *loaded))
+				loaded.reset();
+			return loaded;
+		});
+	};
+	LODSelector lod_selector;
 
 	//load into VBOS
-	GLuint vertexbuffer;
-	glGenBuffers(1, &vertexbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-	GLuint uvbuffer;
-	glGenBuffers(1, &uvbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
-
-	GLuint normalbuffer;
-	glGenBuffers(1, &normalbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-
-	// Setup vertex shader.
-	GLuint vertex_shader_id = 0;
-	const char* vertex_source_pointer = vertex_shader;
-	CHECK_GL_ERROR(vertex_shader_id = glCreateShader(GL_VERTEX_SHADER));
-	CHECK_GL_ERROR(glShaderSource(vertex_shader_id, 1, &vertex_source_pointer, nullptr));
-	glCompileShader(vertex_shader_id);
-	CHECK_GL_SHADER_ERROR(vertex_shader_id);
-
-	// Setup fragment shader.
-	GLuint fragment_shader_id = 0;
-	const char* fragment_source_pointer = fragment_shader;
-	CHECK_GL_ERROR(fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER));
-	CHECK_GL_ERROR(glShaderSource(fragment_shader_id, 1, &fragment_source_pointer, nullptr));
-	glCompileShader(fragment_shader_id);
-	CHECK_GL_SHADER_ERROR(fragment_shader_id);
-
-	//load textures
-	GLuint texture = 0;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	//Let's create our program.
-	GLuint program_id = 0;
-	CHECK_GL_ERROR(program_id = glCreateProgram());
-	CHECK_GL_ERROR(glAttachShader(program_id, vertex_shader_id));
-	CHECK_GL_ERROR(glAttachShader(program_id, fragment_shader_id));
-	//CHECK_GL_ERROR(glAttachShader(program_id, geometry_shader_id));
-
-	// Bind attributes.
-	CHECK_GL_ERROR(glBindAttribLocation(program_id, 0, "vertex_position"));
-	CHECK_GL_ERROR(glBindAttribLocation(program_id, 1, "vertex_uv"));
-	CHECK_GL_ERROR(glBindAttribLocation(program_id, 2, "vertex_normal"));
-	CHECK_GL_ERROR(glBindFragDataLocation(program_id, 0, "fragment_color"));
-	glLinkProgram(program_id);
-	CHECK_GL_PROGRAM_ERROR(program_id);
-
-	// Get the uniform locations.
-	GLint projection_matrix_location = 0;
-	CHECK_GL_ERROR(projection_matrix_location =
-			glGetUniformLocation(program_id, "projection"));
-	GLint view_matrix_location = 0;
-	CHECK_GL_ERROR(view_matrix_location =
-			glGetUniformLocation(program_id, "view"));
-	GLint model_matrix_location = 0;
-	CHECK_GL_ERROR(model_matrix_location =
-			glGetUniformLocation(program_id, "model"));
-	GLint light_position_location = 0;
-	CHECK_GL_ERROR(light_position_location =
-			glGetUniformLocation(program_id, "light_position"));
-	GLint camera_position_location = 0;
-	CHECK_GL_ERROR(camera_position_location =
-			glGetUniformLocation(program_id, "camera_position"));
-
-	//color uniforms
-	GLint diffuse_color_location = 0;
-	CHECK_GL_ERROR(diffuse_color_location =
-			glGetUniformLocation(program_id, "diffuse_color"));
-	GLint ambient_color_location = 0;
-	CHECK_GL_ERROR(ambient_color_location =
-			glGetUniformLocation(program_id, "ambient_color"));
-	GLint specular_color_location = 0;
-	CHECK_GL_ERROR(specular_color_location =
-			glGetUniformLocation(program_id, "specular_color"));
-	GLint warm_color_location = 0;
-	CHECK_GL_ERROR(warm_color_location =
-			glGetUniformLocation(program_id, "warm_color"));
-	GLint cool_color_location = 0;
-	CHECK_GL_ERROR(cool_color_location =
-			glGetUniformLocation(program_id, "cool_color"));
-	GLint light_color_location = 0;
-	CHECK_GL_ERROR(light_color_location =
-			glGetUniformLocation(program_id, "light_color"));
-
-	//float/int uniforms
-	GLint warm_amount_location = 0;
-	CHECK_GL_ERROR(warm_amount_location =
-			glGetUniformLocation(program_id, "warm_amount"));
-	GLint cool_amount_location = 0;
-	CHECK_GL_ERROR(cool_amount_location =
-			glGetUniformLocation(program_id, "cool_amount"));
-	GLint num_colors_location = 0;
-	CHECK_GL_ERROR(num_colors_location =
-			glGetUniformLocation(program_id, "num_colors"));
-	GLint outline_size_location = 0;
-	CHECK_GL_ERROR(outline_size_location =
-			glGetUniformLocation(program_id, "outline_size"));
-	GLint shininess_location = 0;
-	CHECK_GL_ERROR(shininess_location =
-			glGetUniformLocation(program_id, "shininess"));
-	GLint ka_location = 0;
-	CHECK_GL_ERROR(ka_location =
-			glGetUniformLocation(program_id, "ka"));
-	GLint kd_location = 0;
-	CHECK_GL_ERROR(kd_location =
-			glGetUniformLocation(program_id, "kd"));
-	GLint ks_location = 0;
-	CHECK_GL_ERROR(ks_location =
-			glGetUniformLocation(program_id, "ks"));
-
-	//boolean uniforms 
-	GLint render_outline_location = 0;
-	CHECK_GL_ERROR(render_outline_location =
-			glGetUniformLocation(program_id, "render_outline"));
-	GLint cel_shade_location = 0;
-	CHECK_GL_ERROR(cel_shade_location =
-			glGetUniformLocation(program_id, "cel_shade"));
-	GLint gooch_shade_location = 0;
-	CHECK_GL_ERROR(gooch_shade_location =
-			glGetUniformLocation(program_id, "gooch_shade"));
-	GLint hatch_shade_location = 0;
-	CHECK_GL_ERROR(hatch_shade_location =
-			glGetUniformLocation(program_id, "hatch_shade"));
-	GLint on_white_location = 0;
-	CHECK_GL_ERROR(on_white_location =
-			glGetUniformLocation(program_id, "on_white"));
-	GLint on_flat_location = 0;
-	CHECK_GL_ERROR(on_flat_location =
-			glGetUniformLocation(program_id, "on_flat"));
-	GLint texture_hatch_location = 0;
-	CHECK_GL_ERROR(texture_hatch_location =
-			glGetUniformLocation(program_id, "texture_hatch"));
-
-	//texture uniform
-	GLint texture_location = 0;
-	CHECK_GL_ERROR(texture_location =
-			glGetUniformLocation(program_id, "hatching_texture"));
-
-	glm::vec4 light_position = glm::vec4(13.0f, 18.0f, 20.0f, 1.0f);
-	bool draw_outline = false;
+	SceneBuffers buffers;
+	createSceneBuffers(buffers);
+	uploadMesh(model->mesh, buffers.vertex, buffers.uv, buffers.normal, buffers.element);
+
+	//load textures, mipmapped and trilinear so hatching doesn't shimmer
+	if (!GLEW_EXT_texture_compression_s3tc)
+		texture_options.compress = false;
+	GLuint texture = inputs.size() > 1 ? loadTexture(inputs[1], texture_options) : 0;
+	std::future<std::unique_ptr<TextureData>> next_texture;
+
+	// Hatching strokes for every tone, generated rather than loaded.
+	TonalArtMap tonal_art_map;
+	buildTonalArtMap(kTAMSize, kTAMTones, tonal_art_map);
+	GLuint tam_texture = uploadTonalArtMap(tonal_art_map);
+
+	//Let's create our programs: one per style combination, built the first
+	// time it's drawn. The sources are the embedded copies until the files
+	// change on disk.
+	std::string vertex_path = shaderPath("default.vert");
+	std::string fragment_path = shaderPath("default.frag");
+	std::string geometry_path = shaderPath("default.geom");
+	std::string vertex_source = vertex_shader;
+	std::string fragment_source = fragment_shader;
+	std::string geometry_source = geometry_shader;
+	ProgramCache programs(program_cache);
+	CHECK_SUCCESS(programs.setSources(vertex_source, fragment_source, geometry_source));
+
+	// Everything but the samplers lives in three uniform blocks, sent only
+	// when they change.
+	UniformBuffer uniform_buffer;
+	uniform_buffer.create();
+
 	bool outline_hold = false;
+	// The inverted hull, edges found in screen space, or silhouette lines
+	// from the geometry shader.
+	int outline_mode = 0;
 	bool cel_shaded = false;
 	bool gooch_shaded = false;
 	bool hatch_shaded = false;
 	bool on_white = false;
 	bool on_flat = false;
 	bool texture_hatch = false;
+	bool auto_lod = true;
+	int manual_lod = 0;
+	int outline_lod_bias = 1;
+	bool meshlet_culling = true;
+
+	FrameBlock frame;
+	MaterialBlock material;
+	StyleBlock style;
+	glm::vec4 background_color;
+	defaultLook(frame, material, style, background_color);
+	style.tam_tones = tonal_art_map.tones;
+
+	if (headless) {
+		// Full detail, framed like a thumbnail. The render nodes have time
+		// to spare, so the FBO is multisampled like the window.
+		OffscreenTarget target;
+		if (!target.create(headless_width, headless_height, 4))
+			return -1;
+		SceneSettings settings;
+		if (!setScenePrograms(programs, headless_features, settings))
+			return -1;
+		EdgeOutline edges;
+		if (headless_features & kShaderEdges)
+			settings.edges = &edges;
+		settings.hatching_texture = texture;
+		settings.tonal_art_map = tam_texture;
+		settings.outline_size = style.outline_size;
+
+		glm::vec3 eye;
+		fitCamera(model->mesh, float(headless_width) / headless_height, frame.projection, frame.view, eye);
+		frame.model = glm::mat4(1.0f);
+		frame.camera_position = eye;
+		frame.viewport_size = glm::vec2(headless_width, headless_height);
+		uniform_buffer.set(frame);
+		uniform_buffer.set(material);
+		uniform_buffer.set(style);
+		uniform_buffer.flush();
+
+		target.bind();
+		clearScene(background_color);
+		GPUTimer untimed;  // never created, so it records nothing
+		drawScene(*model, buffers, settings, frame.projection * frame.view, eye, untimed);
+		Image image;
+		target.read(image);
+		deleteSceneBuffers(buffers);
+		if (!saveImage(output_path, image))
+			return -1;
+		std::cout << "Wrote " << output_path << std::endl;
+		if (!profile_path.empty())
+			writeProfileTrace(profile_path);
+		return 0;
+	}
 
+	GUI gui(window);
+	gui.setPickTarget(&model->bvh);
 	ImGui::CreateContext();
 	ImGui_ImplGlfw_InitForOpenGL(window, true);
 	ImGui_ImplOpenGL3_Init();
 	ImGui::StyleColorsDark();
 
-	glm::vec4 diffuse_color = glm::vec4(0.3, 1.0, 1.0, 1.0);
-	glm::vec4 light_color = glm::vec4(1.0, 0.0, 1.0, 1.0);
-	glm::vec4 ambient_color = glm::vec4(0.1, 0.1, 0.1, 1.0);
-	glm::vec4 specular_color = glm::vec4(1.0, 1.0, 1.0, 1.0);
-	glm::vec4 warm_color = glm::vec4(0.4, 0.4, 0.0, 1.0);
-	glm::vec4 cool_color = glm::vec4(0.0, 0.0, 0.4, 1.0);
-	glm::vec4 background_color = glm::vec4(0.9f, 0.9f, 0.8f, 0.0f);
-	float warm_amount = 0.75;
-	float cool_amount = 0.25;
-	int num_colors = 4;
-	float outline_size = 0.04;
-	float shininess = 32.0;
-	float ka = 0.5;
-	float kd = 1.0;
-	float ks = 1.0;
-	delete[] data;
+	// Per-pass GPU time, read back a few frames late.
+	GPUTimer gpu_timer;
+	gpu_timer.create();
+	EdgeOutline edge_outline;
+
+	// J saves the shaded model, without the panels, read back and encoded
+	// off the frame.
+	CaptureOptions screenshot_options;
+	screenshot_options.extension = screenshot_format;
+	ScreenCapture screen_capture;
+	screen_capture.create(screenshot_options);
+	// Recording reads back every frame the same way, with a pool of
+	// encoders. The panel starts and stops it.
+	ScreenCapture recorder;
+	bool recording = false;
+	auto setRecording = [&](bool on) {
+		if (on == recording)
+			return;
+		if (on) {
+			recording = recorder.create(record_options);
+			return;
+		}
+		recorder.finish();
+		recording = false;
+		std::cout << "Recorded " << recorder.saved() << " frames, " << recorder.dropped() << " dropped, "
+		          << recorder.throughput() << " frames/s" << std::endl;
+	};
+	setRecording(record);
+	// --export hands every frame to other processes through shared memory,
+	// read back the same way. The ring has room for a full screen window.
+	FrameExport frame_export;
+	ScreenCapture export_capture;
+	bool exporting = false;
+	if (!export_name.empty()) {
+		int framebuffer_width, framebuffer_height;
+		glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+		int max_width = framebuffer_width, max_height = framebuffer_height;
+		if (const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor())) {
+			float scale = float(framebuffer_width) / window_width;
+			max_width = std::max(max_width, int(mode->width * scale));
+			max_height = std::max(max_height, int(mode->height * scale));
+		}
+		CaptureOptions export_options;
+		export_options.exporter = &frame_export;
+		exporting = frame_export.create(export_name, max_width, max_height) &&
+		            export_capture.create(export_options);
+	}
+
+	// Browse the model's own directory unless told otherwise.
+	if (asset_directories.empty()) {
+		std::string first = inputs[0];
+		size_t slash = first.rfind('/');
+		asset_directories.push_back(slash == std::string::npos ? "." : first.substr(0, slash));
+	}
+	AssetBrowser browser;
+	browser.scan(asset_directories);
+
+	// Edited assets and shaders are reloaded in the background and swapped
+	// in at the start of a frame; nothing else is touched.
+	FileWatcher watcher;
+	watcher.watch(inputs[0]);
+	if (inputs.size() > 1)
+		watcher.watch(inputs[1]);
+	if (!vertex_path.empty()) {
+		watcher.watch(vertex_path);
+		watcher.watch(fragment_path);
+		watcher.watch(geometry_path);
+	}
+
+	// A save that lands while the file is still loading is kept here and
+	// loaded again once that finishes, as the load may have read it half
+	// written or before the change.
+	std::string stale_model;
+	bool stale_texture = false;
 
 	while (!glfwWindowShouldClose(window)) {
-		// Setup some basic window stuff.
+		PROFILE_ZONE("frame");
+		for (const std::string& path : watcher.changed()) {
+			if (path == model->path || (next_model.valid() && path == next_model_path)) {
+				stale_model = path;
+			} else if (inputs.size() > 1 && path == inputs[1]) {
+				stale_texture = true;
+			} else if (path == vertex_path || path == fragment_path || path == geometry_path) {
+				std::string& source = path == vertex_path ? vertex_source :
+				                      path == fragment_path ? fragment_source : geometry_source;
+				std::string previous = source;
+				if (readShaderSource(path, source) &&
+				    programs.setSources(vertex_source, fragment_source, geometry_source))
+					std::cout << "Reloaded " << path << std::endl;
+				else
+					source = previous;
+			}
+		}
+		if (next_texture.valid() &&
+		    next_texture.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			std::unique_ptr<TextureData> prepared = next_texture.get();
+			GLuint uploaded = prepared ? uploadTexture(*prepared) : 0;
+			if (uploaded) {
+				glState().deleteTextures(1, &texture);
+				texture = uploaded;
+				std::cout << "Reloaded " << inputs[1] << std::endl;
+			}
+		}
+
+		// Swap in a model once it has finished loading.
+		if (next_model.valid() &&
+		    next_model.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			std::unique_ptr<ModelData> loaded = next_model.get();
+			if (loaded) {
+				model = std::move(loaded);
+				watcher.watch(model->path);
+				uploadMesh(model->mesh, buffers.vertex, buffers.uv, buffers.normal, buffers.element);
+				lod_selector = LODSelector();
+				gui.setPickTarget(&model->bvh);
+			} else {
+				std::cerr << "Failed to load " << next_model_path << std::endl;
+			}
+		}
+
+		// Start any reloads that had to wait; a model picked in the browser
+		// meanwhile makes the old one's moot.
+		if (!stale_model.empty() && !next_model.valid()) {
+			if (stale_model == model->path)
+				loadModelAsync(stale_model);
+			stale_model.clear();
+		}
+		if (stale_texture && !next_texture.valid()) {
+			std::string path = inputs[1];
+			next_texture = std::async(std::launch::async, [path, texture_options] {
+				std::unique_ptr<TextureData> prepared(new TextureData);
+				if (!prepareTexture(path, texture_options, *prepared))
+					prepared.reset();
+				return prepared;
+			});
+			stale_texture = false;
+		}
+		const Mesh& mesh = model->mesh;
+
+		// Count last frame's state calls, then setup some basic window
+		// stuff.
+		GLStateCounters state_counters = glState().counters();
+		glState().resetCounters();
+		gpu_timer.beginFrame();
+		screen_capture.poll();
+		if (recording)
+			recorder.poll();
+		if (exporting)
+			export_capture.poll();
 		glfwGetFramebufferSize(window, &window_width, &window_height);
-		glViewport(0, 0, window_width, window_height);
-		glClearColor(background_color.x, background_color.y, background_color.z, background_color.a);
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_MULTISAMPLE);
-		glEnable(GL_BLEND);
-		glEnable(GL_CULL_FACE);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glDepthFunc(GL_LESS);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glCullFace(GL_BACK);
+		glState().viewport(0, 0, window_width, window_height);
+		clearScene(background_color);
 
 		ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
 
-		// Use our program.
-		CHECK_GL_ERROR(glUseProgram(program_id));
-
 		gui.updateMatrices();
 
 		glm::mat4 projection_matrix = gui.getProjection();
@@ -455,164 +511,230 @@ int main(int argc, char* argv[])
 		glm::vec3 camera_position = gui.getCamera();
 		//std::cout << "camera pos " << glm::to_string(camera_position) << endl;
 
-		// Pass uniforms in.
-		CHECK_GL_ERROR(glUniformMatrix4fv(projection_matrix_location, 1, GL_FALSE,
-					&projection_matrix[0][0]));
-		CHECK_GL_ERROR(glUniformMatrix4fv(view_matrix_location, 1, GL_FALSE,
-					&view_matrix[0][0]));
-		CHECK_GL_ERROR(glUniformMatrix4fv(model_matrix_location, 1, GL_FALSE,
-					&model_matrix[0][0]));
-		CHECK_GL_ERROR(glUniform4fv(light_position_location, 1, &light_position[0]));
-		CHECK_GL_ERROR(glUniform3fv(camera_position_location, 1, &camera_position[0]));
-
-		//set bool uniforms
-		CHECK_GL_ERROR(glUniform1i(cel_shade_location, cel_shaded));
-		CHECK_GL_ERROR(glUniform1i(gooch_shade_location, gooch_shaded));
-		CHECK_GL_ERROR(glUniform1i(hatch_shade_location, hatch_shaded));
-		CHECK_GL_ERROR(glUniform1i(texture_hatch_location, texture_hatch));
-
-		//texture uniform
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		CHECK_GL_ERROR(glUniform1i(texture_location, 0));
-
-		// 1st attribute buffer : vertices
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-		glVertexAttribPointer(
-			0,                  // attribute
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-		);
-
-		// 2nd attribute buffer : UVs
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-		glVertexAttribPointer(
-			1,                                // attribute
-			2,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		// 3rd attribute buffer : normals
-		glEnableVertexAttribArray(2);
-		glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-		glVertexAttribPointer(
-			2,                                // attribute
-			3,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		if (outline_hold) {
-
-			draw_outline = true;
-			//render outline
-			glCullFace(GL_FRONT);
-			glDepthMask(GL_TRUE);
-			//add new uniforms
-			glm::vec4 outline_color = glm::vec4(0.0, 0.0, 0.0, 1.0);
-			CHECK_GL_ERROR(glUniform4fv(diffuse_color_location, 1, &outline_color[0]));
-			CHECK_GL_ERROR(glUniform1f(outline_size_location, outline_size));
-			CHECK_GL_ERROR(glUniform1i(render_outline_location, draw_outline));
-
-			// draw the triangles !
-			glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-
-			draw_outline = false;
+		// Pick the level of detail from the projected bounding sphere; the
+		// outline hull is thick and flat-colored, so it can go coarser.
+		int num_lods = mesh.lods.size();
+		float radius_pixels = projectedRadius(mesh, view_matrix * model_matrix, window_height);
+		int lod = auto_lod ? lod_selector.select(mesh, radius_pixels)
+		                   : std::min(manual_lod, num_lods - 1);
+		int outline_lod = std::min(lod + outline_lod_bias, num_lods - 1);
+
+		glm::mat4 mvp = projection_matrix * view_matrix * model_matrix;
+		glm::vec3 camera_model = glm::vec3(glm::inverse(model_matrix) * glm::vec4(camera_position, 1.0f));
+
+		// Each pass uses the program built for just what it draws; the plain
+		// one always exists if a permutation fails to build.
+		unsigned int features = (cel_shaded ? kShaderCel : 0) | (gooch_shaded ? kShaderGooch : 0) |
+		                        (hatch_shaded ? kShaderHatch : 0) | (on_white ? kShaderOnWhite : 0) |
+		                        (on_flat ? kShaderOnFlat : 0) | (texture_hatch ? kShaderTextureHatch : 0);
+		bool screen_outline = outline_hold && outline_mode == 1;
+		if (screen_outline)
+			features |= kShaderEdges;
+		GLuint shaded = programs.get(features);
+		if (!shaded) {
+			shaded = programs.get(0);
+			screen_outline = false;
 		}
-		//render normal
-		glCullFace(GL_BACK);
-
-		//add new uniforms
-		CHECK_GL_ERROR(glUniform4fv(diffuse_color_location, 1, &diffuse_color[0]));
-		CHECK_GL_ERROR(glUniform4fv(ambient_color_location, 1, &ambient_color[0]));
-		CHECK_GL_ERROR(glUniform4fv(specular_color_location, 1, &specular_color[0]));
-		CHECK_GL_ERROR(glUniform4fv(light_color_location, 1, &light_color[0]));
-		CHECK_GL_ERROR(glUniform1f(ka_location, ka)); 
-		CHECK_GL_ERROR(glUniform1f(kd_location, kd)); 
-		CHECK_GL_ERROR(glUniform1f(ks_location, ks)); 
-		CHECK_GL_ERROR(glUniform1f(shininess_location, shininess));
-		//gooch
-		CHECK_GL_ERROR(glUniform4fv(warm_color_location, 1, &warm_color[0])); //warm color for gooch shading
-		CHECK_GL_ERROR(glUniform4fv(cool_color_location, 1, &cool_color[0])); //cool color for gooch shading
-		CHECK_GL_ERROR(glUniform1f(warm_amount_location, warm_amount)); //alpha for gooch shading
-		CHECK_GL_ERROR(glUniform1f(cool_amount_location, cool_amount)); //beta for gooch shading
-		//cel
-		CHECK_GL_ERROR(glUniform1i(num_colors_location, num_colors)); //number of colors for cel shading
-		CHECK_GL_ERROR(glUniform1i(render_outline_location, draw_outline)); //render outline (should be false)
-		//hatch
-		CHECK_GL_ERROR(glUniform1i(on_white_location, on_white)); //flat white bg
-		CHECK_GL_ERROR(glUniform1i(on_flat_location, on_flat)); //flat base color bg
-
-		// Draw the triangles !
-		glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(2);
+		GLuint outline = outline_hold && outline_mode == 0 ? programs.get(kShaderOutline) : 0;
+		GLuint silhouette = outline_hold && outline_mode == 2 ? programs.get(kShaderSilhouette) : 0;
+
+		// Pass uniforms in; only blocks the panel or camera changed go out.
+		frame.projection = projection_matrix;
+		frame.view = view_matrix;
+		frame.model = model_matrix;
+		frame.camera_position = camera_position;
+		frame.viewport_size = glm::vec2(window_width, window_height);
+		uniform_buffer.set(frame);
+		uniform_buffer.set(material);
+		uniform_buffer.set(style);
+		uniform_buffer.flush();
+
+		SceneSettings settings;
+		settings.outline = outline;
+		settings.silhouette = silhouette;
+		settings.edges = screen_outline ? &edge_outline : nullptr;
+		settings.shaded = shaded;
+		settings.hatching_texture = texture;
+		settings.tonal_art_map = tam_texture;
+		settings.lod = lod;
+		settings.outline_lod = outline_lod;
+		settings.meshlet_culling = meshlet_culling;
+		settings.outline_size = style.outline_size;
+		MeshletStats meshlet_stats = drawScene(*model, buffers, settings, mvp, camera_model, gpu_timer);
+		if (gui.takeScreenshotRequest())
+			screen_capture.capture(window_width, window_height);
+		if (recording)
+			recorder.capture(window_width, window_height);
+		if (exporting)
+			export_capture.capture(window_width, window_height);
+
+		// Thumbnails pick up every style uniform set above. The outline
+		// isn't drawn in them, so it isn't part of the style.
+		{
+			std::vector<float> style_values;
+			for (const glm::vec4& v : { material.diffuse_color, material.ambient_color, material.specular_color,
+			                            style.light_color, style.warm_color, style.cool_color, frame.light_position })
+				style_values.insert(style_values.end(), &v[0], &v[0] + 4);
+			float values[] = { material.ka, material.kd, material.ks, material.shininess, style.warm_amount,
+			                   style.cool_amount, style.hatch_scale,
+			                   float(cel_shaded ? style.num_colors + 1 : 0), float(gooch_shaded),
+			                   float(hatch_shaded), float(on_white), float(on_flat), float(texture_hatch) };
+			style_values.insert(style_values.end(), std::begin(values), std::end(values));
+			uint64_t style_hash = hashBytes(style_values.data(), style_values.size() * sizeof(float));
+			if (texture_hatch && inputs.size() > 1)
+				style_hash = hashString(inputs[1], style_hash);
+			browser.setStyle(style_hash);
+		}
+		gpu_timer.begin("thumbnails");
+		browser.update([&](const glm::mat4& projection, const glm::mat4& view, const glm::vec3& eye) {
+			FrameBlock thumbnail = frame;
+			thumbnail.projection = projection;
+			thumbnail.view = view;
+			thumbnail.model = glm::mat4(1.0f);
+			thumbnail.camera_position = eye;
+			uniform_buffer.set(thumbnail);
+			uniform_buffer.flush();
+		});
+		gpu_timer.end();
+
+		std::string picked_model;
+		if (browser.draw(picked_model) && !next_model.valid())
+			loadModelAsync(picked_model);
 
 		{
+            PROFILE_ZONE("ImGui panels");
             ImGui::Begin("shading options");
-            ImGui::ColorEdit3("object color", (float *)&diffuse_color);
-            ImGui::ColorEdit3("ambient color", (float *)&ambient_color);
-            ImGui::ColorEdit3("specular color", (float *)&specular_color);
-            ImGui::SliderFloat("kd", &kd, 0.0f, 1.0f);
-            ImGui::SliderFloat("ka", &ka, 0.0f, 1.0f);
-            ImGui::SliderFloat("ks", &ks, 0.0f, 1.0f);
-            ImGui::SliderFloat("shininess", &shininess, 1.0f, 80.0f);
+            ImGui::ColorEdit3("object color", (float *)&material.diffuse_color);
+            ImGui::ColorEdit3("ambient color", (float *)&material.ambient_color);
+            ImGui::ColorEdit3("specular color", (float *)&material.specular_color);
+            ImGui::SliderFloat("kd", &material.kd, 0.0f, 1.0f);
+            ImGui::SliderFloat("ka", &material.ka, 0.0f, 1.0f);
+            ImGui::SliderFloat("ks", &material.ks, 0.0f, 1.0f);
+            ImGui::SliderFloat("shininess", &material.shininess, 1.0f, 80.0f);
             ImGui::Checkbox("cel shaded", &cel_shaded);
             if (cel_shaded) {
-            	ImGui::SliderInt("number of colors", &num_colors, 0, 10);
+            	ImGui::SliderInt("number of colors", &style.num_colors, 0, 10);
             }
             ImGui::Checkbox("gooch shaded", &gooch_shaded);
             if (gooch_shaded) {
-            	ImGui::ColorEdit3("warm color", (float *)&warm_color);
-            	ImGui::ColorEdit3("cool color", (float *)&cool_color);
-            	ImGui::SliderFloat("warm amount", &warm_amount, 0.0f, 1.0f);
-            	ImGui::SliderFloat("cool amount", &cool_amount, 0.0f, 1.0f);
+            	ImGui::ColorEdit3("warm color", (float *)&style.warm_color);
+            	ImGui::ColorEdit3("cool color", (float *)&style.cool_color);
+            	ImGui::SliderFloat("warm amount", &style.warm_amount, 0.0f, 1.0f);
+            	ImGui::SliderFloat("cool amount", &style.cool_amount, 0.0f, 1.0f);
             }
             ImGui::Checkbox("hatching", &hatch_shaded);
             if (hatch_shaded) {
             	ImGui::Checkbox("flat white", &on_white);
             	ImGui::Checkbox("flat base color", &on_flat);
+            	ImGui::SliderFloat("hatch scale", &style.hatch_scale, 0.5f, 16.0f);
             }
             ImGui::Checkbox("outline", &outline_hold);
             if (outline_hold) {
-            	ImGui::SliderFloat("outline size", &outline_size, 0.0f, 0.05f);
+            	// Switch between them to compare the outline, edges and
+            	// silhouettes passes in the GPU timings.
+            	ImGui::RadioButton("hull", &outline_mode, 0);
+            	ImGui::SameLine();
+            	ImGui::RadioButton("screen space", &outline_mode, 1);
+            	ImGui::SameLine();
+            	ImGui::RadioButton("silhouettes", &outline_mode, 2);
+            	if (outline_mode == 0) {
+            		ImGui::SliderFloat("outline size", &style.outline_size, 0.0f, 0.05f);
+            	} else if (outline_mode == 1) {
+            		ImGui::SliderFloat("edge width", &style.edge_width, 0.5f, 4.0f);
+            		ImGui::SliderFloat("edge threshold", &style.edge_threshold, 0.05f, 2.0f);
+            	} else {
+            		ImGui::SliderFloat("line width", &style.silhouette_width, 0.5f, 8.0f);
+            		ImGui::SliderFloat("crease angle", &style.crease_angle, 0.0f, 180.0f);
+            	}
             }
             ImGui::Checkbox("texture", &texture_hatch);
-            ImGui::SliderFloat3("light position", &light_position.x, -50.0f, 50.0f);
-            ImGui::ColorEdit3("light color", (float *)&light_color);
+            ImGui::Checkbox("automatic LOD", &auto_lod);
+            if (!auto_lod) {
+            	ImGui::SliderInt("LOD", &manual_lod, 0, num_lods - 1);
+            }
+            if (outline_hold && outline_mode == 0) {
+            	ImGui::SliderInt("outline LOD bias", &outline_lod_bias, 0, num_lods - 1);
+            }
+            if (next_model.valid())
+            	ImGui::Text("loading %s...", next_model_path.c_str());
+            ImGui::Text("LOD %d (%u triangles), outline LOD %d, radius %.0f px", lod,
+                        mesh.lods[lod].index_count / 3, outline_lod, radius_pixels);
+            const PickResult& pick = gui.getPick();
+            if (pick.hit) {
+            	ImGui::Text("picked triangle %u at (%.2f, %.2f, %.2f), bone %d, %.3f ms", pick.triangle,
+            	            pick.barycentric.x, pick.barycentric.y, pick.barycentric.z, pick.bone,
+            	            gui.getPickTime());
+            }
+            ImGui::Checkbox("meshlet culling", &meshlet_culling);
+            if (meshlet_culling && meshlet_stats.triangles > 0) {
+            	float total = meshlet_stats.triangles;
+            	ImGui::Text("meshlets %u/%u in %u draws (%s)", meshlet_stats.visible_meshlets,
+            	            meshlet_stats.meshlets, meshlet_stats.draws,
+            	            buffers.indirect ? "indirect" : "multi-draw");
+            	ImGui::Text("culled %.1f%% of triangles (frustum %.1f%%, cone %.1f%%)",
+            	            100.0f * (meshlet_stats.frustum_culled_triangles + meshlet_stats.cone_culled_triangles) / total,
+            	            100.0f * meshlet_stats.frustum_culled_triangles / total,
+            	            100.0f * meshlet_stats.cone_culled_triangles / total);
+            }
+            ImGui::Text("GL state calls %u, %u redundant dropped", state_counters.calls,
+                        state_counters.redundant);
+            ImGui::Text("GL errors: %s, %u so far", glDebugMode(), glErrorCount());
+            ImGui::Text("screenshots (J) %u saved, %u dropped, last encode %.1f ms",
+                        screen_capture.saved(), screen_capture.dropped(), screen_capture.encodeTime());
+            bool record_toggle = recording;
+            if (ImGui::Checkbox("record frames", &record_toggle))
+            	setRecording(record_toggle);
+            if (recording) {
+            	ImGui::Text("%u written at %.1f frames/s, %u dropped, %zu waiting, encode %.1f ms",
+            	            recorder.saved(), recorder.throughput(), recorder.dropped(), recorder.waiting(),
+            	            recorder.encodeTime());
+            }
+            if (exporting) {
+            	ImGui::Text("exported %u frames to /%s, %u dropped, %u consumers waiting",
+            	            frame_export.published(), export_name.c_str(), export_capture.dropped(),
+            	            frame_export.consumersWaiting());
+            }
+            ImGui::SliderFloat3("light position", &frame.light_position.x, -50.0f, 50.0f);
+            ImGui::ColorEdit3("light color", (float *)&style.light_color);
             ImGui::ColorEdit3("background color", (float *)&background_color);
-            //ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::End();
 		}
+		gpu_timer.draw();
 
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		{
+			PROFILE_ZONE("ImGui render");
+			ImGui::Render();
+			gpu_timer.begin("imgui");
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			gpu_timer.end();
+		}
+		gpu_timer.endFrame();
 
 		// Poll and swap.
-		glfwPollEvents();
-		glfwSwapBuffers(window);
+		{
+			PROFILE_ZONE("glfwPollEvents");
+			glfwPollEvents();
+		}
+		{
+			PROFILE_ZONE("glfwSwapBuffers");
+			glfwSwapBuffers(window);
+		}
 	}
-
+	if (!profile_path.empty())
+		writeProfileTrace(profile_path);
+
+	screen_capture.finish();
+	setRecording(false);
+	if (exporting)
+		export_capture.finish();
+	frame_export.close();
 	ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
-	glDeleteBuffers(1, &vertexbuffer);
-	glDeleteBuffers(1, &uvbuffer);
-	glDeleteBuffers(1, &normalbuffer);
-	glDeleteProgram(program_id);
-	glDeleteVertexArrays(1, &VertexArrayID);
+	deleteSceneBuffers(buffers);
+	glState().deleteTextures(1, &texture);
+	glState().deleteTextures(1, &tam_texture);
+	glState().deleteVertexArrays(1, &VertexArrayID);
 	glfwDestroyWindow(window);
 	glfwTerminate();
 	exit(EXIT_SUCCESS);
@@ -0,0 +1,48 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& path, bool sequential)
+{
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	size_ = st.st_size;
+	if (size_ > 0) {
+		void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			::close(fd);
+			size_ = 0;
+			return false;
+		}
+		madvise(mapped, size_, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+		data_ = static_cast<const unsigned char*>(mapped);
+	}
+	::close(fd);
+	open_ = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data_)
+		munmap(const_cast<unsigned char*>(data_), size_);
+	data_ = nullptr;
+	size_ = 0;
+	open_ = false;
+}
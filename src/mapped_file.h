@@ -0,0 +1,32 @@
+#ifndef NPR_MAPPED_FILE_H
+#define NPR_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Read-only memory mapping of a whole file. The mapping lives as long as
+ * the object; empty files map to a null pointer with size 0.
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// sequential hints the kernel to read ahead; packs are read at random.
+	bool open(const std::string& path, bool sequential = true);
+	void close();
+
+	const unsigned char* data() const { return data_; }
+	size_t size() const { return size_; }
+	bool isOpen() const { return open_; }
+
+private:
+	const unsigned char* data_ = nullptr;
+	size_t size_ = 0;
+	bool open_ = false;
+};
+
+#endif
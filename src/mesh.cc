@@ -0,0 +1,151 @@
+#include "mesh.h"
+
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+struct Corner {
+	glm::vec3 position;
+	glm::vec2 uv;
+	glm::vec3 normal;
+
+	bool operator==(const Corner& other) const
+	{
+		return memcmp(this, &other, sizeof(Corner)) == 0;
+	}
+};
+
+struct CornerHash {
+	size_t operator()(const Corner& corner) const
+	{
+		// FNV-1a over the raw bytes; exact duplicates are all we weld.
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&corner);
+		size_t hash = 2166136261u;
+		for (size_t i = 0; i < sizeof(Corner); i++)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+};
+
+}
+
+void buildIndexedMesh(const std::vector<glm::vec3>& vertices,
+                      const std::vector<glm::vec2>& uvs,
+                      const std::vector<glm::vec3>& normals,
+                      Mesh& mesh)
+{
+	mesh.vertices.clear();
+	mesh.uvs.clear();
+	mesh.normals.clear();
+	mesh.indices.clear();
+	mesh.lods.clear();
+
+	std::unordered_map<Corner, unsigned int, CornerHash> lookup;
+	lookup.reserve(vertices.size());
+	mesh.indices.reserve(vertices.size());
+
+	for (size_t i = 0; i < vertices.size(); i++) {
+		Corner corner;
+		corner.position = vertices[i];
+		corner.uv = uvs[i];
+		corner.normal = normals[i];
+
+		auto found = lookup.find(corner);
+		if (found != lookup.end()) {
+			mesh.indices.push_back(found->second);
+			continue;
+		}
+		unsigned int index = mesh.vertices.size();
+		lookup.emplace(corner, index);
+		mesh.vertices.push_back(corner.position);
+		mesh.uvs.push_back(corner.uv);
+		mesh.normals.push_back(corner.normal);
+		mesh.indices.push_back(index);
+	}
+
+	LODLevel base;
+	base.index_count = mesh.indices.size();
+	mesh.lods.push_back(base);
+	computeBoundingSphere(mesh);
+}
+
+void computeBoundingSphere(Mesh& mesh)
+{
+	if (mesh.vertices.empty()) {
+		mesh.bounds_center = glm::vec3(0.0f);
+		mesh.bounds_radius = 0.0f;
+		return;
+	}
+
+	// Ritter's sphere: start from an approximate diameter, then grow.
+	const std::vector<glm::vec3>& points = mesh.vertices;
+	glm::vec3 a = points[0];
+	glm::vec3 b = a;
+	float best = -1.0f;
+	for (const glm::vec3& p : points) {
+		float d = glm::dot(p - a, p - a);
+		if (d > best) {
+			best = d;
+			b = p;
+		}
+	}
+	glm::vec3 c = b;
+	best = -1.0f;
+	for (const glm::vec3& p : points) {
+		float d = glm::dot(p - b, p - b);
+		if (d > best) {
+			best = d;
+			c = p;
+		}
+	}
+
+	glm::vec3 center = 0.5f * (b + c);
+	float radius = 0.5f * glm::length(c - b);
+	for (const glm::vec3& p : points) {
+		float d = glm::length(p - center);
+		if (d > radius) {
+			float grown = 0.5f * (radius + d);
+			center += (d - grown) / d * (p - center);
+			radius = grown;
+		}
+	}
+	mesh.bounds_center = center;
+	mesh.bounds_radius = radius;
+}
+
+void computeVertexNormals(Mesh& mesh)
+{
+	mesh.normals.assign(mesh.vertices.size(), glm::vec3(0.0f));
+	const LODLevel& base = mesh.lods[0];
+	for (unsigned int i = base.index_offset; i + 2 < base.index_offset + base.index_count; i += 3) {
+		unsigned int a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+		// The cross product's length is twice the area, so big triangles
+		// count for more.
+		glm::vec3 normal = glm::cross(mesh.vertices[b] - mesh.vertices[a], mesh.vertices[c] - mesh.vertices[a]);
+		mesh.normals[a] += normal;
+		mesh.normals[b] += normal;
+		mesh.normals[c] += normal;
+	}
+	for (glm::vec3& normal : mesh.normals) {
+		float length = glm::length(normal);
+		normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+}
+
+void computeBoxUVs(Mesh& mesh)
+{
+	float scale = mesh.bounds_radius > 0.0f ? 0.5f / mesh.bounds_radius : 1.0f;
+	mesh.uvs.resize(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); i++) {
+		glm::vec3 p = (mesh.vertices[i] - mesh.bounds_center) * scale + 0.5f;
+		glm::vec3 n = glm::abs(mesh.normals[i]);
+		if (n.x >= n.y && n.x >= n.z)
+			mesh.uvs[i] = glm::vec2(p.z, p.y);
+		else if (n.y >= n.z)
+			mesh.uvs[i] = glm::vec2(p.x, p.z);
+		else
+			mesh.uvs[i] = glm::vec2(p.x, p.y);
+	}
+	mesh.generated_uvs = true;
+}
@@ -0,0 +1,78 @@
+#ifndef NPR_MESH_H
+#define NPR_MESH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+ * A contiguous run of the index buffer holding one level of detail.
+ * error is the largest collapse error of the level, relative to the
+ * bounding sphere radius, so it can be projected to pixels at draw time.
+ * Each level is also split into meshlets, listed in the given range of
+ * Mesh::meshlets.
+ */
+struct LODLevel {
+	unsigned int index_offset = 0;
+	unsigned int index_count = 0;
+	float error = 0.0f;
+	unsigned int meshlet_offset = 0;
+	unsigned int meshlet_count = 0;
+	// Into Mesh::adjacency, two entries per index.
+	unsigned int adjacency_offset = 0;
+};
+
+/*
+ * A small cluster of connected triangles of one level, with a bounding
+ * sphere and a normal cone for culling. The cluster is back facing from
+ * any camera position c with
+ *   dot(center - c, cone_axis) >= cone_cutoff * length(center - c) + radius
+ */
+struct Meshlet {
+	unsigned int index_offset = 0;
+	unsigned int triangle_count = 0;
+	unsigned int vertex_count = 0;
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+	glm::vec3 cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	float cone_cutoff = 1.0f;
+};
+
+/*
+ * Indexed triangle mesh. Every level of detail indexes the same vertex
+ * arrays; indices holds all levels back to back, finest first, and
+ * adjacency the same levels with neighbours (buildAdjacency), uploaded
+ * after them.
+ */
+struct Mesh {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<unsigned int> indices;
+	std::vector<unsigned int> adjacency;
+	std::vector<LODLevel> lods;
+	std::vector<Meshlet> meshlets;
+
+	glm::vec3 bounds_center = glm::vec3(0.0f);
+	float bounds_radius = 0.0f;
+	// The file had none; uvs are computeBoxUVs' instead.
+	bool generated_uvs = false;
+};
+
+// Welds identical (position, uv, normal) corners of a triangle soup, as
+// produced by loadOBJ, into an indexed mesh with a single LOD.
+void buildIndexedMesh(const std::vector<glm::vec3>& vertices,
+                      const std::vector<glm::vec2>& uvs,
+                      const std::vector<glm::vec3>& normals,
+                      Mesh& mesh);
+
+void computeBoundingSphere(Mesh& mesh);
+
+// Area weighted vertex normals from the first level of detail.
+void computeVertexNormals(Mesh& mesh);
+
+// UVs for a mesh that came without: each vertex projected onto the
+// bounding box face its normal points at most, scaled so the box spans
+// 0..1 like a usual texture layout. Needs normals and the bounding sphere.
+void computeBoxUVs(Mesh& mesh);
+
+#endif
@@ -0,0 +1,518 @@
+#include "mesh_io.h"
+#include "asset.h"
+#include "parallel.h"
+#include "profiler.h"
+
+#include <stdio.h>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Vertex records are gathered on worker threads in chunks of this many.
+const size_t kGatherChunk = 1 << 16;
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+bool parsePlyType(const std::string& name, PlyType& type)
+{
+	static const struct {
+		const char* name;
+		PlyType type;
+	} kTypes[] = {
+		{ "char", PlyType::Int8 }, { "int8", PlyType::Int8 },
+		{ "uchar", PlyType::UInt8 }, { "uint8", PlyType::UInt8 },
+		{ "short", PlyType::Int16 }, { "int16", PlyType::Int16 },
+		{ "ushort", PlyType::UInt16 }, { "uint16", PlyType::UInt16 },
+		{ "int", PlyType::Int32 }, { "int32", PlyType::Int32 },
+		{ "uint", PlyType::UInt32 }, { "uint32", PlyType::UInt32 },
+		{ "float", PlyType::Float32 }, { "float32", PlyType::Float32 },
+		{ "double", PlyType::Float64 }, { "float64", PlyType::Float64 },
+	};
+	for (const auto& known : kTypes)
+		if (name == known.name) {
+			type = known.type;
+			return true;
+		}
+	return false;
+}
+
+size_t plyTypeSize(PlyType type)
+{
+	switch (type) {
+	case PlyType::Int8:
+	case PlyType::UInt8:
+		return 1;
+	case PlyType::Int16:
+	case PlyType::UInt16:
+		return 2;
+	case PlyType::Float64:
+		return 8;
+	default:
+		return 4;
+	}
+}
+
+// Any scalar as a double, swapped if the file's byte order isn't ours.
+double readPlyValue(const unsigned char* p, PlyType type, bool swap)
+{
+	unsigned char bytes[8];
+	size_t size = plyTypeSize(type);
+	for (size_t i = 0; i < size; i++)
+		bytes[i] = p[swap ? size - 1 - i : i];
+	switch (type) {
+	case PlyType::Int8: { int8_t v; memcpy(&v, bytes, 1); return v; }
+	case PlyType::UInt8: return bytes[0];
+	case PlyType::Int16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+	case PlyType::UInt16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+	case PlyType::Int32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+	case PlyType::UInt32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+	case PlyType::Float32: { float v; memcpy(&v, bytes, 4); return v; }
+	case PlyType::Float64: { double v; memcpy(&v, bytes, 8); return v; }
+	}
+	return 0.0;
+}
+
+struct PlyProperty {
+	std::string name;
+	PlyType type;
+	bool list = false;
+	PlyType count_type;
+	size_t offset = 0;  // within the record, for elements without lists
+};
+
+struct PlyElement {
+	std::string name;
+	size_t count = 0;
+	std::vector<PlyProperty> properties;
+	size_t record_size = 0;  // 0 if records vary in size
+
+	int find(const char* property) const
+	{
+		for (size_t i = 0; i < properties.size(); i++)
+			if (properties[i].name == property)
+				return i;
+		return -1;
+	}
+};
+
+bool bigEndianHost()
+{
+	const uint16_t one = 1;
+	unsigned char first;
+	memcpy(&first, &one, 1);
+	return first == 0;
+}
+
+// Steps over one record of an element with list properties.
+bool skipRecord(const PlyElement& element, const unsigned char*& p, const unsigned char* end, bool swap)
+{
+	for (const PlyProperty& property : element.properties) {
+		size_t count = 1;
+		if (property.list) {
+			if (size_t(end - p) < plyTypeSize(property.count_type))
+				return false;
+			double value = readPlyValue(p, property.count_type, swap);
+			if (value < 0.0)
+				return false;
+			count = size_t(value);
+			p += plyTypeSize(property.count_type);
+		}
+		if (size_t(end - p) / plyTypeSize(property.type) < count)
+			return false;
+		p += count * plyTypeSize(property.type);
+	}
+	return true;
+}
+
+bool parsePlyHeader(const unsigned char* data, size_t size, std::vector<PlyElement>& elements,
+                    bool& big_endian, size_t& header_size)
+{
+	const char* kEnd = "end_header";
+	const unsigned char* found = nullptr;
+	for (size_t i = 0; i + 10 <= size && !found; i++)
+		if (memcmp(data + i, kEnd, 10) == 0 && (i == 0 || data[i - 1] == '\n'))
+			found = data + i + 10;
+	if (size < 4 || memcmp(data, "ply", 3) != 0 || !found) {
+		printf("Not a correct PLY file\n");
+		return false;
+	}
+	// The payload starts after the line break, \n or \r\n.
+	while (found < data + size && *found != '\n')
+		found++;
+	if (found == data + size) {
+		printf("Not a correct PLY file\n");
+		return false;
+	}
+	header_size = found + 1 - data;
+
+	std::istringstream header(std::string((const char*)data, header_size));
+	std::string line;
+	bool has_format = false;
+	while (std::getline(header, line)) {
+		std::istringstream words(line);
+		std::string keyword;
+		words >> keyword;
+		if (keyword == "format") {
+			std::string format;
+			words >> format;
+			if (format == "ascii") {
+				printf("ASCII PLY isn't supported, convert it to binary\n");
+				return false;
+			}
+			if (format != "binary_little_endian" && format != "binary_big_endian") {
+				printf("Unknown PLY format %s\n", format.c_str());
+				return false;
+			}
+			big_endian = format == "binary_big_endian";
+			has_format = true;
+		} else if (keyword == "element") {
+			PlyElement element;
+			if (!(words >> element.name >> element.count)) {
+				printf("Bad PLY line: %s\n", line.c_str());
+				return false;
+			}
+			elements.push_back(element);
+		} else if (keyword == "property") {
+			PlyProperty property;
+			std::string type;
+			words >> type;
+			if (type == "list") {
+				std::string count_type;
+				words >> count_type >> type;
+				property.list = true;
+				if (!parsePlyType(count_type, property.count_type)) {
+					printf("Bad PLY line: %s\n", line.c_str());
+					return false;
+				}
+			}
+			if (elements.empty() || !parsePlyType(type, property.type) || !(words >> property.name)) {
+				printf("Bad PLY line: %s\n", line.c_str());
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+	}
+	if (!has_format) {
+		printf("Not a correct PLY file\n");
+		return false;
+	}
+
+	for (PlyElement& element : elements) {
+		size_t offset = 0;
+		bool fixed = true;
+		for (PlyProperty& property : element.properties) {
+			property.offset = offset;
+			offset += plyTypeSize(property.type);
+			fixed = fixed && !property.list;
+		}
+		element.record_size = fixed ? offset : 0;
+	}
+	return true;
+}
+
+/*
+ * Copies up to three properties of every vertex into out, interleaved.
+ * When they're all float32 the bytes are copied as they are, a record at
+ * a time if they're adjacent, and big endian files are fixed by one
+ * swapBytes32 pass over the copy. Anything else is converted one value at
+ * a time. Runs over chunks of vertices in parallel.
+ */
+void gatherVertices(const PlyElement& element, const unsigned char* records, bool swap,
+                    const int* properties, int components, float* out)
+{
+	bool raw = true, adjacent = true;
+	for (int c = 0; c < components; c++) {
+		const PlyProperty& property = element.properties[properties[c]];
+		raw = raw && property.type == PlyType::Float32;
+		adjacent = adjacent && property.offset == element.properties[properties[0]].offset + 4 * c;
+	}
+	size_t stride = element.record_size;
+	parallelFor(element.count, kGatherChunk, [&](size_t begin, size_t end) {
+		if (raw && adjacent && stride == 4u * components) {
+			memcpy(out + begin * components, records + begin * stride, (end - begin) * stride);
+		} else if (raw && adjacent) {
+			size_t offset = element.properties[properties[0]].offset;
+			for (size_t v = begin; v < end; v++)
+				memcpy(out + v * components, records + v * stride + offset, 4 * components);
+		} else {
+			for (size_t v = begin; v < end; v++)
+				for (int c = 0; c < components; c++) {
+					const PlyProperty& property = element.properties[properties[c]];
+					const unsigned char* p = records + v * stride + property.offset;
+					if (raw)
+						memcpy(out + v * components + c, p, 4);
+					else
+						out[v * components + c] = float(readPlyValue(p, property.type, swap));
+				}
+		}
+		if (raw && swap)
+			swapBytes32(out + begin * components, (end - begin) * components);
+	});
+}
+
+// Finds the first of a few spellings of each component; false if any is
+// missing.
+bool findProperties(const PlyElement& element, const char* const* names, int spellings,
+                    int components, int* properties)
+{
+	for (int s = 0; s < spellings; s++) {
+		bool found = true;
+		for (int c = 0; c < components; c++) {
+			properties[c] = element.find(names[s * components + c]);
+			found = found && properties[c] >= 0;
+		}
+		if (found)
+			return true;
+	}
+	return false;
+}
+
+void finishMesh(Mesh& mesh, bool has_normals, bool has_uvs)
+{
+	mesh.lods.assign(1, LODLevel());
+	mesh.lods[0].index_count = mesh.indices.size();
+	if (!has_normals)
+		computeVertexNormals(mesh);
+	computeBoundingSphere(mesh);
+	// Hatching needs coordinates that vary over the surface.
+	if (!has_uvs)
+		computeBoxUVs(mesh);
+}
+
+struct PositionHash {
+	size_t operator()(const glm::vec3& position) const
+	{
+		// FNV-1a over the raw bytes; only exact duplicates are welded.
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&position);
+		size_t hash = 2166136261u;
+		for (size_t i = 0; i < sizeof(glm::vec3); i++)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+};
+
+}
+
+void swapBytes32(void* data, size_t count)
+{
+	unsigned char* bytes = static_cast<unsigned char*>(data);
+	size_t i = 0;
+#if defined(__SSE2__)
+	// No byte shuffle in SSE2: swap the bytes of each 16-bit half, then
+	// the halves.
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(bytes + i * 4));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+		_mm_storeu_si128((__m128i*)(bytes + i * 4), v);
+	}
+#endif
+	for (; i < count; i++) {
+		uint32_t word;
+		memcpy(&word, bytes + i * 4, 4);
+		word = (word >> 24) | ((word >> 8) & 0xff00) | ((word << 8) & 0xff0000) | (word << 24);
+		memcpy(bytes + i * 4, &word, 4);
+	}
+}
+
+bool decodePLY(const unsigned char* data, size_t size, Mesh& mesh)
+{
+	std::vector<PlyElement> elements;
+	bool big_endian = false;
+	size_t header_size = 0;
+	if (!parsePlyHeader(data, size, elements, big_endian, header_size))
+		return false;
+	bool swap = big_endian != bigEndianHost();
+
+	mesh = Mesh();
+	bool has_vertices = false, has_faces = false, has_normals = false, has_uvs = false;
+	size_t vertex_count = 0;
+	const unsigned char* p = data + header_size;
+	const unsigned char* end = data + size;
+	for (const PlyElement& element : elements) {
+		if (element.name == "vertex") {
+			if (element.count == 0 || element.record_size == 0 ||
+			    size_t(end - p) / element.record_size < element.count) {
+				printf("Not a correct PLY file\n");
+				return false;
+			}
+			static const char* const kPositions[] = { "x", "y", "z" };
+			static const char* const kNormals[] = { "nx", "ny", "nz" };
+			static const char* const kUVs[] = { "s", "t", "u", "v", "texture_u", "texture_v",
+			                                    "texture_s", "texture_t" };
+			int properties[3];
+			if (!findProperties(element, kPositions, 1, 3, properties)) {
+				printf("PLY vertices have no position\n");
+				return false;
+			}
+			vertex_count = element.count;
+			mesh.vertices.resize(vertex_count);
+			gatherVertices(element, p, swap, properties, 3, &mesh.vertices[0].x);
+			if (findProperties(element, kNormals, 1, 3, properties)) {
+				mesh.normals.resize(vertex_count);
+				gatherVertices(element, p, swap, properties, 3, &mesh.normals[0].x);
+				has_normals = true;
+			}
+			if (findProperties(element, kUVs, 4, 2, properties)) {
+				mesh.uvs.resize(vertex_count);
+				gatherVertices(element, p, swap, properties, 2, &mesh.uvs[0].x);
+				has_uvs = true;
+			}
+			p += element.count * element.record_size;
+			has_vertices = true;
+		} else if (element.name == "face") {
+			int indices = element.find("vertex_indices");
+			if (indices < 0)
+				indices = element.find("vertex_index");
+			if (indices < 0 || !element.properties[indices].list) {
+				printf("PLY faces have no vertex indices\n");
+				return false;
+			}
+			// 32-bit indices are copied as they are and swapped in one
+			// pass at the end, like the vertices.
+			const PlyProperty& list = element.properties[indices];
+			size_t index_size = plyTypeSize(list.type);
+			bool raw = index_size == 4;
+			mesh.indices.reserve(element.count * 3);
+			for (size_t f = 0; f < element.count; f++) {
+				for (size_t i = 0; i < element.properties.size(); i++) {
+					const PlyProperty& property = element.properties[i];
+					size_t count = 1;
+					if (property.list) {
+						double value = size_t(end - p) >= plyTypeSize(property.count_type) ?
+							readPlyValue(p, property.count_type, swap) : -1.0;
+						if (value < 0.0) {
+							printf("Not a correct PLY file\n");
+							return false;
+						}
+						count = size_t(value);
+						p += plyTypeSize(property.count_type);
+					}
+					size_t value_size = plyTypeSize(property.type);
+					if (size_t(end - p) / value_size < count) {
+						printf("Not a correct PLY file\n");
+						return false;
+					}
+					if (int(i) == indices) {
+						for (size_t k = 1; k + 1 < count; k++) {
+							const size_t fan[3] = { 0, k, k + 1 };
+							for (size_t corner : fan) {
+								const unsigned char* q = p + corner * index_size;
+								unsigned int index;
+								if (raw)
+									memcpy(&index, q, 4);
+								else
+									index = (unsigned int)(int64_t)readPlyValue(q, list.type, swap);
+								mesh.indices.push_back(index);
+							}
+						}
+					}
+					p += count * value_size;
+				}
+			}
+			if (raw && swap && !mesh.indices.empty())
+				swapBytes32(mesh.indices.data(), mesh.indices.size());
+			has_faces = true;
+		} else if (element.record_size > 0) {
+			if (size_t(end - p) / element.record_size < element.count) {
+				printf("Not a correct PLY file\n");
+				return false;
+			}
+			p += element.count * element.record_size;
+		} else {
+			for (size_t r = 0; r < element.count; r++)
+				if (!skipRecord(element, p, end, swap)) {
+					printf("Not a correct PLY file\n");
+					return false;
+				}
+		}
+	}
+
+	if (!has_vertices || !has_faces || mesh.indices.empty()) {
+		printf("PLY file has no triangles\n");
+		return false;
+	}
+	for (unsigned int index : mesh.indices)
+		if (index >= vertex_count) {
+			printf("PLY face index %u out of range\n", index);
+			return false;
+		}
+	// Same V flip as loadOBJ.
+	if (has_uvs)
+		for (glm::vec2& uv : mesh.uvs)
+			uv.y = -uv.y;
+	finishMesh(mesh, has_normals, has_uvs);
+	return true;
+}
+
+bool loadPLY(const std::string& path, Mesh& mesh)
+{
+	PROFILE_ZONE("loadPLY");
+	printf("Loading PLY file %s...\n", path.c_str());
+	AssetData asset;
+	if (!readAsset(path, asset)) {
+		printf("%s could not be opened.\n", path.c_str());
+		return false;
+	}
+	return decodePLY(asset.data(), asset.size(), mesh);
+}
+
+bool decodeSTL(const unsigned char* data, size_t size, Mesh& mesh)
+{
+	const size_t kHeaderSize = 84, kRecordSize = 50;
+	uint32_t count = 0;
+	if (size >= kHeaderSize)
+		memcpy(&count, data + 80, 4);
+	if (bigEndianHost())
+		swapBytes32(&count, 1);
+	if (size < kHeaderSize || count == 0 || (size - kHeaderSize) / kRecordSize < count) {
+		// ASCII files start with "solid", but so do some binary headers.
+		if (size >= 5 && memcmp(data, "solid", 5) == 0)
+			printf("ASCII STL isn't supported, convert it to binary\n");
+		else
+			printf("Not a correct STL file\n");
+		return false;
+	}
+
+	// Records are 50 bytes, so positions can't be copied in one go; the
+	// corners of a chunk are copied, then swapped once on big endian hosts.
+	std::vector<glm::vec3> corners(size_t(count) * 3);
+	bool swap = bigEndianHost();
+	parallelFor(count, kGatherChunk, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++)
+			memcpy(&corners[t * 3], data + kHeaderSize + t * kRecordSize + 12, 36);
+		if (swap)
+			swapBytes32(&corners[begin * 3], (end - begin) * 9);
+	});
+
+	mesh = Mesh();
+	std::unordered_map<glm::vec3, unsigned int, PositionHash> lookup;
+	lookup.reserve(corners.size() / 4);
+	mesh.indices.reserve(corners.size());
+	for (const glm::vec3& corner : corners) {
+		auto found = lookup.emplace(corner, (unsigned int)mesh.vertices.size());
+		if (found.second)
+			mesh.vertices.push_back(corner);
+		mesh.indices.push_back(found.first->second);
+	}
+	finishMesh(mesh, false, false);
+	return true;
+}
+
+bool loadSTL(const std::string& path, Mesh& mesh)
+{
+	PROFILE_ZONE("loadSTL");
+	printf("Loading STL file %s...\n", path.c_str());
+	AssetData asset;
+	if (!readAsset(path, asset)) {
+		printf("%s could not be opened.\n", path.c_str());
+		return false;
+	}
+	return decodeSTL(asset.data(), asset.size(), mesh);
+}
@@ -0,0 +1,27 @@
+#ifndef NPR_MESH_IO_H
+#define NPR_MESH_IO_H
+
+#include "mesh.h"
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Binary PLY, little or big endian. Vertices need x, y and z; nx/ny/nz
+ * and s/t (or u/v, texture_u/texture_v) are used when present, other
+ * properties and elements are skipped. Faces are fan triangulated.
+ * Missing normals are computed, missing uvs are zero. The result has a
+ * single level of detail, like buildIndexedMesh gives.
+ */
+bool loadPLY(const std::string& path, Mesh& mesh);
+bool decodePLY(const unsigned char* data, size_t size, Mesh& mesh);
+
+// Binary STL. Corners are welded by position and given smooth normals,
+// since the facet normals would make scans look faceted.
+bool loadSTL(const std::string& path, Mesh& mesh);
+bool decodeSTL(const unsigned char* data, size_t size, Mesh& mesh);
+
+// Reverses the bytes of count 32-bit words in place.
+void swapBytes32(void* data, size_t count);
+
+#endif
@@ -0,0 +1,333 @@
+#include "meshlet.h"
+#include "config.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+void finishMeshlet(const Mesh& mesh, Meshlet& meshlet, const std::vector<unsigned int>& used)
+{
+	// Sphere around the vertex box; cheap and tight enough for clusters.
+	glm::vec3 lo = mesh.vertices[used[0]];
+	glm::vec3 hi = lo;
+	for (unsigned int v : used) {
+		lo = glm::min(lo, mesh.vertices[v]);
+		hi = glm::max(hi, mesh.vertices[v]);
+	}
+	meshlet.center = 0.5f * (lo + hi);
+	meshlet.radius = 0.0f;
+	for (unsigned int v : used)
+		meshlet.radius = std::max(meshlet.radius, glm::length(mesh.vertices[v] - meshlet.center));
+
+	// Normal cone from the face normals. If the faces spread over more than
+	// a hemisphere (or nearly so) the cluster can never be back facing.
+	const unsigned int* tri = &mesh.indices[meshlet.index_offset];
+	std::vector<glm::vec3> face_normals;
+	face_normals.reserve(meshlet.triangle_count);
+	glm::vec3 axis(0.0f);
+	for (unsigned int t = 0; t < meshlet.triangle_count; t++, tri += 3) {
+		const glm::vec3& a = mesh.vertices[tri[0]];
+		const glm::vec3& b = mesh.vertices[tri[1]];
+		const glm::vec3& c = mesh.vertices[tri[2]];
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float len = glm::length(n);
+		if (len <= 0.0f)
+			continue;
+		face_normals.push_back(n / len);
+		axis += n;
+	}
+	float axis_len = glm::length(axis);
+	meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.cone_cutoff = 1.0f;
+	if (face_normals.empty() || axis_len <= 0.0f)
+		return;
+	axis /= axis_len;
+	float min_dot = 1.0f;
+	for (const glm::vec3& n : face_normals)
+		min_dot = std::min(min_dot, glm::dot(n, axis));
+	meshlet.cone_axis = axis;
+	if (min_dot > 0.1f)
+		meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+}
+
+void buildMeshlets(Mesh& mesh)
+{
+	PROFILE_ZONE("buildMeshlets");
+	mesh.meshlets.clear();
+	std::vector<unsigned int> stamp(mesh.vertices.size(), ~0u);
+	std::vector<unsigned int> used;
+	used.reserve(kMeshletMaxVertices);
+
+	for (LODLevel& lod : mesh.lods) {
+		lod.meshlet_offset = mesh.meshlets.size();
+		const unsigned int* level = &mesh.indices[lod.index_offset];
+		unsigned int num_triangles = lod.index_count / 3;
+
+		// Vertex to triangle adjacency of this level, in CSR form.
+		std::vector<unsigned int> first(mesh.vertices.size() + 1, 0);
+		for (unsigned int i = 0; i < lod.index_count; i++)
+			first[level[i] + 1]++;
+		for (size_t v = 0; v < mesh.vertices.size(); v++)
+			first[v + 1] += first[v];
+		std::vector<unsigned int> fill(first.begin(), first.end() - 1);
+		std::vector<unsigned int> adjacent(lod.index_count);
+		for (unsigned int i = 0; i < lod.index_count; i++)
+			adjacent[fill[level[i]]++] = i / 3;
+
+		std::vector<glm::vec3> face_normal(num_triangles);
+		for (unsigned int t = 0; t < num_triangles; t++) {
+			const glm::vec3& a = mesh.vertices[level[3 * t]];
+			const glm::vec3& b = mesh.vertices[level[3 * t + 1]];
+			const glm::vec3& c = mesh.vertices[level[3 * t + 2]];
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float len = glm::length(n);
+			face_normal[t] = len > 0.0f ? n / len : glm::vec3(0.0f);
+		}
+
+		// Grow each meshlet greedily over shared vertices, preferring
+		// triangles that add few vertices and face the same way as the
+		// meshlet so far; coherent normals are what make cone culling work.
+		std::vector<bool> emitted(num_triangles, false);
+		std::vector<unsigned int> order;
+		order.reserve(lod.index_count);
+		std::vector<unsigned int> candidates;
+		unsigned int next_seed = 0;
+		unsigned int remaining = num_triangles;
+		while (remaining > 0) {
+			Meshlet current;
+			current.index_offset = lod.index_offset + order.size();
+			unsigned int id = mesh.meshlets.size();
+			glm::vec3 axis(0.0f);
+			used.clear();
+			candidates.clear();
+
+			while (current.triangle_count < (unsigned int)kMeshletMaxTriangles && remaining > 0) {
+				int best = -1;
+				float best_score = 0.0f;
+				size_t kept = 0;
+				for (size_t c = 0; c < candidates.size(); c++) {
+					unsigned int t = candidates[c];
+					if (emitted[t])
+						continue;
+					candidates[kept++] = t;
+					int fresh = 0;
+					for (int k = 0; k < 3; k++)
+						if (stamp[level[3 * t + k]] != id)
+							fresh++;
+					if (used.size() + fresh > (size_t)kMeshletMaxVertices)
+						continue;
+					float spread = glm::length(axis) > 0.0f
+						? 1.0f - glm::dot(face_normal[t], glm::normalize(axis)) : 0.0f;
+					float score = fresh + 8.0f * spread;
+					if (best < 0 || score < best_score) {
+						best = t;
+						best_score = score;
+					}
+				}
+				candidates.resize(kept);
+
+				if (best < 0) {
+					// Nothing connected fits: seed from the next unused
+					// triangle if there is room for it, else close the meshlet.
+					while (emitted[next_seed])
+						next_seed++;
+					if (used.size() + 3 > (size_t)kMeshletMaxVertices)
+						break;
+					best = next_seed;
+				}
+
+				emitted[best] = true;
+				remaining--;
+				current.triangle_count++;
+				axis += face_normal[best];
+				for (int k = 0; k < 3; k++) {
+					unsigned int v = level[3 * best + k];
+					order.push_back(v);
+					if (stamp[v] == id)
+						continue;
+					stamp[v] = id;
+					used.push_back(v);
+					for (unsigned int a = first[v]; a < first[v + 1]; a++)
+						if (!emitted[adjacent[a]])
+							candidates.push_back(adjacent[a]);
+				}
+			}
+
+			current.vertex_count = used.size();
+			mesh.meshlets.push_back(current);
+		}
+
+		// Bounds are computed once the reordered indices are written back.
+		std::copy(order.begin(), order.end(), mesh.indices.begin() + lod.index_offset);
+		lod.meshlet_count = mesh.meshlets.size() - lod.meshlet_offset;
+		for (unsigned int m = lod.meshlet_offset; m < mesh.meshlets.size(); m++) {
+			Meshlet& meshlet = mesh.meshlets[m];
+			used.assign(mesh.indices.begin() + meshlet.index_offset,
+			            mesh.indices.begin() + meshlet.index_offset + 3 * meshlet.triangle_count);
+			std::sort(used.begin(), used.end());
+			used.erase(std::unique(used.begin(), used.end()), used.end());
+			finishMeshlet(mesh, meshlet, used);
+		}
+	}
+}
+
+void MeshletCuller::build(const Mesh& mesh)
+{
+	// Padding lets a group of four start at any meshlet of any level.
+	size_t count = mesh.meshlets.size();
+	size_t padded = count + 4;
+	center_x_.assign(padded, 0.0f);
+	center_y_.assign(padded, 0.0f);
+	center_z_.assign(padded, 0.0f);
+	radius_.assign(padded, 0.0f);
+	axis_x_.assign(padded, 0.0f);
+	axis_y_.assign(padded, 0.0f);
+	axis_z_.assign(padded, 1.0f);
+	cutoff_.assign(padded, 1.0f);
+	index_offset_.assign(padded, 0);
+	triangle_count_.assign(padded, 0);
+	for (size_t i = 0; i < count; i++) {
+		const Meshlet& m = mesh.meshlets[i];
+		center_x_[i] = m.center.x;
+		center_y_[i] = m.center.y;
+		center_z_[i] = m.center.z;
+		radius_[i] = m.radius;
+		axis_x_[i] = m.cone_axis.x;
+		axis_y_[i] = m.cone_axis.y;
+		axis_z_[i] = m.cone_axis.z;
+		cutoff_[i] = m.cone_cutoff;
+		index_offset_[i] = m.index_offset;
+		triangle_count_[i] = m.triangle_count;
+	}
+}
+
+void MeshletCuller::cull(const LODLevel& lod, const glm::mat4& mvp, const glm::vec3& camera,
+                         bool cone_culling, float inflate)
+{
+	PROFILE_ZONE("MeshletCuller::cull");
+	commands_.clear();
+	stats_ = MeshletStats();
+
+	// Gribb-Hartmann frustum planes, normalized so distances are in model
+	// units and compare directly against sphere radii.
+	glm::vec4 planes[6];
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+	planes[0] = row[3] + row[0];
+	planes[1] = row[3] - row[0];
+	planes[2] = row[3] + row[1];
+	planes[3] = row[3] - row[1];
+	planes[4] = row[3] + row[2];
+	planes[5] = row[3] - row[2];
+	for (glm::vec4& p : planes)
+		p /= glm::length(glm::vec3(p));
+
+	unsigned int first = lod.meshlet_offset;
+	unsigned int end = lod.meshlet_offset + lod.meshlet_count;
+	for (unsigned int base = first; base < end; base += 4) {
+		int in_frustum = 0, front_facing = 0;
+#if defined(__SSE2__)
+		__m128 cx = _mm_loadu_ps(&center_x_[base]);
+		__m128 cy = _mm_loadu_ps(&center_y_[base]);
+		__m128 cz = _mm_loadu_ps(&center_z_[base]);
+		__m128 r = _mm_add_ps(_mm_loadu_ps(&radius_[base]), _mm_set1_ps(inflate));
+		__m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (const glm::vec4& p : planes) {
+			__m128 d = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(p.x)), _mm_mul_ps(cy, _mm_set1_ps(p.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+			inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, neg_r));
+		}
+		in_frustum = _mm_movemask_ps(inside);
+
+		front_facing = 0xf;
+		if (cone_culling) {
+			__m128 vx = _mm_sub_ps(cx, _mm_set1_ps(camera.x));
+			__m128 vy = _mm_sub_ps(cy, _mm_set1_ps(camera.y));
+			__m128 vz = _mm_sub_ps(cz, _mm_set1_ps(camera.z));
+			__m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+			                                     _mm_mul_ps(vz, vz)));
+			__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(&axis_x_[base])),
+			                                     _mm_mul_ps(vy, _mm_loadu_ps(&axis_y_[base]))),
+			                          _mm_mul_ps(vz, _mm_loadu_ps(&axis_z_[base])));
+			__m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cutoff_[base]), dist), r);
+			front_facing = _mm_movemask_ps(_mm_cmplt_ps(along, limit));
+		}
+#else
+		for (int lane = 0; lane < 4; lane++) {
+			unsigned int i = base + lane;
+			glm::vec3 c(center_x_[i], center_y_[i], center_z_[i]);
+			float r = radius_[i] + inflate;
+			bool inside = true;
+			for (const glm::vec4& p : planes)
+				inside = inside && glm::dot(glm::vec3(p), c) + p.w > -r;
+			if (inside)
+				in_frustum |= 1 << lane;
+			glm::vec3 v = c - camera;
+			glm::vec3 axis(axis_x_[i], axis_y_[i], axis_z_[i]);
+			if (!cone_culling || glm::dot(v, axis) < cutoff_[i] * glm::length(v) + r)
+				front_facing |= 1 << lane;
+		}
+#endif
+
+		for (int lane = 0; lane < 4 && base + lane < end; lane++) {
+			unsigned int i = base + lane;
+			unsigned int triangles = triangle_count_[i];
+			stats_.meshlets++;
+			stats_.triangles += triangles;
+			if (!(in_frustum & (1 << lane))) {
+				stats_.frustum_culled_triangles += triangles;
+				continue;
+			}
+			if (!(front_facing & (1 << lane))) {
+				stats_.cone_culled_triangles += triangles;
+				continue;
+			}
+			stats_.visible_meshlets++;
+			if (!commands_.empty()) {
+				DrawElementsIndirectCommand& last = commands_.back();
+				if (last.first_index + last.count == index_offset_[i]) {
+					last.count += 3 * triangles;
+					continue;
+				}
+			}
+			commands_.push_back({ 3 * triangles, 1, index_offset_[i], 0, 0 });
+		}
+	}
+	stats_.draws = commands_.size();
+}
+
+void MeshletCuller::draw(GLuint indirect_buffer)
+{
+	if (commands_.empty())
+		return;
+
+	if (indirect_buffer) {
+		// Orphan and refill the command buffer every frame.
+		GLsizeiptr size = commands_.size() * sizeof(DrawElementsIndirectCommand);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, commands_.data());
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, commands_.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		return;
+	}
+
+	counts_.clear();
+	offsets_.clear();
+	for (const DrawElementsIndirectCommand& command : commands_) {
+		counts_.push_back(command.count);
+		offsets_.push_back((const void*)(command.first_index * sizeof(unsigned int)));
+	}
+	glMultiDrawElements(GL_TRIANGLES, counts_.data(), GL_UNSIGNED_INT, offsets_.data(), counts_.size());
+}
@@ -0,0 +1,67 @@
+#ifndef NPR_MESHLET_H
+#define NPR_MESHLET_H
+
+#include "mesh.h"
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Splits every level of detail into clusters of at most kMeshletMaxVertices
+// vertices and kMeshletMaxTriangles triangles, grown over shared vertices,
+// and computes their bounds. Triangles within each level are reordered so
+// every meshlet is a contiguous run of the index buffer.
+void buildMeshlets(Mesh& mesh);
+
+// Layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+};
+
+struct MeshletStats {
+	unsigned int meshlets = 0;
+	unsigned int visible_meshlets = 0;
+	unsigned int triangles = 0;
+	unsigned int frustum_culled_triangles = 0;
+	unsigned int cone_culled_triangles = 0;
+	unsigned int draws = 0;
+};
+
+/*
+ * Culls the meshlets of one level four at a time with SSE, against the
+ * view frustum and, optionally, by normal cone. Surviving meshlets that
+ * are adjacent in the index buffer are merged into one draw.
+ */
+class MeshletCuller {
+public:
+	void build(const Mesh& mesh);
+
+	// mvp maps model space to clip space; camera is in model space.
+	// inflate grows every bounding sphere, e.g. by the outline hull offset.
+	void cull(const LODLevel& lod, const glm::mat4& mvp, const glm::vec3& camera,
+	          bool cone_culling, float inflate = 0.0f);
+
+	// Issues the surviving ranges with glMultiDrawElementsIndirect when
+	// indirect_buffer is non-zero, or glMultiDrawElements otherwise. The
+	// element buffer must already be bound.
+	void draw(GLuint indirect_buffer);
+
+	const MeshletStats& stats() const { return stats_; }
+
+private:
+	// Meshlet data as structure of arrays, padded for four-wide loads.
+	std::vector<float> center_x_, center_y_, center_z_, radius_;
+	std::vector<float> axis_x_, axis_y_, axis_z_, cutoff_;
+	std::vector<unsigned int> index_offset_, triangle_count_;
+
+	std::vector<DrawElementsIndirectCommand> commands_;
+	std::vector<GLsizei> counts_;
+	std::vector<const void*> offsets_;
+	MeshletStats stats_;
+};
+
+#endif
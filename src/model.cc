@@ -0,0 +1,200 @@
+#include "model.h"
+#include "adjacency.h"
+#include "asset.h"
+#include "config.h"
+#include "gl_state.h"
+#include "lod.h"
+#include "mesh_io.h"
+#include "profiler.h"
+
+#include <stdio.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+bool loadOBJ(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	PROFILE_ZONE("loadOBJ");
+	printf("Loading OBJ file %s...\n", path);
+
+	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+	std::vector<glm::vec3> temp_vertices; 
+	std::vector<glm::vec2> temp_uvs;
+	std::vector<glm::vec3> temp_normals;
+
+
+	// Goes through readAsset so models can come from a pack; fmemopen keeps
+	// the fscanf parsing below unchanged.
+	AssetData asset;
+	FILE * file = readAsset(path, asset) && asset.size() > 0 ?
+		fmemopen(const_cast<unsigned char*>(asset.data()), asset.size(), "r") : NULL;
+	if( file == NULL ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
+	}
+
+	while( 1 ){
+
+		char lineHeader[128];
+		// read the first word of the line
+		int res = fscanf(file, "%s", lineHeader);
+		if (res == EOF)
+			break; // EOF = End Of File. Quit the loop.
+
+		// else : parse lineHeader
+		
+		if (strcmp( lineHeader, "v" ) == 0){
+			glm::vec3 vertex;
+			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
+			temp_vertices.push_back(vertex);
+		} else if (strcmp( lineHeader, "vt" ) == 0){
+			glm::vec2 uv;
+			fscanf(file, "%f %f\n", &uv.x, &uv.y );
+			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+			temp_uvs.push_back(uv);
+		} else if ( strcmp( lineHeader, "vn" ) == 0 ){
+			glm::vec3 normal;
+			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
+			temp_normals.push_back(normal);
+		} else if ( strcmp( lineHeader, "f" ) == 0 ){
+			std::string vertex1, vertex2, vertex3;
+			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
+			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
+			if (matches != 9){
+				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+				fclose(file);
+				return false;
+			}
+			vertexIndices.push_back(vertexIndex[0]);
+			vertexIndices.push_back(vertexIndex[1]);
+			vertexIndices.push_back(vertexIndex[2]);
+			uvIndices    .push_back(uvIndex[0]);
+			uvIndices    .push_back(uvIndex[1]);
+			uvIndices    .push_back(uvIndex[2]);
+			normalIndices.push_back(normalIndex[0]);
+			normalIndices.push_back(normalIndex[1]);
+			normalIndices.push_back(normalIndex[2]);
+		} else{
+			// Probably a comment, eat up the rest of the line
+			char stupidBuffer[1000];
+			fgets(stupidBuffer, 1000, file);
+		}
+	}
+
+	// For each vertex of each triangle
+	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
+		// Get the indices of its attributes
+		unsigned int vertexIndex = vertexIndices[i];
+		unsigned int uvIndex = uvIndices[i];
+		unsigned int normalIndex = normalIndices[i];
+		// Files picked from the browser may be anything, so don't trust them
+		if (vertexIndex - 1 >= temp_vertices.size() || uvIndex - 1 >= temp_uvs.size() ||
+		    normalIndex - 1 >= temp_normals.size()) {
+			printf("Face index out of range in %s\n", path);
+			fclose(file);
+			return false;
+		}
+
+		// Get the attributes thanks to the index
+		glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
+		glm::vec2 uv = temp_uvs[ uvIndex-1 ];
+		glm::vec3 normal = temp_normals[ normalIndex-1 ];
+		
+		// Put the attributes in buffers
+		out_vertices.push_back(vertex);
+		out_uvs     .push_back(uv);
+		out_normals .push_back(normal);
+	}
+	fclose(file);
+	return true;
+}
+
+namespace {
+
+std::string extension(const std::string& path)
+{
+	size_t dot = path.rfind('.');
+	if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+		return "";
+	std::string extension = path.substr(dot + 1);
+	for (char& c : extension)
+		c = tolower(c);
+	return extension;
+}
+
+}
+
+bool isModelFile(const std::string& path)
+{
+	std::string type = extension(path);
+	return type == "obj" || type == "ply" || type == "stl";
+}
+
+bool loadMesh(const std::string& path, Mesh& mesh)
+{
+	// Scans usually come as binary PLY or STL, which are read straight
+	// into an indexed mesh.
+	std::string type = extension(path);
+	if (type == "ply")
+		return loadPLY(path, mesh);
+	if (type == "stl")
+		return loadSTL(path, mesh);
+
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	if (!loadOBJ(path.c_str(), vertices, uvs, normals) || vertices.empty())
+		return false;
+	buildIndexedMesh(vertices, uvs, normals, mesh);
+	return true;
+}
+
+bool loadModel(const std::string& path, ModelData& model)
+{
+	PROFILE_ZONE("loadModel");
+	model.path = path;
+	if (!loadMesh(path, model.mesh))
+		return false;
+
+	// Bake the LOD chain; every level shares the vertex buffers and lives
+	// in one element buffer.
+	Mesh& mesh = model.mesh;
+	buildLODChain(mesh, kNumLODs);
+	buildMeshlets(mesh);
+	// For the silhouette pass, from the final triangle order.
+	buildAdjacency(mesh);
+	std::cout << "Mesh: " << mesh.vertices.size() << " vertices, "
+	          << mesh.lods.size() << " levels of detail"
+	          << (mesh.generated_uvs ? ", no UVs so box projected ones\n" : "\n");
+	for (size_t i = 0; i < mesh.lods.size(); i++)
+		std::cout << "  LOD " << i << ": " << mesh.lods[i].index_count / 3 << " triangles, "
+		          << mesh.lods[i].meshlet_count << " meshlets\n";
+	model.culler.build(mesh);
+
+	// Picking runs against the full resolution level. None of the model
+	// formats carry a skeleton, so there are no bones to pick yet.
+	model.bvh.build(mesh, mesh.lods[0]);
+	return true;
+}
+
+void uploadMesh(const Mesh& mesh, GLuint vertex_buffer, GLuint uv_buffer,
+                GLuint normal_buffer, GLuint element_buffer)
+{
+	PROFILE_ZONE("uploadMesh");
+	glState().bindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(glm::vec3), mesh.vertices.data(), GL_STATIC_DRAW);
+	glState().bindBuffer(GL_ARRAY_BUFFER, uv_buffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.uvs.size() * sizeof(glm::vec2), mesh.uvs.data(), GL_STATIC_DRAW);
+	glState().bindBuffer(GL_ARRAY_BUFFER, normal_buffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.normals.size() * sizeof(glm::vec3), mesh.normals.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+	size_t indices = mesh.indices.size() * sizeof(unsigned int);
+	size_t adjacency = mesh.adjacency.size() * sizeof(unsigned int);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices + adjacency, nullptr, GL_STATIC_DRAW);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices, mesh.indices.data());
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indices, adjacency, mesh.adjacency.data());
+}
@@ -0,0 +1,43 @@
+#ifndef NPR_MODEL_H
+#define NPR_MODEL_H
+
+#include "bvh.h"
+#include "mesh.h"
+#include "meshlet.h"
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Reads a triangulated OBJ with positions, uvs and normals on every face
+// into a triangle soup.
+bool loadOBJ(const char* path, std::vector<glm::vec3>& out_vertices,
+             std::vector<glm::vec2>& out_uvs, std::vector<glm::vec3>& out_normals);
+
+// Whether loadModel knows the file's extension.
+bool isModelFile(const std::string& path);
+
+// Reads an OBJ, binary PLY or binary STL model into an indexed mesh with a
+// single level of detail.
+bool loadMesh(const std::string& path, Mesh& mesh);
+
+// Everything the viewer needs to draw and pick one model, built off the
+// GL thread so a new model can load while the old one is shown.
+struct ModelData {
+	std::string path;
+	Mesh mesh;
+	MeshletCuller culler;
+	BVH bvh;
+};
+
+// loadMesh, then the LOD chain, meshlets, adjacency, culling data and the
+// picking BVH. Needs no GL context.
+bool loadModel(const std::string& path, ModelData& model);
+
+// (Re)fills the vertex attribute and element buffers from mesh, the
+// adjacency indices right after the others.
+void uploadMesh(const Mesh& mesh, GLuint vertex_buffer, GLuint uv_buffer,
+                GLuint normal_buffer, GLuint element_buffer);
+
+#endif
@@ -0,0 +1,218 @@
+#include "pack.h"
+#include "cache.h"
+#include "lz.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char kPackMagic[8] = { 'N', 'P', 'R', 'P', 'A', 'C', 'K', 0 };
+const uint32_t kPackVersion = 1;
+
+struct PackHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_count;
+	uint64_t index_offset;
+	uint64_t names_offset;
+	uint64_t names_size;
+};
+
+size_t blockCount(uint64_t raw_size)
+{
+	return (raw_size + kPackBlockSize - 1) / kPackBlockSize;
+}
+
+}
+
+bool AssetPack::open(const std::string& path)
+{
+	path_ = path;
+	if (!file_.open(path, false)) {
+		printf("%s could not be opened.\n", path.c_str());
+		return false;
+	}
+	PackHeader header;
+	const unsigned char* data = file_.data();
+	size_t size = file_.size();
+	bool ok = size >= sizeof(header);
+	if (ok) {
+		memcpy(&header, data, sizeof(header));
+		ok = memcmp(header.magic, kPackMagic, sizeof(kPackMagic)) == 0 && header.version == kPackVersion &&
+		     header.index_offset % alignof(PackEntry) == 0 && header.index_offset <= size &&
+		     header.entry_count <= (size - header.index_offset) / sizeof(PackEntry) &&
+		     header.names_offset <= size && header.names_size <= size - header.names_offset;
+	}
+	if (ok) {
+		entries_ = reinterpret_cast<const PackEntry*>(data + header.index_offset);
+		count_ = header.entry_count;
+		names_ = reinterpret_cast<const char*>(data + header.names_offset);
+		names_size_ = header.names_size;
+		for (const PackEntry& entry : *this)
+			ok = ok && entry.offset <= size && entry.size <= size - entry.offset && entry.name_offset < names_size_;
+	}
+	if (!ok) {
+		printf("Not a correct asset pack\n");
+		file_.close();
+		entries_ = nullptr;
+		count_ = 0;
+	}
+	return ok;
+}
+
+const PackEntry* AssetPack::find(const std::string& name) const
+{
+	uint64_t hash = hashString(name);
+	const PackEntry* entry = std::lower_bound(begin(), end(), hash,
+		[](const PackEntry& e, uint64_t h) { return e.name_hash < h; });
+	for (; entry != end() && entry->name_hash == hash; entry++)
+		if (this->name(*entry) == name)
+			return entry;
+	return nullptr;
+}
+
+std::string AssetPack::name(const PackEntry& entry) const
+{
+	const char* start = names_ + entry.name_offset;
+	return std::string(start, strnlen(start, names_size_ - entry.name_offset));
+}
+
+bool AssetPack::read(const PackEntry& entry, std::vector<unsigned char>& buffer, const unsigned char*& data) const
+{
+	const unsigned char* stored = file_.data() + entry.offset;
+	if (entry.codec == kPackStored) {
+		if (entry.size != entry.raw_size)
+			return false;
+		data = stored;
+		return true;
+	}
+	if (entry.codec != kPackLZ)
+		return false;
+
+	size_t blocks = blockCount(entry.raw_size);
+	if (blocks * 4 > entry.size)
+		return false;
+	std::vector<uint64_t> offsets(blocks + 1);
+	offsets[0] = blocks * 4;
+	for (size_t i = 0; i < blocks; i++) {
+		uint32_t block_size;
+		memcpy(&block_size, stored + 4 * i, 4);
+		offsets[i + 1] = offsets[i] + block_size;
+	}
+	if (offsets[blocks] > entry.size)
+		return false;
+
+	buffer.resize(entry.raw_size);
+	std::atomic<bool> ok(true);
+	parallelFor(blocks, 1, [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			size_t raw = std::min<uint64_t>(kPackBlockSize, entry.raw_size - i * kPackBlockSize);
+			size_t packed = offsets[i + 1] - offsets[i];
+			unsigned char* out = buffer.data() + i * kPackBlockSize;
+			// Blocks that didn't shrink are kept as they were.
+			if (packed == raw)
+				memcpy(out, stored + offsets[i], raw);
+			else if (!lzDecompress(stored + offsets[i], packed, out, raw))
+				ok = false;
+		}
+	});
+	data = buffer.data();
+	return ok;
+}
+
+bool writeAssetPack(const std::string& path, const std::vector<PackInput>& inputs)
+{
+	std::vector<MappedFile> files(inputs.size());
+	for (size_t i = 0; i < inputs.size(); i++)
+		if (!files[i].open(inputs[i].path)) {
+			printf("%s could not be opened.\n", inputs[i].path.c_str());
+			return false;
+		}
+
+	// Every block of every file is one job.
+	struct Block {
+		size_t file;
+		size_t offset;
+		size_t size;
+		std::vector<unsigned char> packed;
+	};
+	std::vector<Block> blocks;
+	std::vector<size_t> first_block(inputs.size() + 1, 0);
+	for (size_t i = 0; i < inputs.size(); i++) {
+		first_block[i] = blocks.size();
+		for (size_t offset = 0; offset < files[i].size(); offset += kPackBlockSize)
+			blocks.push_back({ i, offset, std::min(kPackBlockSize, files[i].size() - offset), {} });
+	}
+	first_block[inputs.size()] = blocks.size();
+	parallelFor(blocks.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Block& block = blocks[i];
+			block.packed.resize(lzCompressBound(block.size));
+			size_t size = lzCompress(files[block.file].data() + block.offset, block.size, block.packed.data());
+			if (size >= block.size)
+				block.packed.assign(files[block.file].data() + block.offset,
+				                    files[block.file].data() + block.offset + block.size);
+			else
+				block.packed.resize(size);
+		}
+	});
+
+	std::vector<unsigned char> pack(sizeof(PackHeader), 0);
+	std::vector<PackEntry> entries(inputs.size());
+	std::string names;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		PackEntry& entry = entries[i];
+		entry.name_hash = hashString(inputs[i].name);
+		entry.name_offset = names.size();
+		names += inputs[i].name;
+		names.push_back('\0');
+		entry.raw_size = files[i].size();
+
+		size_t packed = 4 * (first_block[i + 1] - first_block[i]);
+		for (size_t b = first_block[i]; b < first_block[i + 1]; b++)
+			packed += blocks[b].packed.size();
+		entry.codec = packed < entry.raw_size ? kPackLZ : kPackStored;
+
+		pack.resize((pack.size() + 15) & ~size_t(15), 0);
+		entry.offset = pack.size();
+		if (entry.codec == kPackStored) {
+			pack.insert(pack.end(), files[i].data(), files[i].data() + files[i].size());
+		} else {
+			for (size_t b = first_block[i]; b < first_block[i + 1]; b++) {
+				uint32_t size = blocks[b].packed.size();
+				const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&size);
+				pack.insert(pack.end(), bytes, bytes + 4);
+			}
+			for (size_t b = first_block[i]; b < first_block[i + 1]; b++)
+				pack.insert(pack.end(), blocks[b].packed.begin(), blocks[b].packed.end());
+		}
+		entry.size = pack.size() - entry.offset;
+	}
+
+	std::sort(entries.begin(), entries.end(),
+		[](const PackEntry& a, const PackEntry& b) { return a.name_hash < b.name_hash; });
+	for (size_t i = 1; i < entries.size(); i++)
+		if (entries[i].name_hash == entries[i - 1].name_hash &&
+		    strcmp(&names[entries[i].name_offset], &names[entries[i - 1].name_offset]) == 0) {
+			printf("%s is in the pack twice\n", &names[entries[i].name_offset]);
+			return false;
+		}
+
+	PackHeader header;
+	memcpy(header.magic, kPackMagic, sizeof(kPackMagic));
+	header.version = kPackVersion;
+	header.entry_count = entries.size();
+	pack.resize((pack.size() + 15) & ~size_t(15), 0);
+	header.index_offset = pack.size();
+	const unsigned char* index = reinterpret_cast<const unsigned char*>(entries.data());
+	pack.insert(pack.end(), index, index + entries.size() * sizeof(PackEntry));
+	header.names_offset = pack.size();
+	header.names_size = names.size();
+	pack.insert(pack.end(), names.begin(), names.end());
+	memcpy(pack.data(), &header, sizeof(header));
+	return writeFileAtomic(path, pack.data(), pack.size());
+}
@@ -0,0 +1,65 @@
+#ifndef NPR_PACK_H
+#define NPR_PACK_H
+
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Asset pack: a header, entry data, then an index sorted by name hash and
+ * a table of names. Compressed entries are split into kPackBlockSize
+ * blocks that decompress independently, so one large entry can be spread
+ * across worker threads. Entry data starts 16-byte aligned, so stored
+ * entries are used straight from the mapping.
+ */
+const size_t kPackBlockSize = 256 << 10;
+
+enum PackCodec : uint32_t {
+	kPackStored = 0,
+	kPackLZ = 1,  // block sizes as uint32, then the LZ blocks
+};
+
+struct PackEntry {
+	uint64_t name_hash;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t raw_size;
+	uint32_t codec;
+	uint32_t name_offset;
+};
+
+class AssetPack {
+public:
+	bool open(const std::string& path);
+
+	const PackEntry* find(const std::string& name) const;
+	std::string name(const PackEntry& entry) const;
+	const PackEntry* begin() const { return entries_; }
+	const PackEntry* end() const { return entries_ + count_; }
+	const std::string& path() const { return path_; }
+
+	// Points data at the entry's bytes: into the mapping for stored
+	// entries, into buffer for compressed ones.
+	bool read(const PackEntry& entry, std::vector<unsigned char>& buffer, const unsigned char*& data) const;
+
+private:
+	MappedFile file_;
+	std::string path_;
+	const PackEntry* entries_ = nullptr;
+	uint32_t count_ = 0;
+	const char* names_ = nullptr;
+	size_t names_size_ = 0;
+};
+
+struct PackInput {
+	std::string name;  // what loaders will look it up by
+	std::string path;  // where to read it from now
+};
+
+// Compresses every input on worker threads, storing entries that don't
+// shrink, and writes the pack atomically.
+bool writeAssetPack(const std::string& path, const std::vector<PackInput>& inputs);
+
+#endif
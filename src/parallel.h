@@ -0,0 +1,38 @@
+#ifndef NPR_PARALLEL_H
+#define NPR_PARALLEL_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+inline unsigned int workerCount()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+/*
+ * Splits [0, count) into one contiguous chunk per hardware thread, never
+ * smaller than min_chunk, and runs fn(begin, end) on each. The calling
+ * thread takes the first chunk; returns once every chunk is done.
+ */
+template <typename Fn>
+void parallelFor(size_t count, size_t min_chunk, Fn fn)
+{
+	size_t chunks = std::min<size_t>(workerCount(), (count + min_chunk - 1) / std::max<size_t>(min_chunk, 1));
+	if (chunks <= 1) {
+		if (count > 0)
+			fn(size_t(0), count);
+		return;
+	}
+	size_t step = (count + chunks - 1) / chunks;
+	std::vector<std::thread> threads;
+	threads.reserve(chunks - 1);
+	for (size_t begin = step; begin < count; begin += step)
+		threads.emplace_back(fn, begin, std::min(begin + step, count));
+	fn(size_t(0), std::min(step, count));
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+#endif
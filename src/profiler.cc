@@ -0,0 +1,167 @@
+#include "profiler.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef NPR_PROFILE
+namespace {
+
+struct Event {
+	const char* name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+// Written only by the thread holding it; count is what lets the writer of
+// the trace read alongside.
+struct Ring {
+	Ring() : events(kProfileEvents) {}
+	std::vector<Event> events;
+	std::atomic<uint64_t> count{0};
+	int id = 0;
+	const char* name = nullptr;
+	bool in_use = true;
+};
+
+struct Registry {
+	Registry() : ticks(profileTicks()), time(std::chrono::steady_clock::now()) {}
+	std::mutex mutex;
+	std::vector<std::unique_ptr<Ring>> rings;
+	// Where the trace starts, and what the ticks are calibrated against.
+	uint64_t ticks;
+	std::chrono::steady_clock::time_point time;
+};
+
+Registry& registry()
+{
+	static Registry registry;
+	return registry;
+}
+
+// Start the clock when the program loads rather than at the first zone.
+Registry& start = registry();
+
+// parallelFor starts fresh threads for every call, so a ring goes back to
+// the pool when its thread ends instead of piling up. Its zones stay and
+// show under the same track as the next thread to take it.
+struct RingOwner {
+	Ring* ring = nullptr;
+	~RingOwner()
+	{
+		if (!ring)
+			return;
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		ring->in_use = false;
+	}
+};
+
+// Plain pointer for the fast path; the owner only exists for its
+// destructor, and touching it costs a TLS init check every time.
+thread_local Ring* thread_ring = nullptr;
+
+Ring& claimRing()
+{
+	thread_local RingOwner owner;
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	for (std::unique_ptr<Ring>& ring : r.rings) {
+		if (!ring->in_use) {
+			ring->in_use = true;
+			ring->name = nullptr;
+			owner.ring = thread_ring = ring.get();
+			return *owner.ring;
+		}
+	}
+	r.rings.emplace_back(new Ring);
+	r.rings.back()->id = r.rings.size();
+	owner.ring = thread_ring = r.rings.back().get();
+	return *owner.ring;
+}
+
+Ring& threadRing()
+{
+	return thread_ring ? *thread_ring : claimRing();
+}
+
+}
+
+uint64_t profileTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void profileThreadName(const char* name)
+{
+	threadRing().name = name;
+}
+
+void profileRecord(const char* name, uint64_t begin, uint64_t end)
+{
+	Ring& ring = threadRing();
+	uint64_t count = ring.count.load(std::memory_order_relaxed);
+	Event& event = ring.events[count % kProfileEvents];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+	ring.count.store(count + 1, std::memory_order_release);
+}
+#endif
+
+bool writeProfileTrace(const std::string& path)
+{
+#ifndef NPR_PROFILE
+	(void)path;
+	printf("Not built with the profiler, configure with -DNPR_PROFILE=ON\n");
+	return false;
+#else
+	Registry& r = registry();
+	// The TSC rate isn't exposed anywhere portable, so measure it over the
+	// whole run.
+	uint64_t ticks = profileTicks();
+	double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - r.time).count();
+	double ticks_per_us = us > 0.0 && ticks > r.ticks ? (ticks - r.ticks) / us : 1.0;
+
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) {
+		printf("Cannot write profile %s\n", path.c_str());
+		return false;
+	}
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"npr\"}}");
+	std::lock_guard<std::mutex> lock(r.mutex);
+	size_t written = 0;
+	for (const std::unique_ptr<Ring>& ring : r.rings) {
+		if (ring->name)
+			fprintf(file, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+			        ring->id, ring->name);
+		uint64_t count = ring->count.load(std::memory_order_acquire);
+		uint64_t first = count > uint64_t(kProfileEvents) ? count - kProfileEvents : 0;
+		for (uint64_t i = first; i < count; i++) {
+			const Event& event = ring->events[i % kProfileEvents];
+			fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":\"%s\",\"ts\":%.3f,\"dur\":%.3f}",
+			        ring->id, event.name, int64_t(event.begin - r.ticks) / ticks_per_us,
+			        (event.end - event.begin) / ticks_per_us);
+			written++;
+		}
+	}
+	fprintf(file, "\n]}\n");
+	if (fclose(file) != 0) {
+		printf("Cannot write profile %s\n", path.c_str());
+		return false;
+	}
+	printf("Wrote %zu zones to %s\n", written, path.c_str());
+	return true;
+#endif
+}
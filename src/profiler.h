@@ -0,0 +1,57 @@
+#ifndef NPR_PROFILER_H
+#define NPR_PROFILER_H
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Scoped CPU zones, built in by the NPR_PROFILE cmake option and nothing
+ * at all without it. A zone reads the TSC when it opens and closes and
+ * appends one event to a ring owned by its thread, so recording takes no
+ * lock; each ring keeps the last kProfileEvents zones. writeProfileTrace()
+ * turns every ring into Chrome trace_event JSON, which Perfetto and
+ * chrome://tracing open.
+ *
+ * Zone names must be string literals (or otherwise live forever), only
+ * the pointer is kept.
+ */
+#ifdef NPR_PROFILE
+#define NPR_PROFILE_CONCAT2(a, b) a##b
+#define NPR_PROFILE_CONCAT(a, b) NPR_PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) ProfileZone NPR_PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_THREAD(name) profileThreadName(name)
+#else
+#define PROFILE_ZONE(name) do {} while (0)
+#define PROFILE_THREAD(name) do {} while (0)
+#endif
+
+// Zones each thread keeps; older ones are overwritten.
+const int kProfileEvents = 1 << 16;
+
+// Only built with NPR_PROFILE, use the macros.
+uint64_t profileTicks();
+
+// Names the calling thread in the trace.
+void profileThreadName(const char* name);
+
+// Closes with the time it was made.
+void profileRecord(const char* name, uint64_t begin, uint64_t end);
+
+class ProfileZone {
+public:
+	explicit ProfileZone(const char* name) : name_(name), begin_(profileTicks()) {}
+	~ProfileZone() { profileRecord(name_, begin_, profileTicks()); }
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name_;
+	uint64_t begin_;
+};
+
+// Writes every thread's zones. Threads may keep recording meanwhile; a
+// ring that wraps while it's copied can lose its oldest zones. Returns
+// false if the profiler isn't built in or the file can't be written.
+bool writeProfileTrace(const std::string& path);
+
+#endif
@@ -0,0 +1,223 @@
+#include "scene.h"
+#include "config.h"
+#include "edge_outline.h"
+#include "gl_debug.h"
+#include "gl_state.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+void createSceneBuffers(SceneBuffers& buffers)
+{
+	glGenBuffers(1, &buffers.vertex);
+	glGenBuffers(1, &buffers.uv);
+	glGenBuffers(1, &buffers.normal);
+	glGenBuffers(1, &buffers.element);
+	// Culled meshlets are submitted with one multi-draw; indirect when the
+	// driver has it, client-side arrays otherwise.
+	if (GLEW_ARB_multi_draw_indirect)
+		glGenBuffers(1, &buffers.indirect);
+}
+
+void deleteSceneBuffers(SceneBuffers& buffers)
+{
+	glState().deleteBuffers(1, &buffers.vertex);
+	glState().deleteBuffers(1, &buffers.uv);
+	glState().deleteBuffers(1, &buffers.normal);
+	glState().deleteBuffers(1, &buffers.element);
+	if (buffers.indirect)
+		glDeleteBuffers(1, &buffers.indirect);
+	buffers = SceneBuffers();
+}
+
+void clearScene(const glm::vec4& background)
+{
+	// Most of it is already set and never reaches the driver.
+	GLStateCache& state = glState();
+	glClearColor(background.x, background.y, background.z, background.a);
+	state.enable(GL_DEPTH_TEST);
+	state.enable(GL_MULTISAMPLE);
+	state.enable(GL_BLEND);
+	state.enable(GL_CULL_FACE);
+	state.depthMask(GL_TRUE);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	state.depthFunc(GL_LESS);
+	state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.cullFace(GL_BACK);
+}
+
+MeshletStats drawScene(ModelData& model, const SceneBuffers& buffers, const SceneSettings& settings,
+                       const glm::mat4& mvp, const glm::vec3& camera_model, GPUTimer& timer)
+{
+	const Mesh& mesh = model.mesh;
+	MeshletCuller& meshlet_culler = model.culler;
+	GLStateCache& state = glState();
+	bool edges = settings.edges && settings.edges->begin();
+
+	//textures
+	state.activeTexture(GL_TEXTURE0);
+	state.bindTexture(GL_TEXTURE_2D, settings.hatching_texture);
+	state.activeTexture(GL_TEXTURE1);
+	state.bindTexture(GL_TEXTURE_2D_ARRAY, settings.tonal_art_map);
+	state.activeTexture(GL_TEXTURE0);
+
+	// 1st attribute buffer : vertices
+	glEnableVertexAttribArray(0);
+	state.bindBuffer(GL_ARRAY_BUFFER, buffers.vertex);
+	glVertexAttribPointer(
+		0,                  // attribute
+		3,                  // size
+		GL_FLOAT,           // type
+		GL_FALSE,           // normalized?
+		0,                  // stride
+		(void*)0            // array buffer offset
+	);
+
+	// 2nd attribute buffer : UVs
+	glEnableVertexAttribArray(1);
+	state.bindBuffer(GL_ARRAY_BUFFER, buffers.uv);
+	glVertexAttribPointer(
+		1,                                // attribute
+		2,                                // size
+		GL_FLOAT,                         // type
+		GL_FALSE,                         // normalized?
+		0,                                // stride
+		(void*)0                          // array buffer offset
+	);
+
+	// 3rd attribute buffer : normals
+	glEnableVertexAttribArray(2);
+	state.bindBuffer(GL_ARRAY_BUFFER, buffers.normal);
+	glVertexAttribPointer(
+		2,                                // attribute
+		3,                                // size
+		GL_FLOAT,                         // type
+		GL_FALSE,                         // normalized?
+		0,                                // stride
+		(void*)0                          // array buffer offset
+	);
+
+	if (settings.outline) {
+		//render outline
+		timer.begin("outline");
+		state.cullFace(GL_FRONT);
+		CHECK_GL_ERROR(state.useProgram(settings.outline));
+
+		// draw the triangles ! the hull shows back faces, so only the
+		// frustum test applies, on spheres grown by the hull offset
+		const LODLevel& level = mesh.lods[settings.outline_lod];
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.element);
+		if (settings.meshlet_culling) {
+			meshlet_culler.cull(level, mvp, camera_model, false, settings.outline_size);
+			meshlet_culler.draw(buffers.indirect);
+		} else {
+			glDrawElements(GL_TRIANGLES, level.index_count, GL_UNSIGNED_INT,
+			               (void*)(level.index_offset * sizeof(unsigned int)));
+		}
+		timer.end();
+	}
+	//render normal
+	timer.begin("shaded");
+	state.cullFace(GL_BACK);
+
+	CHECK_GL_ERROR(state.useProgram(settings.shaded));
+
+	// Draw the triangles !
+	const LODLevel& level = mesh.lods[settings.lod];
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.element);
+	MeshletStats meshlet_stats;
+	if (settings.meshlet_culling) {
+		meshlet_culler.cull(level, mvp, camera_model, true);
+		meshlet_culler.draw(buffers.indirect);
+		meshlet_stats = meshlet_culler.stats();
+	} else {
+		glDrawElements(GL_TRIANGLES, level.index_count, GL_UNSIGNED_INT,
+		               (void*)(level.index_offset * sizeof(unsigned int)));
+	}
+	timer.end();
+
+	if (settings.silhouette) {
+		// Lines of the level on screen, from the adjacency copy after the
+		// indices. Every triangle goes through, as the geometry shader
+		// needs the back facing ones' neighbours, and quads come out
+		// either way round.
+		timer.begin("silhouettes");
+		state.disable(GL_CULL_FACE);
+		CHECK_GL_ERROR(state.useProgram(settings.silhouette));
+		glDrawElements(GL_TRIANGLES_ADJACENCY, 2 * level.index_count, GL_UNSIGNED_INT,
+		               (void*)((mesh.indices.size() + level.adjacency_offset) * sizeof(unsigned int)));
+		state.enable(GL_CULL_FACE);
+		timer.end();
+	}
+
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(1);
+	glDisableVertexAttribArray(2);
+	if (edges) {
+		timer.begin("edges");
+		settings.edges->end();
+		timer.end();
+	}
+	// Thumbnails draw with whatever program is left in use.
+	state.useProgram(settings.shaded);
+	return meshlet_stats;
+}
+
+bool setScenePrograms(ProgramCache& programs, unsigned int features, SceneSettings& settings)
+{
+	settings.shaded = programs.get(features & ~(kShaderOutline | kShaderSilhouette));
+	bool hull = (features & kShaderOutline) && !(features & (kShaderEdges | kShaderSilhouette));
+	settings.outline = hull ? programs.get(kShaderOutline) : 0;
+	settings.silhouette = features & kShaderSilhouette ? programs.get(kShaderSilhouette) : 0;
+	return settings.shaded != 0;
+}
+
+void defaultLook(FrameBlock& frame, MaterialBlock& material, StyleBlock& style, glm::vec4& background)
+{
+	frame = {};
+	frame.light_position = glm::vec4(13.0f, 18.0f, 20.0f, 1.0f);
+	material = {};
+	material.diffuse_color = glm::vec4(0.3, 1.0, 1.0, 1.0);
+	material.ambient_color = glm::vec4(0.1, 0.1, 0.1, 1.0);
+	material.specular_color = glm::vec4(1.0, 1.0, 1.0, 1.0);
+	material.shininess = 32.0;
+	material.ka = 0.5;
+	material.kd = 1.0;
+	material.ks = 1.0;
+	style = {};
+	style.light_color = glm::vec4(1.0, 0.0, 1.0, 1.0);
+	style.warm_color = glm::vec4(0.4, 0.4, 0.0, 1.0);
+	style.cool_color = glm::vec4(0.0, 0.0, 0.4, 1.0);
+	style.outline_color = glm::vec4(0.0, 0.0, 0.0, 1.0);
+	style.warm_amount = 0.75;
+	style.cool_amount = 0.25;
+	style.num_colors = 4;
+	style.tam_tones = kTAMTones;
+	style.hatch_scale = 4.0f;
+	style.outline_size = 0.04;
+	style.edge_width = 1.0f;
+	style.edge_threshold = 0.5f;
+	style.silhouette_width = 2.0f;
+	style.crease_angle = 60.0f;
+	background = glm::vec4(0.9f, 0.9f, 0.8f, 0.0f);
+}
+
+void fitCamera(const Mesh& mesh, float aspect, glm::mat4& projection, glm::mat4& view, glm::vec3& eye,
+               float yaw, float pitch)
+{
+	// kFov is vertical; narrow images have to fit the sphere across instead.
+	const float fov = glm::radians(kFov);
+	float half = std::min(fov * 0.5f, std::atan(std::tan(fov * 0.5f) * aspect));
+	float radius = std::max(mesh.bounds_radius, 1e-4f);
+	float distance = radius / std::sin(half);
+	// Straight overhead would leave lookAt without a sideways axis.
+	float elevation = glm::clamp(std::atan(0.2f) + glm::radians(pitch), glm::radians(-89.0f), glm::radians(89.0f));
+	float azimuth = glm::radians(yaw);
+	glm::vec3 direction(std::sin(azimuth) * std::cos(elevation), std::sin(elevation),
+	                    std::cos(azimuth) * std::cos(elevation));
+	eye = mesh.bounds_center + distance * direction;
+	projection = glm::perspective(fov, aspect, std::max(distance - radius, radius * 0.01f),
+	                              distance + radius);
+	view = glm::lookAt(eye, mesh.bounds_center, glm::vec3(0.0f, 1.0f, 0.0f));
+}
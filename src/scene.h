@@ -0,0 +1,71 @@
+#ifndef NPR_SCENE_H
+#define NPR_SCENE_H
+
+#include "gpu_timer.h"
+#include "meshlet.h"
+#include "model.h"
+#include "shader.h"
+#include "uniforms.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// What the model on screen is drawn from. indirect is 0 without
+// ARB_multi_draw_indirect.
+struct SceneBuffers {
+	GLuint vertex = 0;
+	GLuint uv = 0;
+	GLuint normal = 0;
+	GLuint element = 0;
+	GLuint indirect = 0;
+};
+
+void createSceneBuffers(SceneBuffers& buffers);
+void deleteSceneBuffers(SceneBuffers& buffers);
+
+class EdgeOutline;
+
+// What one frame draws with: programs from ProgramCache (0 for no
+// outline or silhouette lines) and the two hatching textures. With edges,
+// the shaded program has to be an EDGES one.
+struct SceneSettings {
+	GLuint outline = 0;
+	GLuint silhouette = 0;
+	EdgeOutline* edges = nullptr;
+	GLuint shaded = 0;
+	GLuint hatching_texture = 0;
+	GLuint tonal_art_map = 0;
+	int lod = 0;
+	int outline_lod = 0;
+	bool meshlet_culling = true;
+	float outline_size = 0.0f;
+};
+
+// Clears the bound framebuffer to background and sets the state every
+// pass below starts from.
+void clearScene(const glm::vec4& background);
+
+// Draws the outline hull, if any, then the shaded model and its silhouette
+// lines, into whatever framebuffer is bound (through settings.edges and
+// its edge pass if set), with the uniform blocks already flushed. The
+// window and --headless both draw through here. Returns the shaded pass's
+// culling stats.
+MeshletStats drawScene(ModelData& model, const SceneBuffers& buffers, const SceneSettings& settings,
+                       const glm::mat4& mvp, const glm::vec3& camera_model, GPUTimer& timer);
+
+// The shaded, hull and silhouette programs for a --style list; the hull
+// only if neither screen-space outline is asked for too. Returns false if the shaded
+// one doesn't build.
+bool setScenePrograms(ProgramCache& programs, unsigned int features, SceneSettings& settings);
+
+// The light, material, style and background the viewer starts with and
+// --headless and --batch render with.
+void defaultLook(FrameBlock& frame, MaterialBlock& material, StyleBlock& style, glm::vec4& background);
+
+// A camera framing the mesh's bounding sphere from the front and a little
+// above, like the viewer's default one, then turned yaw degrees around the
+// model and pitch degrees up.
+void fitCamera(const Mesh& mesh, float aspect, glm::mat4& projection, glm::mat4& view, glm::vec3& eye,
+               float yaw = 0.0f, float pitch = 0.0f);
+
+#endif
@@ -0,0 +1,387 @@
+#include "shader.h"
+#include "cache.h"
+#include "gl_state.h"
+#include "mapped_file.h"
+#include "profiler.h"
+#include "uniforms.h"
+
+#include <stdio.h>
+#include <strings.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const int kProgramCacheVersion = 1;
+
+// Program cache entries: this header, the key they were built for, then the
+// driver's binary.
+struct ProgramBinaryHeader {
+	char magic[4];
+	uint32_t format;
+	uint32_t key_size;
+	uint32_t binary_size;
+};
+
+const struct {
+	unsigned int feature;
+	const char* name;
+} kFeatureNames[] = {
+	{ kShaderCel, "CEL" },
+	{ kShaderGooch, "GOOCH" },
+	{ kShaderHatch, "HATCH" },
+	{ kShaderOnWhite, "ON_WHITE" },
+	{ kShaderOnFlat, "ON_FLAT" },
+	{ kShaderTextureHatch, "TEXTURE_HATCH" },
+	{ kShaderOutline, "OUTLINE" },
+	{ kShaderEdges, "EDGES" },
+	{ kShaderSilhouette, "SILHOUETTE" },
+};
+
+GLuint compileShader(GLenum type, const std::string& source)
+{
+	GLuint shader = glCreateShader(type);
+	const char* text = source.c_str();
+	glShaderSource(shader, 1, &text, nullptr);
+	glCompileShader(shader);
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status != GL_TRUE) {
+		GLint length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+		std::vector<char> log(length + 1, '\0');
+		glGetShaderInfoLog(shader, length, nullptr, log.data());
+		printf("Shader compile error:\n%s\n", log.data());
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+// #version has to stay first, so defines go on the line after it.
+std::string withDefines(const std::string& source, const std::string& defines)
+{
+	if (defines.empty())
+		return source;
+	size_t version = source.find("#version");
+	size_t line = version == std::string::npos ? 0 : source.find('\n', version);
+	if (line == std::string::npos)
+		return source + "\n" + defines;
+	if (version != std::string::npos)
+		line++;
+	return source.substr(0, line) + defines + source.substr(line);
+}
+
+std::string featureDefines(unsigned int features)
+{
+	std::string defines;
+	for (const auto& feature : kFeatureNames)
+		if (features & feature.feature)
+			defines += std::string("#define ") + feature.name + "\n";
+	return defines;
+}
+
+std::string featureList(unsigned int features)
+{
+	std::string list;
+	for (const auto& feature : kFeatureNames)
+		if (features & feature.feature)
+			list += (list.empty() ? "" : "+") + std::string(feature.name);
+	return list.empty() ? "plain" : list;
+}
+
+// Returns 0 if there's no entry for key or the driver won't take it back,
+// which it may after an update even when the version string is the same.
+GLuint loadProgramBinary(const std::string& path, const std::string& key)
+{
+	MappedFile file;
+	ProgramBinaryHeader header;
+	if (!file.open(path) || file.size() < sizeof(header))
+		return 0;
+	memcpy(&header, file.data(), sizeof(header));
+	const unsigned char* stored_key = file.data() + sizeof(header);
+	if (memcmp(header.magic, "NPRP", 4) != 0 || header.key_size != key.size() ||
+	    file.size() != sizeof(header) + size_t(header.key_size) + header.binary_size ||
+	    memcmp(stored_key, key.data(), key.size()) != 0)
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, stored_key + key.size(), header.binary_size);
+	// A rejected binary may raise an error as well as fail to link; don't
+	// leave it for the next CHECK_GL_ERROR.
+	glGetError();
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+bool saveProgramBinary(const std::string& path, const std::string& key, GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	ProgramBinaryHeader header;
+	std::vector<unsigned char> data(sizeof(header) + key.size() + length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, data.data() + sizeof(header) + key.size());
+	if (written <= 0)
+		return false;
+	memcpy(header.magic, "NPRP", 4);
+	header.format = format;
+	header.key_size = key.size();
+	header.binary_size = written;
+	memcpy(data.data(), &header, sizeof(header));
+	memcpy(data.data() + sizeof(header), key.data(), key.size());
+	return writeFileAtomic(path, data.data(), sizeof(header) + key.size() + written);
+}
+
+// Samplers keep the same units for the whole run: the hatching texture on
+// 0 and the tonal art map on 1. False if the uniform blocks don't match
+// their structs, which would draw with garbage.
+bool setupProgram(GLuint program)
+{
+	if (!bindUniformBlocks(program))
+		return false;
+	GLuint current = glState().save().program;
+	glState().useProgram(program);
+	glUniform1i(glGetUniformLocation(program, "hatching_texture"), 0);
+	glUniform1i(glGetUniformLocation(program, "tonal_art_map"), 1);
+	glState().useProgram(current);
+	return true;
+}
+
+}
+
+std::string shaderPath(const std::string& file)
+{
+#ifdef NPR_SHADER_DIR
+	return std::string(NPR_SHADER_DIR) + "/" + file;
+#else
+	return "";
+#endif
+}
+
+bool readShaderSource(const std::string& path, std::string& source)
+{
+	std::ifstream file(path);
+	if (!file) {
+		printf("%s could not be opened.\n", path.c_str());
+		return false;
+	}
+	std::stringstream text;
+	text << file.rdbuf();
+	source = text.str();
+
+	const std::string kOpen = "R\"zzz(", kClose = ")zzz\"";
+	size_t begin = source.find(kOpen), end = source.rfind(kClose);
+	if (begin != std::string::npos && end != std::string::npos && end > begin)
+		source = source.substr(begin + kOpen.size(), end - begin - kOpen.size());
+	return true;
+}
+
+GLuint buildProgram(const std::string& vertex_source, const std::string& fragment_source,
+                    const std::string& defines, const std::string& geometry_source)
+{
+	GLuint vertex = compileShader(GL_VERTEX_SHADER, withDefines(vertex_source, defines));
+	GLuint fragment = vertex ? compileShader(GL_FRAGMENT_SHADER, withDefines(fragment_source, defines)) : 0;
+	GLuint geometry = 0;
+	if (fragment && !geometry_source.empty())
+		geometry = compileShader(GL_GEOMETRY_SHADER, withDefines(geometry_source, defines));
+	if (!fragment || (!geometry_source.empty() && !geometry)) {
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex);
+	if (geometry)
+		glAttachShader(program, geometry);
+	glAttachShader(program, fragment);
+	glBindAttribLocation(program, 0, "vertex_position");
+	glBindAttribLocation(program, 1, "vertex_uv");
+	glBindAttribLocation(program, 2, "vertex_normal");
+	glBindFragDataLocation(program, 0, "fragment_color");
+	glBindFragDataLocation(program, 1, "fragment_normal");
+	if (GLEW_ARB_get_program_binary)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
+	// The program keeps what it needs once linked.
+	glDeleteShader(vertex);
+	glDeleteShader(geometry);
+	glDeleteShader(fragment);
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		GLint length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+		std::vector<char> log(length + 1, '\0');
+		glGetProgramInfoLog(program, length, nullptr, log.data());
+		printf("Program link error:\n%s\n", log.data());
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+bool parseShaderFeatures(const std::string& list, unsigned int& features)
+{
+	features = 0;
+	std::stringstream stream(list);
+	std::string name;
+	while (std::getline(stream, name, ',')) {
+		if (name.empty())
+			continue;
+		unsigned int feature = 0;
+		for (const auto& known : kFeatureNames)
+			if (strcasecmp(name.c_str(), known.name) == 0)
+				feature = known.feature;
+		if (!feature) {
+			printf("Unknown style %s\n", name.c_str());
+			return false;
+		}
+		features |= feature;
+	}
+	return true;
+}
+
+unsigned int normalizeShaderFeatures(unsigned int features)
+{
+	// Silhouette lines and the hull are a flat color whatever the style;
+	// either screen-space outline replaces the hull.
+	if (features & kShaderSilhouette)
+		return kShaderSilhouette;
+	if (features & kShaderEdges)
+		features &= ~kShaderOutline;
+	if (features & kShaderOutline)
+		return kShaderOutline;
+	// Same precedence as the old uniform branches: cel over gooch, tonal
+	// hatching over the texture, and hatching paper over the base style.
+	if (features & kShaderCel)
+		features &= ~kShaderGooch;
+	if (features & kShaderHatch)
+		features &= ~kShaderTextureHatch;
+	else
+		features &= ~(kShaderOnWhite | kShaderOnFlat);
+	if (features & kShaderOnWhite)
+		features &= ~kShaderOnFlat;
+	if (features & (kShaderOnWhite | kShaderOnFlat | kShaderTextureHatch))
+		features &= ~(kShaderCel | kShaderGooch);
+	return features;
+}
+
+ProgramCache::~ProgramCache()
+{
+	clear();
+}
+
+void ProgramCache::clear()
+{
+	for (auto& entry : programs_)
+		glDeleteProgram(entry.second);
+	programs_.clear();
+}
+
+bool ProgramCache::setSources(const std::string& vertex_source, const std::string& fragment_source,
+                              const std::string& geometry_source)
+{
+	// Every permutation in use is rebuilt before anything is dropped, as an
+	// edit can break code under one #ifdef only. One that was broken
+	// already may stay broken; the plain one, and SILHOUETTE if there's a
+	// new geometry shader, must build.
+	bool reloading = !vertex_source_.empty();
+	bool new_geometry = reloading && !geometry_source.empty() && geometry_source != geometry_source_;
+	std::map<unsigned int, bool> required;
+	for (const auto& entry : programs_)
+		required[entry.first] = entry.second != 0;
+	required[0] = true;
+	if (new_geometry)
+		required[kShaderSilhouette] = true;
+	std::map<unsigned int, GLuint> built;
+	for (const auto& entry : required) {
+		unsigned int features = entry.first;
+		GLuint program = build(vertex_source, fragment_source,
+		                       features & kShaderSilhouette ? geometry_source : std::string(), features);
+		if (!program && entry.second) {
+			for (auto& test : built)
+				glDeleteProgram(test.second);
+			return false;
+		}
+		built[features] = program;
+	}
+	clear();
+	vertex_source_ = vertex_source;
+	fragment_source_ = fragment_source;
+	geometry_source_ = geometry_source;
+	// Keep the test builds.
+	programs_ = built;
+	return true;
+}
+
+GLuint ProgramCache::get(unsigned int features)
+{
+	features = normalizeShaderFeatures(features);
+	auto found = programs_.find(features);
+	if (found != programs_.end())
+		return found->second;
+
+	// Failures are remembered too, so a broken permutation isn't rebuilt
+	// every frame.
+	GLuint program = build(vertex_source_, fragment_source_,
+	                       features & kShaderSilhouette ? geometry_source_ : std::string(), features);
+	programs_[features] = program;
+	return program;
+}
+
+GLuint ProgramCache::build(const std::string& vertex_source, const std::string& fragment_source,
+                           const std::string& geometry_source, unsigned int features)
+{
+	PROFILE_ZONE("ProgramCache::build");
+	if (disk_cache_ && driver_.empty()) {
+		// Binaries only mean something to the driver that made them.
+		GLint formats = 0;
+		if (GLEW_ARB_get_program_binary)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		directory_ = formats > 0 ? cacheDirectory("programs") : "";
+		disk_cache_ = !directory_.empty();
+		driver_ = std::string((const char*)glGetString(GL_RENDERER)) + "\n" +
+		          (const char*)glGetString(GL_VERSION) + "\nv" + std::to_string(kProgramCacheVersion);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::string defines = featureDefines(features) + uniformBlockSource();
+	std::string key, path;
+	if (disk_cache_) {
+		uint64_t sources = hashString(geometry_source, hashString(fragment_source, hashString(vertex_source)));
+		key = driver_ + "\n" + hexString(sources) + "\n" + defines;
+		path = directory_ + "/" + hexString(hashString(key)) + ".bin";
+	}
+	GLuint program = path.empty() ? 0 : loadProgramBinary(path, key);
+	bool cached = program != 0;
+	if (!cached)
+		program = buildProgram(vertex_source, fragment_source, defines, geometry_source);
+	// Rejected like a link failure, and not cached.
+	if (program && !setupProgram(program)) {
+		printf("Program %s doesn't match the uniform structs\n", featureList(features).c_str());
+		glDeleteProgram(program);
+		program = 0;
+	}
+	if (program && !cached && !path.empty() && !saveProgramBinary(path, key, program))
+		printf("Cannot write program cache %s\n", path.c_str());
+	if (program) {
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("Program %s: %.1f ms%s\n", featureList(features).c_str(), ms, cached ? " (cached)" : "");
+	}
+	return program;
+}
@@ -0,0 +1,93 @@
+#ifndef NPR_SHADER_H
+#define NPR_SHADER_H
+
+#include <map>
+#include <string>
+#include <GL/glew.h>
+
+// Where shaders/<file> lives in the source tree, for reloading it while
+// running. Empty when the build didn't say (NPR_SHADER_DIR).
+std::string shaderPath(const std::string& file);
+
+// Reads a shader file as embedded with #include, minus the raw string
+// wrapper around it.
+bool readShaderSource(const std::string& path, std::string& source);
+
+// Compiles and links the scene program with its attribute and output
+// locations bound, with a geometry shader in between if there's a source
+// for one. defines go right after the #version line. Prints the log and
+// returns 0 on failure, so a broken edit can leave the running program in
+// place.
+GLuint buildProgram(const std::string& vertex_source, const std::string& fragment_source,
+                    const std::string& defines = "", const std::string& geometry_source = "");
+
+// Style switches, each compiled in as a #define of the same name rather
+// than branched on at run time.
+enum ShaderFeature : unsigned int {
+	kShaderCel = 1 << 0,
+	kShaderGooch = 1 << 1,
+	kShaderHatch = 1 << 2,
+	kShaderOnWhite = 1 << 3,
+	kShaderOnFlat = 1 << 4,
+	kShaderTextureHatch = 1 << 5,
+	kShaderOutline = 1 << 6,
+	// Also writes normals for EdgeOutline; replaces the hull.
+	kShaderEdges = 1 << 7,
+	// Silhouette and crease lines from the adjacency indices, through the
+	// geometry shader; replaces the hull too.
+	kShaderSilhouette = 1 << 8,
+};
+
+// Parses a comma separated list of feature names as in the shaders, in
+// any case ("cel,outline"). Returns false on an unknown name.
+bool parseShaderFeatures(const std::string& list, unsigned int& features);
+
+// Drops features that another one overrides, so combinations that render
+// the same share a program.
+unsigned int normalizeShaderFeatures(unsigned int features);
+
+/*
+ * One program per normalized feature set, built from the same sources the
+ * first time it's asked for and kept until the sources change; only
+ * SILHOUETTE attaches the geometry shader.
+ * The uniform blocks from uniforms.h are declared in front of the sources
+ * and bound to their binding points, and the samplers to their units.
+ * With disk_cache, linked binaries are also kept under
+ * cacheDirectory("programs"), keyed by the sources, defines and driver, so
+ * later runs skip compiling; anything the driver rejects is rebuilt.
+ */
+class ProgramCache {
+public:
+	explicit ProgramCache(bool disk_cache = true) : disk_cache_(disk_cache) {}
+	~ProgramCache();
+	ProgramCache(const ProgramCache&) = delete;
+	ProgramCache& operator=(const ProgramCache&) = delete;
+
+	// Replaces the sources if every permutation built so far still builds
+	// with them, and the plain one and SILHOUETTE (when a geometry shader
+	// replaces another) too, swapping in the new programs. Otherwise the
+	// old sources and programs stay. A broken geometry shader given first
+	// only fails SILHOUETTE.
+	bool setSources(const std::string& vertex_source, const std::string& fragment_source,
+	                const std::string& geometry_source);
+
+	// The program for these features, or 0 if it doesn't build.
+	GLuint get(unsigned int features);
+
+	size_t size() const { return programs_.size(); }
+
+private:
+	void clear();
+	GLuint build(const std::string& vertex_source, const std::string& fragment_source,
+	             const std::string& geometry_source, unsigned int features);
+
+	bool disk_cache_;
+	std::string directory_;
+	std::string driver_;
+	std::string vertex_source_;
+	std::string fragment_source_;
+	std::string geometry_source_;
+	std::map<unsigned int, GLuint> programs_;
+};
+
+#endif
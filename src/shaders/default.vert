@@ -1,12 +1,9 @@
 R"zzz(
 #version 330 core
-uniform vec4 light_position;
-uniform vec3 camera_position;
-uniform mat4 projection;
-uniform mat4 model;
-uniform mat4 view;
-uniform bool render_outline;
-uniform float outline_size;
+// With OUTLINE defined this only pushes the hull out along the normals.
+// SILHOUETTE runs it as usual, for default.geom.
+// The Frame, Material and Style uniform blocks are declared by
+// ProgramCache, from uniforms.h.
 layout(location = 0) in vec3 vertex_position;
 layout(location = 1) in vec2 vertex_uv;
 layout(location = 2) in vec3 vertex_normal;
@@ -18,12 +15,10 @@ out vec2 uv;
 out vec4 camera_direction;
 void main() {
 	//Transform vertex into clipping coordinates
-	if (render_outline) {
-		gl_Position = projection * view * model * vec4(vertex_position + vertex_normal * outline_size, 1.0);
-	}
-	else {
-		gl_Position = projection * view * model * vec4(vertex_position, 1.0);
-	}
+#ifdef OUTLINE
+	gl_Position = projection * view * model * vec4(vertex_position + vertex_normal * outline_size, 1.0);
+#else
+	gl_Position = projection * view * model * vec4(vertex_position, 1.0);
 	world_position = model * vec4(vertex_position, 1.0); //ok
 
     light_direction = light_position - gl_Position;
@@ -32,5 +27,6 @@ void main() {
     normal = vec4(vertex_normal, 1.0);
     //normal = model * vec4(vertex_normal, 1.0);
 	uv = vertex_uv; //ok
+#endif
 }
 )zzz"
@@ -0,0 +1,53 @@
+R"zzz(
+#version 330 core
+// Screen-space outline: Sobel over the depth and normals the shaded pass
+// wrote, composited over whatever was drawn underneath. Drawn as one
+// triangle covering the viewport (edges.vert in edge_outline.cc). The
+// Frame and Style uniform blocks come from uniforms.h.
+uniform sampler2D scene_color;
+uniform sampler2D scene_normal;
+uniform sampler2D scene_depth;
+out vec4 fragment_color;
+
+// Distance from the eye; the far plane where nothing was drawn.
+float linearDepth(vec2 uv) {
+	float ndc = texture(scene_depth, uv).r * 2.0 - 1.0;
+	return projection[3][2] / (ndc + projection[2][2]);
+}
+
+void main() {
+	vec2 size = vec2(textureSize(scene_depth, 0));
+	vec2 uv = gl_FragCoord.xy / size;
+	vec2 step = edge_width / size;
+
+	// 3x3 neighbourhood, edge_width pixels apart, bottom row first.
+	float depth[9];
+	vec3 normals[9];
+	for (int y = 0; y < 3; y++) {
+		for (int x = 0; x < 3; x++) {
+			vec2 at = uv + vec2(x - 1, y - 1) * step;
+			depth[y * 3 + x] = linearDepth(at);
+			normals[y * 3 + x] = texture(scene_normal, at).xyz;
+		}
+	}
+	float depth_x = (depth[2] + 2.0 * depth[5] + depth[8]) - (depth[0] + 2.0 * depth[3] + depth[6]);
+	float depth_y = (depth[6] + 2.0 * depth[7] + depth[8]) - (depth[0] + 2.0 * depth[1] + depth[2]);
+	vec3 normal_x = (normals[2] + 2.0 * normals[5] + normals[8]) - (normals[0] + 2.0 * normals[3] + normals[6]);
+	vec3 normal_y = (normals[6] + 2.0 * normals[7] + normals[8]) - (normals[0] + 2.0 * normals[1] + normals[2]);
+
+	// Depth steps count relative to the distance, so one threshold holds
+	// near and far; they find folds where the normals either side agree.
+	// Nothing drawn has a zero normal, so silhouettes show in both.
+	float depth_edge = length(vec2(depth_x, depth_y)) / min(depth[4], min(depth[3], depth[5]));
+	float normal_edge = sqrt(dot(normal_x, normal_x) + dot(normal_y, normal_y));
+	float edge = max(smoothstep(edge_threshold, 2.0 * edge_threshold, normal_edge),
+	                 smoothstep(0.25 * edge_threshold, 0.5 * edge_threshold, depth_edge));
+
+	// The model is opaque and the background transparent, blended over
+	// the target's own clear color.
+	vec4 color = texture(scene_color, uv);
+	vec3 rgb = color.a > 0.0 ? mix(color.rgb, outline_color.rgb, edge) : outline_color.rgb;
+	fragment_color = vec4(rgb, max(color.a, edge));
+	gl_FragDepth = texture(scene_depth, uv).r;
+}
+)zzz"
@@ -0,0 +1,141 @@
+#include "tam.h"
+#include "config.h"
+#include "gl_state.h"
+#include "parallel.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+// Fixed so every run builds the same strokes.
+const unsigned int kStrokeSeed = 20190415;
+
+// Endpoints in texture space, [0, 1) wraps; width in texels at any level.
+struct Stroke {
+	float x0, y0, x1, y1;
+	float width;
+};
+
+// Draws an antialiased stroke into a tiling size x size tile of paper
+// brightness. Overlapping ink doesn't darken further. Returns how much
+// the summed brightness dropped.
+double drawStroke(const Stroke& stroke, int size, float* paper)
+{
+	float ax = stroke.x0 * size, ay = stroke.y0 * size;
+	float bx = stroke.x1 * size, by = stroke.y1 * size;
+	float dx = bx - ax, dy = by - ay;
+	float length2 = std::max(dx * dx + dy * dy, 1e-6f);
+	float reach = stroke.width * 0.5f + 1.0f;
+	int x_lo = int(std::floor(std::min(ax, bx) - reach)), x_hi = int(std::ceil(std::max(ax, bx) + reach));
+	int y_lo = int(std::floor(std::min(ay, by) - reach)), y_hi = int(std::ceil(std::max(ay, by) + reach));
+
+	double dropped = 0.0;
+	for (int y = y_lo; y <= y_hi; y++)
+		for (int x = x_lo; x <= x_hi; x++) {
+			float px = x + 0.5f - ax, py = y + 0.5f - ay;
+			float t = std::min(std::max((px * dx + py * dy) / length2, 0.0f), 1.0f);
+			float ex = px - t * dx, ey = py - t * dy;
+			float coverage = stroke.width * 0.5f + 0.5f - std::sqrt(ex * ex + ey * ey);
+			if (coverage <= 0.0f)
+				continue;
+			float& texel = paper[((y % size + size) % size) * size + (x % size + size) % size];
+			float inked = std::min(texel, 1.0f - std::min(coverage, 1.0f));
+			dropped += texel - inked;
+			texel = inked;
+		}
+	return dropped;
+}
+
+float toneDarkness(int tone, int tones)
+{
+	return tones > 1 ? kTAMMaxDarkness * tone / (tones - 1) : 0.0f;
+}
+
+}
+
+void buildTonalArtMap(int size, int tones, TonalArtMap& map)
+{
+	PROFILE_ZONE("buildTonalArtMap");
+	map.size = size;
+	map.tones = tones;
+
+	// Place strokes lightest tone first, until each tone's darkness is met
+	// on the finest level. Light tones get one hatching direction, then
+	// cross hatching, then diagonals for the darkest.
+	std::mt19937 random(kStrokeSeed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<Stroke> strokes;
+	std::vector<size_t> tone_strokes(tones, 0);
+	std::vector<float> paper(size_t(size) * size, 1.0f);
+	double darkness = 0.0;
+	for (int tone = 1; tone < tones; tone++) {
+		float f = float(tone) / (tones - 1);
+		float angle = f <= 0.4f ? 0.0f : f <= 0.7f ? float(M_PI) / 2.0f : float(M_PI) / 4.0f;
+		while (darkness < toneDarkness(tone, tones)) {
+			Stroke stroke;
+			float a = angle + (unit(random) - 0.5f) * 0.15f;
+			float length = 0.3f + 0.3f * unit(random);
+			stroke.x0 = unit(random);
+			stroke.y0 = unit(random);
+			stroke.x1 = stroke.x0 + std::cos(a) * length;
+			stroke.y1 = stroke.y0 + std::sin(a) * length;
+			stroke.width = 1.0f + 0.5f * unit(random);
+			darkness += drawStroke(stroke, size, paper.data()) / paper.size();
+			strokes.push_back(stroke);
+		}
+		tone_strokes[tone] = strokes.size();
+	}
+
+	// Rasterize every tone at every level. Coarse levels soak up more ink
+	// from the same strokes, so each tile is lightened to its tone's
+	// darkness to keep tone steady across mips.
+	int num_levels = 1;
+	while ((size >> (num_levels - 1)) > 1)
+		num_levels++;
+	map.levels.assign(num_levels, std::vector<unsigned char>());
+	for (int level = 0; level < num_levels; level++) {
+		int level_size = std::max(size >> level, 1);
+		map.levels[level].resize(size_t(level_size) * level_size * tones);
+	}
+	parallelFor(size_t(num_levels) * tones, 1, [&](size_t begin, size_t end) {
+		for (size_t job = begin; job < end; job++) {
+			int level = job / tones, tone = job % tones;
+			int level_size = std::max(size >> level, 1);
+			size_t texels = size_t(level_size) * level_size;
+			std::vector<float> tile(texels, 1.0f);
+			double ink = 0.0;
+			for (size_t i = 0; i < tone_strokes[tone]; i++)
+				ink += drawStroke(strokes[i], level_size, tile.data());
+			double scale = ink > 0.0 ? toneDarkness(tone, tones) * texels / ink : 0.0;
+			unsigned char* out = &map.levels[level][tone * texels];
+			for (size_t i = 0; i < texels; i++) {
+				float brightness = 1.0f - std::min(float((1.0f - tile[i]) * scale), 1.0f);
+				out[i] = (unsigned char)(brightness * 255.0f + 0.5f);
+			}
+		}
+	});
+}
+
+GLuint uploadTonalArtMap(const TonalArtMap& map)
+{
+	PROFILE_ZONE("uploadTonalArtMap");
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glState().bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t level = 0; level < map.levels.size(); level++) {
+		int level_size = std::max(map.size >> level, 1);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_R8, level_size, level_size, map.tones, 0,
+		             GL_RED, GL_UNSIGNED_BYTE, map.levels[level].data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, map.levels.size() - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	return texture;
+}
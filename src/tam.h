@@ -0,0 +1,27 @@
+#ifndef NPR_TAM_H
+#define NPR_TAM_H
+
+#include <vector>
+#include <GL/glew.h>
+
+/*
+ * Tonal art map: hatching tiles from white to dark, each with its own mip
+ * chain. Darker tones contain every stroke of the lighter ones and strokes
+ * keep the same width in texels at every level, so blending neighbouring
+ * tones and switching mips doesn't make strokes pop.
+ */
+struct TonalArtMap {
+	int size = 0;   // width and height of the finest level
+	int tones = 0;
+	// One entry per mip level holding tones layers of 8-bit paper brightness.
+	std::vector<std::vector<unsigned char>> levels;
+};
+
+// size must be a power of two. Strokes are placed once, then every tone and
+// level is rasterized on its own worker.
+void buildTonalArtMap(int size, int tones, TonalArtMap& map);
+
+// Uploads as a single channel GL_TEXTURE_2D_ARRAY with one layer per tone.
+GLuint uploadTonalArtMap(const TonalArtMap& map);
+
+#endif
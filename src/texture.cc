@@ -0,0 +1,726 @@
+#include "texture.h"
+#include "asset.h"
+#include "cache.h"
+#include "gl_state.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Bump whenever decoding or filtering changes what ends up in the cache.
+const int kTextureCacheVersion = 1;
+
+// Kaiser window parameters, radius in destination texels.
+const float kKaiserRadius = 2.0f;
+const float kKaiserAlpha = 4.0f;
+
+enum BMPCompression {
+	kBMPRGB = 0,
+	kBMPRLE8 = 1,
+	kBMPRLE4 = 2,
+	kBMPBitfields = 3,
+	kBMPAlphaBitfields = 6,
+};
+
+uint32_t readU32(const unsigned char* p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+uint16_t readU16(const unsigned char* p) { return p[0] | p[1] << 8; }
+
+// Extracts a channel under mask and widens it to eight bits.
+struct Channel {
+	uint32_t mask = 0;
+	int shift = 0;
+	uint32_t max = 0;
+
+	explicit Channel(uint32_t m = 0) : mask(m)
+	{
+		if (!mask)
+			return;
+		while (!(mask >> shift & 1))
+			shift++;
+		max = mask >> shift;
+	}
+	unsigned char operator()(uint32_t pixel, unsigned char fallback) const
+	{
+		if (!max)
+			return fallback;
+		return (unsigned char)(((pixel & mask) >> shift) * 255 / max);
+	}
+};
+
+// Expands RLE8/RLE4 into one palette index per pixel, rows bottom-up.
+// Pixels skipped by delta codes stay at index 0.
+void decodeRLE(const unsigned char* p, const unsigned char* end, int width, int height,
+               bool four_bit, std::vector<unsigned char>& indices)
+{
+	indices.assign(size_t(width) * height, 0);
+	int x = 0, y = 0;
+	auto put = [&](unsigned char index) {
+		if (x < width && y < height)
+			indices[size_t(y) * width + x] = index;
+		x++;
+	};
+	while (p + 1 < end && y < height) {
+		unsigned char count = p[0], value = p[1];
+		p += 2;
+		if (count > 0) {
+			for (int i = 0; i < count; i++)
+				put(four_bit ? (i & 1 ? value & 0xF : value >> 4) : value);
+		} else if (value == 0) {
+			x = 0;
+			y++;
+		} else if (value == 1) {
+			break;
+		} else if (value == 2) {
+			if (p + 1 >= end)
+				break;
+			x += p[0];
+			y += p[1];
+			p += 2;
+		} else {
+			// Absolute run, padded to a whole number of 16-bit words.
+			int bytes = four_bit ? (value + 1) / 2 : value;
+			if (p + bytes > end)
+				break;
+			for (int i = 0; i < value; i++)
+				put(four_bit ? (i & 1 ? p[i / 2] & 0xF : p[i / 2] >> 4) : p[i]);
+			p += (bytes + 1) & ~1;
+		}
+	}
+}
+
+float srgbToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+unsigned char linearToSRGB(float c)
+{
+	c = std::min(std::max(c, 0.0f), 1.0f);
+	c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+	return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+float besselI0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 20; k++) {
+		term *= (x / (2.0f * k)) * (x / (2.0f * k));
+		sum += term;
+	}
+	return sum;
+}
+
+// Source taps for every destination texel along one axis, padded to the
+// same count so the passes can run without branching.
+struct Taps {
+	int count = 0;
+	std::vector<int> index;
+	std::vector<float> weight;
+};
+
+Taps buildTaps(int src, int dst, MipFilter filter)
+{
+	float scale = float(src) / dst;
+	std::vector<std::vector<std::pair<int, float>>> lists(dst);
+	for (int x = 0; x < dst; x++) {
+		std::vector<std::pair<int, float>>& list = lists[x];
+		if (filter == MipFilter::Box) {
+			float lo = x * scale, hi = (x + 1) * scale;
+			for (int i = int(std::floor(lo)); i < int(std::ceil(hi)); i++)
+				list.emplace_back(i, std::min(hi, i + 1.0f) - std::max(lo, float(i)));
+		} else {
+			float center = (x + 0.5f) * scale;
+			float reach = kKaiserRadius * scale;
+			for (int i = int(std::floor(center - reach)); i <= int(std::ceil(center + reach)); i++) {
+				float d = (i + 0.5f - center) / scale;
+				if (std::abs(d) >= kKaiserRadius)
+					continue;
+				float t = d / kKaiserRadius;
+				float sinc = d == 0.0f ? 1.0f : std::sin(float(M_PI) * d) / (float(M_PI) * d);
+				float window = besselI0(kKaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(kKaiserAlpha);
+				list.emplace_back(i, sinc * window);
+			}
+		}
+		float sum = 0.0f;
+		for (auto& tap : list) {
+			tap.first = (tap.first % src + src) % src;
+			sum += tap.second;
+		}
+		for (auto& tap : list)
+			tap.second /= sum;
+	}
+
+	Taps taps;
+	for (const auto& list : lists)
+		taps.count = std::max<int>(taps.count, list.size());
+	taps.index.assign(size_t(dst) * taps.count, 0);
+	taps.weight.assign(size_t(dst) * taps.count, 0.0f);
+	for (int x = 0; x < dst; x++)
+		for (size_t i = 0; i < lists[x].size(); i++) {
+			taps.index[size_t(x) * taps.count + i] = lists[x][i].first;
+			taps.weight[size_t(x) * taps.count + i] = lists[x][i].second;
+		}
+	return taps;
+}
+
+// KTX 1.1 container, see the Khronos spec. Only 2D textures with a full or
+// partial mip chain are written or accepted.
+const unsigned char kKTXIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const uint32_t kKTXEndianness = 0x04030201;
+const char kKTXSourceKey[] = "npr.source";
+
+struct KTXHeader {
+	unsigned char identifier[12];
+	uint32_t endianness;
+	uint32_t gl_type;
+	uint32_t gl_type_size;
+	uint32_t gl_format;
+	uint32_t gl_internal_format;
+	uint32_t gl_base_internal_format;
+	uint32_t pixel_width;
+	uint32_t pixel_height;
+	uint32_t pixel_depth;
+	uint32_t array_elements;
+	uint32_t faces;
+	uint32_t mip_levels;
+	uint32_t key_value_bytes;
+};
+
+size_t pad4(size_t n) { return (n + 3) & ~size_t(3); }
+
+// Past any texture size a driver takes; keeps level sizes from overflowing.
+const uint32_t kMaxKTXSize = 1 << 16;
+const uint32_t kMaxKTXLevels = 17;
+
+bool writeKTX(const std::string& path, const std::string& source, const KTXHeader& format,
+              const std::vector<TextureLevel>& levels)
+{
+	KTXHeader header = format;
+	memcpy(header.identifier, kKTXIdentifier, sizeof(kKTXIdentifier));
+	header.endianness = kKTXEndianness;
+	header.pixel_width = levels[0].width;
+	header.pixel_height = levels[0].height;
+	header.pixel_depth = 0;
+	header.array_elements = 0;
+	header.faces = 1;
+	header.mip_levels = levels.size();
+
+	uint32_t pair_bytes = sizeof(kKTXSourceKey) + source.size() + 1;
+	header.key_value_bytes = 4 + pad4(pair_bytes);
+
+	size_t total = sizeof(header) + header.key_value_bytes;
+	for (const TextureLevel& level : levels)
+		total += 4 + pad4(level.size);
+	std::vector<unsigned char> file(total, 0);
+	unsigned char* p = file.data();
+	memcpy(p, &header, sizeof(header));
+	p += sizeof(header);
+	memcpy(p, &pair_bytes, 4);
+	memcpy(p + 4, kKTXSourceKey, sizeof(kKTXSourceKey));
+	memcpy(p + 4 + sizeof(kKTXSourceKey), source.c_str(), source.size() + 1);
+	p += header.key_value_bytes;
+	for (const TextureLevel& level : levels) {
+		uint32_t size = level.size;
+		memcpy(p, &size, 4);
+		memcpy(p + 4, level.data, level.size);
+		p += 4 + pad4(level.size);
+	}
+	return writeFileAtomic(path, file.data(), file.size());
+}
+
+// Points levels into data. Fails unless the file was written for source.
+bool parseKTX(const unsigned char* data, size_t size, const std::string& source,
+              KTXHeader& header, std::vector<TextureLevel>& levels)
+{
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.identifier, kKTXIdentifier, sizeof(kKTXIdentifier)) != 0 ||
+	    header.endianness != kKTXEndianness || header.faces != 1 ||
+	    header.pixel_depth > 1 || header.array_elements > 0 || header.mip_levels == 0)
+		return false;
+
+	const unsigned char* p = data + sizeof(header);
+	const unsigned char* end = data + size;
+	if (header.key_value_bytes > size_t(end - p))
+		return false;
+	const unsigned char* key_values_end = p + header.key_value_bytes;
+	bool fresh = false;
+	while (p + 4 <= key_values_end) {
+		uint32_t pair_bytes = readU32(p);
+		const char* key = reinterpret_cast<const char*>(p + 4);
+		if (pair_bytes > size_t(key_values_end - p - 4))
+			return false;
+		size_t key_length = strnlen(key, pair_bytes);
+		if (key_length + 1 < pair_bytes && strcmp(key, kKTXSourceKey) == 0)
+			fresh = source.compare(0, std::string::npos, key + key_length + 1,
+			                       strnlen(key + key_length + 1, pair_bytes - key_length - 1)) == 0;
+		p += 4 + pad4(pair_bytes);
+	}
+	if (!fresh)
+		return false;
+
+	// Only what prepareTexture writes, so every level's size is known and
+	// GL never reads past the mapping of a short or stale file.
+	bool block = header.gl_type == 0 && header.gl_format == 0;
+	bool bc3 = header.gl_internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	if (block ? !bc3 && header.gl_internal_format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT :
+	            header.gl_type != GL_UNSIGNED_BYTE || header.gl_format != GL_RGBA ||
+	            header.gl_internal_format != GL_RGBA8)
+		return false;
+	if (header.pixel_width == 0 || header.pixel_width > kMaxKTXSize || header.pixel_height > kMaxKTXSize ||
+	    header.mip_levels > kMaxKTXLevels)
+		return false;
+
+	p = key_values_end;
+	levels.clear();
+	int width = header.pixel_width, height = std::max<int>(header.pixel_height, 1);
+	for (uint32_t i = 0; i < header.mip_levels; i++) {
+		if (end - p < 4)
+			return false;
+		uint32_t level_size = readU32(p);
+		size_t expected = block ? blockCompressedSize(width, height, bc3 ? BlockFormat::BC3 : BlockFormat::BC1) :
+		                          size_t(width) * height * 4;
+		if (level_size != expected || size_t(end - p - 4) < level_size)
+			return false;
+		levels.push_back({ width, height, p + 4, level_size });
+		p += 4 + pad4(level_size);
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+	return true;
+}
+
+const char* filterName(MipFilter filter)
+{
+	return filter == MipFilter::Box ? "box" : "kaiser";
+}
+
+const char* qualityName(EncodeQuality quality)
+{
+	return quality == EncodeQuality::Fast ? "fast" : quality == EncodeQuality::Normal ? "normal" : "high";
+}
+
+}
+
+bool decodeBMP(const unsigned char* data, size_t size, Image& image)
+{
+	PROFILE_ZONE("decodeBMP");
+	if (size < 26 || data[0] != 'B' || data[1] != 'M')
+		return false;
+	uint32_t data_offset = readU32(data + 0x0A);
+	uint32_t header_size = readU32(data + 0x0E);
+	const unsigned char* info = data + 0x0E;
+	if (0x0E + size_t(header_size) > size)
+		return false;
+
+	int width, height, bpp;
+	uint32_t compression = kBMPRGB, colors_used = 0;
+	size_t palette_entry = 4;
+	uint32_t masks[4] = { 0, 0, 0, 0 };
+	const unsigned char* palette = info + header_size;
+	if (header_size == 12) {
+		// OS/2 core header: 16-bit sizes and three byte palette entries.
+		width = readU16(info + 4);
+		height = (int16_t)readU16(info + 6);
+		bpp = readU16(info + 10);
+		palette_entry = 3;
+	} else if (header_size >= 40) {
+		width = (int32_t)readU32(info + 4);
+		height = (int32_t)readU32(info + 8);
+		bpp = readU16(info + 14);
+		compression = readU32(info + 16);
+		colors_used = readU32(info + 32);
+		if (compression == kBMPBitfields || compression == kBMPAlphaBitfields) {
+			// Masks are part of V2+ headers, otherwise they follow the header.
+			int mask_count = compression == kBMPAlphaBitfields || header_size >= 56 ? 4 : 3;
+			const unsigned char* mask_data = header_size >= 52 ? info + 40 : info + header_size;
+			if (mask_data + 4 * mask_count > data + size)
+				return false;
+			for (int i = 0; i < mask_count; i++)
+				masks[i] = readU32(mask_data + 4 * i);
+			if (header_size < 52)
+				palette += 4 * mask_count;
+		} else if (header_size >= 56) {
+			masks[3] = readU32(info + 52);
+		}
+	} else {
+		return false;
+	}
+
+	bool top_down = height < 0;
+	height = std::abs(height);
+	if (width <= 0 || height == 0 || width > 1 << 15 || height > 1 << 15)
+		return false;
+	if (top_down && (compression == kBMPRLE8 || compression == kBMPRLE4))
+		return false;
+
+	image.width = width;
+	image.height = height;
+	image.pixels.assign(size_t(width) * height * 4, 255);
+	const unsigned char* pixels = data + std::min<size_t>(data_offset, size);
+	const unsigned char* end = data + size;
+
+	if (bpp <= 8) {
+		if (bpp != 1 && bpp != 4 && bpp != 8)
+			return false;
+		uint32_t palette_size = colors_used ? std::min<uint32_t>(colors_used, 256) : 1u << bpp;
+		unsigned char colors[256][4] = {};
+		for (uint32_t i = 0; i < palette_size; i++) {
+			const unsigned char* entry = palette + i * palette_entry;
+			if (entry + palette_entry > end)
+				break;
+			colors[i][0] = entry[2];
+			colors[i][1] = entry[1];
+			colors[i][2] = entry[0];
+			colors[i][3] = 255;
+		}
+
+		std::vector<unsigned char> indices;
+		if (compression == kBMPRLE8 || compression == kBMPRLE4) {
+			decodeRLE(pixels, end, width, height, compression == kBMPRLE4, indices);
+		} else if (compression == kBMPRGB) {
+			indices.assign(size_t(width) * height, 0);
+			size_t stride = (size_t(width) * bpp + 31) / 32 * 4;
+			for (int y = 0; y < height; y++) {
+				const unsigned char* row = pixels + stride * y;
+				for (int x = 0; x < width; x++) {
+					size_t bit = size_t(x) * bpp;
+					if (row + bit / 8 >= end)
+						break;
+					int shift = 8 - bpp - int(bit % 8);
+					indices[size_t(y) * width + x] = (row[bit / 8] >> shift) & ((1 << bpp) - 1);
+				}
+			}
+		} else {
+			return false;
+		}
+		for (size_t i = 0; i < indices.size(); i++)
+			memcpy(&image.pixels[i * 4], colors[indices[i]], 4);
+	} else {
+		if (bpp != 16 && bpp != 24 && bpp != 32)
+			return false;
+		if (compression != kBMPRGB && compression != kBMPBitfields && compression != kBMPAlphaBitfields)
+			return false;
+		if (compression == kBMPRGB) {
+			if (bpp == 16) {
+				masks[0] = 0x7C00; masks[1] = 0x03E0; masks[2] = 0x001F;
+			} else {
+				masks[0] = 0xFF0000; masks[1] = 0x00FF00; masks[2] = 0x0000FF;
+				// Plain 32-bit files often keep alpha in the spare byte.
+				if (bpp == 32)
+					masks[3] = 0xFF000000;
+			}
+		}
+		Channel r(masks[0]), g(masks[1]), b(masks[2]), a(masks[3]);
+		int bytes = bpp / 8;
+		size_t stride = (size_t(width) * bytes + 3) & ~size_t(3);
+		bool any_alpha = false;
+		for (int y = 0; y < height; y++) {
+			const unsigned char* row = pixels + stride * y;
+			unsigned char* out = &image.pixels[size_t(y) * width * 4];
+			for (int x = 0; x < width; x++, out += 4) {
+				const unsigned char* p = row + x * bytes;
+				if (p + bytes > end) {
+					out[0] = out[1] = out[2] = 0;
+					continue;
+				}
+				uint32_t pixel = bytes == 2 ? readU16(p) : bytes == 3 ? p[0] | p[1] << 8 | p[2] << 16 : readU32(p);
+				out[0] = r(pixel, 0);
+				out[1] = g(pixel, 0);
+				out[2] = b(pixel, 0);
+				out[3] = a(pixel, 255);
+				any_alpha |= out[3] != 0;
+			}
+		}
+		// An all-zero alpha channel means the spare byte was never written.
+		if (masks[3] && !any_alpha)
+			for (size_t i = 3; i < image.pixels.size(); i += 4)
+				image.pixels[i] = 255;
+	}
+
+	if (top_down) {
+		size_t stride = size_t(width) * 4;
+		for (int y = 0; y < height / 2; y++)
+			std::swap_ranges(&image.pixels[y * stride], &image.pixels[(y + 1) * stride],
+			                 &image.pixels[(height - 1 - y) * stride]);
+	}
+	return true;
+}
+
+bool saveBMP(const std::string& path, const Image& image)
+{
+	bool alpha = false;
+	for (size_t i = 3; i < image.pixels.size() && !alpha; i += 4)
+		alpha = image.pixels[i] != 255;
+	int bytes = alpha ? 4 : 3;
+	size_t stride = (size_t(image.width) * bytes + 3) & ~size_t(3);
+	size_t data_size = stride * image.height;
+
+	std::vector<unsigned char> file(54 + data_size, 0);
+	auto put32 = [&](size_t offset, uint32_t value) { memcpy(&file[offset], &value, 4); };
+	file[0] = 'B';
+	file[1] = 'M';
+	put32(0x02, file.size());
+	put32(0x0A, 54);
+	put32(0x0E, 40);
+	put32(0x12, image.width);
+	put32(0x16, image.height);
+	file[0x1A] = 1;
+	file[0x1C] = bytes * 8;
+	put32(0x22, data_size);
+	for (int y = 0; y < image.height; y++) {
+		unsigned char* row = &file[54 + stride * y];
+		const unsigned char* in = &image.pixels[size_t(y) * image.width * 4];
+		for (int x = 0; x < image.width; x++, row += bytes, in += 4) {
+			row[0] = in[2];
+			row[1] = in[1];
+			row[2] = in[0];
+			if (alpha)
+				row[3] = in[3];
+		}
+	}
+	return writeFileAtomic(path, file.data(), file.size());
+}
+
+void buildMipChain(const Image& image, MipFilter filter, std::vector<Image>& levels)
+{
+	PROFILE_ZONE("buildMipChain");
+	levels.assign(1, image);
+
+	float to_linear[256];
+	for (int i = 0; i < 256; i++)
+		to_linear[i] = srgbToLinear(i / 255.0f);
+
+	// The chain is filtered from float copies so rounding doesn't pile up.
+	int src_width = image.width, src_height = image.height;
+	std::vector<float> src(image.pixels.size());
+	for (size_t i = 0; i < src.size(); i++)
+		src[i] = i % 4 == 3 ? image.pixels[i] / 255.0f : to_linear[image.pixels[i]];
+
+	std::vector<float> horizontal, dst;
+	while (src_width > 1 || src_height > 1) {
+		int dst_width = std::max(src_width / 2, 1);
+		int dst_height = std::max(src_height / 2, 1);
+		Taps column_taps = buildTaps(src_width, dst_width, filter);
+		Taps row_taps = buildTaps(src_height, dst_height, filter);
+
+		horizontal.assign(size_t(dst_width) * src_height * 4, 0.0f);
+		parallelFor(src_height, 16, [&](size_t begin, size_t end) {
+			for (size_t y = begin; y < end; y++) {
+				const float* in = &src[y * src_width * 4];
+				float* out = &horizontal[y * dst_width * 4];
+				for (int x = 0; x < dst_width; x++, out += 4)
+					for (int t = 0; t < column_taps.count; t++) {
+						float w = column_taps.weight[x * column_taps.count + t];
+						const float* texel = in + column_taps.index[x * column_taps.count + t] * 4;
+						for (int c = 0; c < 4; c++)
+							out[c] += w * texel[c];
+					}
+			}
+		});
+
+		dst.assign(size_t(dst_width) * dst_height * 4, 0.0f);
+		Image level;
+		level.width = dst_width;
+		level.height = dst_height;
+		level.pixels.resize(dst.size());
+		parallelFor(dst_height, 16, [&](size_t begin, size_t end) {
+			size_t row_size = size_t(dst_width) * 4;
+			for (size_t y = begin; y < end; y++) {
+				float* out = &dst[y * row_size];
+				for (int t = 0; t < row_taps.count; t++) {
+					float w = row_taps.weight[y * row_taps.count + t];
+					const float* in = &horizontal[row_taps.index[y * row_taps.count + t] * row_size];
+					for (size_t i = 0; i < row_size; i++)
+						out[i] += w * in[i];
+				}
+				unsigned char* bytes = &level.pixels[y * row_size];
+				for (size_t i = 0; i < row_size; i++) {
+					if (i % 4 == 3)
+						bytes[i] = (unsigned char)(std::min(std::max(out[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+					else
+						bytes[i] = linearToSRGB(out[i]);
+				}
+			}
+		});
+
+		levels.push_back(std::move(level));
+		src.swap(dst);
+		src_width = dst_width;
+		src_height = dst_height;
+	}
+}
+
+GLuint uploadTexture(const std::vector<TextureLevel>& levels, GLenum internal_format,
+                     GLenum format, GLenum type, bool compressed)
+{
+	if (levels.empty())
+		return 0;
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glState().bindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t i = 0; i < levels.size(); i++) {
+		const TextureLevel& level = levels[i];
+		if (compressed)
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, internal_format, level.width, level.height, 0, level.size, level.data);
+		else
+			glTexImage2D(GL_TEXTURE_2D, i, internal_format, level.width, level.height, 0, format, type, level.data);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (GLEW_EXT_texture_filter_anisotropic) {
+		GLfloat max_anisotropy = 1.0f;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(max_anisotropy, 8.0f));
+	}
+	return texture;
+}
+
+bool parseTextureQuality(const std::string& tier, TextureOptions& options)
+{
+	if (tier == "none") {
+		options.compress = false;
+		return true;
+	}
+	if (tier == "fast")
+		options.quality = EncodeQuality::Fast;
+	else if (tier == "normal")
+		options.quality = EncodeQuality::Normal;
+	else if (tier == "high")
+		options.quality = EncodeQuality::High;
+	else
+		return false;
+	options.compress = true;
+	return true;
+}
+
+bool prepareTexture(const std::string& path, const TextureOptions& options, TextureData& texture)
+{
+	PROFILE_ZONE("prepareTexture");
+	std::string key, stamp;
+	if (!assetInfo(path, key, stamp)) {
+		printf("%s could not be opened.\n", path.c_str());
+		return false;
+	}
+	const char* quality = qualityName(options.quality);
+	std::string variant = std::string(filterName(options.filter)) + " " + (options.compress ? quality : "rgba");
+	if (options.max_levels > 0)
+		variant += " " + std::to_string(options.max_levels);
+	std::string source = stamp + " " + variant + " v" + std::to_string(kTextureCacheVersion);
+
+	std::string cache_path;
+	std::string directory = cacheDirectory("textures");
+	if (!directory.empty())
+		cache_path = directory + "/" + hexString(hashString(variant, hashString(key))) + ".ktx";
+
+	KTXHeader header;
+	if (!options.rebuild && !cache_path.empty() && texture.mapping.open(cache_path) &&
+	    parseKTX(texture.mapping.data(), texture.mapping.size(), source, header, texture.levels)) {
+		texture.internal_format = header.gl_internal_format;
+		texture.format = header.gl_format;
+		texture.type = header.gl_type;
+		texture.compressed = header.gl_type == 0;
+		texture.cached = true;
+		return true;
+	}
+	texture.mapping.close();
+	texture.levels.clear();
+
+	printf("Reading image %s\n", path.c_str());
+	Image image;
+	{
+		AssetData file;
+		if (!readAsset(path, file)) {
+			printf("%s could not be opened.\n", path.c_str());
+			return false;
+		}
+		if (!decodeBMP(file.data(), file.size(), image)) {
+			printf("Not a correct BMP file\n");
+			return false;
+		}
+	}
+
+	std::vector<Image> chain;
+	buildMipChain(image, options.filter, chain);
+	if (options.max_levels > 0 && chain.size() > size_t(options.max_levels))
+		chain.resize(options.max_levels);
+
+	memset(&header, 0, sizeof(header));
+	if (options.compress) {
+		bool alpha = false;
+		for (size_t i = 3; i < image.pixels.size() && !alpha; i += 4)
+			alpha = image.pixels[i] != 255;
+		BlockFormat format = alpha ? BlockFormat::BC3 : BlockFormat::BC1;
+
+		size_t input_bytes = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (const Image& level : chain) {
+			texture.storage.emplace_back(blockCompressedSize(level.width, level.height, format));
+			encodeBlocks(level.pixels.data(), level.width, level.height, format, options.quality,
+			             texture.storage.back().data());
+			input_bytes += level.pixels.size();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::vector<unsigned char> decoded(image.pixels.size());
+		decodeBlocks(texture.storage[0].data(), image.width, image.height, format, decoded.data());
+		double psnr = computePSNR(image.pixels.data(), decoded.data(), size_t(image.width) * image.height, alpha ? 4 : 3);
+		printf("Encoded %s as %s (%s): %.1f MB/s, PSNR %.2f dB\n", path.c_str(), alpha ? "BC3" : "BC1",
+		       quality, input_bytes / std::max(seconds, 1e-9) / 1e6, psnr);
+
+		header.gl_type_size = 1;
+		header.gl_internal_format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		header.gl_base_internal_format = alpha ? GL_RGBA : GL_RGB;
+		for (size_t i = 0; i < chain.size(); i++)
+			texture.levels.push_back({ chain[i].width, chain[i].height, texture.storage[i].data(), texture.storage[i].size() });
+	} else {
+		header.gl_type = GL_UNSIGNED_BYTE;
+		header.gl_type_size = 1;
+		header.gl_format = GL_RGBA;
+		header.gl_internal_format = GL_RGBA8;
+		header.gl_base_internal_format = GL_RGBA;
+		for (Image& level : chain) {
+			texture.storage.push_back(std::move(level.pixels));
+			texture.levels.push_back({ level.width, level.height, texture.storage.back().data(), texture.storage.back().size() });
+		}
+	}
+	texture.internal_format = header.gl_internal_format;
+	texture.format = header.gl_format;
+	texture.type = header.gl_type;
+	texture.compressed = options.compress;
+	texture.cached = false;
+
+	if (!cache_path.empty() && !writeKTX(cache_path, source, header, texture.levels))
+		printf("Cannot write texture cache %s\n", cache_path.c_str());
+	return true;
+}
+
+GLuint loadTexture(const std::string& path, const TextureOptions& options)
+{
+	TextureOptions supported = options;
+	supported.compress = options.compress && GLEW_EXT_texture_compression_s3tc;
+	TextureData texture;
+	if (!prepareTexture(path, supported, texture))
+		return 0;
+	return uploadTexture(texture);
+}
+
+GLuint uploadTexture(const TextureData& texture)
+{
+	PROFILE_ZONE("uploadTexture");
+	return uploadTexture(texture.levels, texture.internal_format, texture.format,
+	                     texture.type, texture.compressed);
+}
@@ -0,0 +1,93 @@
+#ifndef NPR_TEXTURE_H
+#define NPR_TEXTURE_H
+
+#include "bcn.h"
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// 8-bit RGBA pixels, bottom row first like glTexImage2D expects.
+struct Image {
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;
+};
+
+// Decodes an in-memory BMP: 1/4/8-bit palettized (optionally RLE4/RLE8),
+// 16/24/32-bit direct colour with or without bitfield masks, bottom-up or
+// top-down. Short pixel data is padded with black rather than rejected.
+bool decodeBMP(const unsigned char* data, size_t size, Image& image);
+
+// Writes 24-bit BMPs for opaque images and 32-bit ones otherwise.
+bool saveBMP(const std::string& path, const Image& image);
+
+enum class MipFilter {
+	Box,     // averages the texels each smaller texel covers
+	Kaiser,  // Kaiser-windowed sinc, keeps thin strokes crisp
+};
+
+// Fills levels with image and every smaller level down to 1x1. Filtering
+// is done in linear light with wrapped edges, as the textures tile, and the
+// rows of each level are split across worker threads.
+void buildMipChain(const Image& image, MipFilter filter, std::vector<Image>& levels);
+
+// One mip level ready for upload; data may point into a mapped file.
+struct TextureLevel {
+	int width;
+	int height;
+	const void* data;
+	size_t size;
+};
+
+// Creates a trilinear filtered GL_TEXTURE_2D from a full or partial mip
+// chain. compressed levels go through glCompressedTexImage2D.
+GLuint uploadTexture(const std::vector<TextureLevel>& levels, GLenum internal_format,
+                     GLenum format, GLenum type, bool compressed);
+
+struct TextureOptions {
+	MipFilter filter = MipFilter::Kaiser;
+	// Block compress to BC1, or BC3 if the image has alpha.
+	bool compress = true;
+	EncodeQuality quality = EncodeQuality::Normal;
+	// Keep at most this many mip levels, 0 for all, e.g. for atlases.
+	int max_levels = 0;
+	// Ignore an existing cache entry and build the texture again.
+	bool rebuild = false;
+};
+
+// Sets the compression tier from "none", "fast", "normal" or "high".
+bool parseTextureQuality(const std::string& tier, TextureOptions& options);
+
+// A texture ready for upload; levels point into mapping or storage.
+struct TextureData {
+	GLenum internal_format = 0;
+	GLenum format = 0;
+	GLenum type = 0;
+	bool compressed = false;
+	bool cached = false;
+	std::vector<TextureLevel> levels;
+	MappedFile mapping;
+	std::vector<std::vector<unsigned char>> storage;
+};
+
+/*
+ * CPU side of loadTexture, reading through readAsset so packed textures
+ * work too. The first time a file is seen with some options
+ * it is decoded, mipmapped, optionally block compressed and written to the
+ * texture cache as a KTX file; later calls map that file instead. Entries
+ * are keyed by path and options and invalidated by the source's size and
+ * modification time. Needs no GL context.
+ */
+bool prepareTexture(const std::string& path, const TextureOptions& options, TextureData& texture);
+
+// The GL side of loadTexture, for textures prepared on another thread.
+GLuint uploadTexture(const TextureData& texture);
+
+// Prepares and uploads a BMP. Compression is skipped when the driver has no
+// S3TC support. Returns 0 on failure.
+GLuint loadTexture(const std::string& path, const TextureOptions& options = TextureOptions());
+
+#endif
@@ -0,0 +1,42 @@
+// Bakes BMP textures into the texture cache ahead of time, so the viewer
+// maps ready-made mip chains instead of encoding on load.
+//
+//   bcenc [--texture-quality=none|fast|normal|high] [--box] file.bmp...
+
+#include "../texture.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+	TextureOptions options;
+	options.rebuild = true;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 18, "--texture-quality=") == 0) {
+			if (!parseTextureQuality(arg.substr(18), options)) {
+				fprintf(stderr, "Unknown texture quality %s\n", arg.c_str() + 18);
+				return 1;
+			}
+		} else if (arg == "--box") {
+			options.filter = MipFilter::Box;
+		} else {
+			files.push_back(arg);
+		}
+	}
+	if (files.empty()) {
+		fprintf(stderr, "Usage: %s [--texture-quality=none|fast|normal|high] [--box] file.bmp...\n", argv[0]);
+		return 1;
+	}
+
+	int failed = 0;
+	for (const std::string& file : files) {
+		TextureData texture;
+		if (!prepareTexture(file, options, texture))
+			failed++;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+// Reference consumer for npr --export: maps the shared memory ring and
+// reads each new frame in place, reporting once a second how many frames
+// arrived, how many it skipped or saw torn, and how long after publishing
+// it got to them. --save writes the next frame as a binary PPM.
+//
+//   frametap [--save=frame.ppm] name
+
+#include "../frame_ring.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+// Waits for the producer to make the ring and fill in its header.
+void* mapRing(const std::string& name, size_t& size)
+{
+	std::string path = "/" + name;
+	for (bool said = false;; said = true) {
+		// Writable only for the waiters count.
+		int fd = shm_open(path.c_str(), O_RDWR, 0);
+		struct stat st;
+		if (fd >= 0 && fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(FrameRingHeader)) {
+			size = st.st_size;
+			void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (ring == MAP_FAILED)
+				return nullptr;
+			FrameRingHeader* header = static_cast<FrameRingHeader*>(ring);
+			while (header->magic.load() != kFrameRingMagic && !header->closed.load())
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			return ring;
+		}
+		if (fd >= 0)
+			close(fd);
+		if (!said)
+			printf("Waiting for %s...\n", path.c_str());
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+}
+
+bool savePPM(const std::string& path, uint32_t width, uint32_t height, uint32_t stride,
+             const unsigned char* pixels)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+	std::vector<unsigned char> row(size_t(width) * 3);
+	for (uint32_t y = 0; y < height; y++) {
+		const unsigned char* in = pixels + size_t(height - 1 - y) * stride;
+		for (uint32_t x = 0; x < width; x++)
+			memcpy(&row[x * 3], &in[x * 4], 3);
+		fwrite(row.data(), 1, row.size(), file);
+	}
+	return fclose(file) == 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	std::string name, save_path;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--save=", 7) == 0)
+			save_path = argv[i] + 7;
+		else
+			name = argv[i];
+	}
+	if (name.empty()) {
+		fprintf(stderr, "Usage: %s [--save=frame.ppm] name\n", argv[0]);
+		return 1;
+	}
+	size_t size = 0;
+	void* ring = mapRing(name, size);
+	if (!ring) {
+		fprintf(stderr, "Cannot map /%s\n", name.c_str());
+		return 1;
+	}
+	FrameRingHeader* header = static_cast<FrameRingHeader*>(ring);
+	if (header->version != kFrameRingVersion) {
+		fprintf(stderr, "/%s is version %u, this reads %u\n", name.c_str(), header->version, kFrameRingVersion);
+		return 1;
+	}
+	if (header->slots == 0 || header->slot_size == 0 ||
+	    header->slot_size < size_t(header->max_width) * header->max_height * 4 ||
+	    size < frameRingSize(header->slots, header->slot_size)) {
+		fprintf(stderr, "/%s has a bad header or is too small for it\n", name.c_str());
+		return 1;
+	}
+	printf("Mapped /%s: %u slots of up to %ux%u\n", name.c_str(), header->slots, header->max_width,
+	       header->max_height);
+
+	uint32_t seen = header->sequence.load();
+	unsigned int frames = 0, skipped = 0, torn = 0;
+	double latency_ms = 0.0, checksum = 0.0;
+	auto report = std::chrono::steady_clock::now();
+	while (!header->closed.load()) {
+		uint32_t sequence = header->sequence.load();
+		if (sequence == seen) {
+			header->waiters.fetch_add(1);
+			frameRingWait(header->sequence, seen, 100);
+			header->waiters.fetch_sub(1);
+			continue;
+		}
+		if (seen && sequence > seen + 1)
+			skipped += sequence - seen - 1;
+		seen = sequence;
+
+		// Read the frame where it is, then make sure it wasn't overwritten
+		// meanwhile.
+		const FrameSlot& slot = *frameRingSlot(ring, (sequence - 1) % header->slots);
+		uint32_t before = slot.sequence.load();
+		if (before != 2 * sequence) {
+			torn++;
+			continue;
+		}
+		// Read once: a slot outside the header's bounds is being rewritten,
+		// or was never written by the exporter, and isn't read at all.
+		uint32_t width = slot.width, height = slot.height, stride = slot.stride;
+		if (width > header->max_width || height > header->max_height || stride < size_t(width) * 4 ||
+		    size_t(stride) * height > header->slot_size) {
+			torn++;
+			continue;
+		}
+		double delay_ms = (frameRingNow() - slot.timestamp_ns) / 1e6;
+		const unsigned char* pixels = frameRingPixels(ring, (sequence - 1) % header->slots);
+		// Stand-in for real work: touch one byte per row.
+		for (uint32_t y = 0; y < height; y++)
+			checksum += pixels[size_t(y) * stride];
+		bool saving = !save_path.empty();
+		if (saving && !savePPM(save_path, width, height, stride, pixels))
+			fprintf(stderr, "Cannot write %s\n", save_path.c_str());
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load() != before) {
+			torn++;
+			continue;
+		}
+		if (saving) {
+			printf("Wrote frame %u (%ux%u) to %s\n", sequence, width, height, save_path.c_str());
+			save_path.clear();
+		}
+		frames++;
+		latency_ms += delay_ms;
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - report >= std::chrono::seconds(1)) {
+			printf("%u frames, %u skipped, %u torn, %.3f ms after publishing\n", frames, skipped, torn,
+			       frames ? latency_ms / frames : 0.0);
+			frames = skipped = torn = 0;
+			latency_ms = 0.0;
+			report = now;
+		}
+	}
+	printf("/%s closed (checksum %.0f)\n", name.c_str(), checksum);
+	munmap(ring, size);
+	return 0;
+}
@@ -0,0 +1,92 @@
+// Builds an asset pack from directory trees. Entries are named relative to
+// the directory given, e.g. obj/bunny.obj for assets/obj/bunny.obj, which
+// is what readAsset looks them up by.
+//
+//   mkpack out.pack dir...
+
+#include "../mapped_file.h"
+#include "../pack.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+void collect(const std::string& root, const std::string& relative, std::vector<PackInput>& inputs)
+{
+	std::string directory = relative.empty() ? root : root + "/" + relative;
+	DIR* dir = opendir(directory.c_str());
+	if (!dir)
+		return;
+	std::vector<std::string> names;
+	while (dirent* entry = readdir(dir))
+		if (entry->d_name[0] != '.')
+			names.push_back(entry->d_name);
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+
+	for (const std::string& name : names) {
+		std::string child = relative.empty() ? name : relative + "/" + name;
+		struct stat st;
+		if (stat((root + "/" + child).c_str(), &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			collect(root, child, inputs);
+		else if (S_ISREG(st.st_mode))
+			inputs.push_back({ child, root + "/" + child });
+	}
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s out.pack dir...\n", argv[0]);
+		return 1;
+	}
+	std::vector<PackInput> inputs;
+	for (int i = 2; i < argc; i++)
+		collect(argv[i], "", inputs);
+
+	auto start = std::chrono::steady_clock::now();
+	if (!writeAssetPack(argv[1], inputs))
+		return 1;
+	double write_ms = millisecondsSince(start);
+
+	// Read everything back, both to check the pack and to time it.
+	AssetPack pack;
+	if (!pack.open(argv[1]))
+		return 1;
+	size_t raw = 0, packed = 0;
+	start = std::chrono::steady_clock::now();
+	for (const PackInput& input : inputs) {
+		const PackEntry* entry = pack.find(input.name);
+		std::vector<unsigned char> buffer;
+		const unsigned char* data;
+		MappedFile original;
+		if (!entry || !pack.read(*entry, buffer, data) || !original.open(input.path) ||
+		    original.size() != entry->raw_size || memcmp(original.data(), data, original.size()) != 0) {
+			fprintf(stderr, "%s doesn't read back correctly\n", input.name.c_str());
+			return 1;
+		}
+		raw += entry->raw_size;
+		packed += entry->size;
+	}
+	double read_ms = millisecondsSince(start);
+	printf("Packed %zu files, %.1f MB into %.1f MB (%.0f%%) in %.0f ms; read back at %.0f MB/s\n",
+	       inputs.size(), raw / 1e6, packed / 1e6, 100.0 * packed / std::max<size_t>(raw, 1),
+	       write_ms, raw / 1e3 / std::max(read_ms, 1e-3));
+	return 0;
+}
@@ -0,0 +1,62 @@
+// Packs a model's textures into one padded atlas image and writes the
+// layout next to it, so a character can be drawn with one texture bind.
+//
+//   texatlas [--padding=N] out.bmp in.bmp...
+//
+// writes out.bmp and out.atlas. Loaders rewrite UVs with remapUVs and
+// load the image with TextureOptions::max_levels = atlas.mipLevels().
+
+#include "../atlas.h"
+#include "../config.h"
+#include "../mapped_file.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+	int padding = kAtlasPadding;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 10, "--padding=") == 0)
+			padding = atoi(arg.c_str() + 10);
+		else
+			files.push_back(arg);
+	}
+	if (files.size() < 2 || padding < 1 || (padding & (padding - 1))) {
+		fprintf(stderr, "Usage: %s [--padding=power of two] out.bmp in.bmp...\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<Image> images(files.size() - 1);
+	std::vector<std::string> names;
+	for (size_t i = 1; i < files.size(); i++) {
+		MappedFile file;
+		if (!file.open(files[i]) || !decodeBMP(file.data(), file.size(), images[i - 1])) {
+			fprintf(stderr, "Cannot read %s\n", files[i].c_str());
+			return 1;
+		}
+		size_t slash = files[i].find_last_of('/');
+		names.push_back(slash == std::string::npos ? files[i] : files[i].substr(slash + 1));
+	}
+
+	TextureAtlas atlas;
+	Image pixels;
+	if (!buildAtlas(images, names, padding, kAtlasMaxSize, atlas, pixels))
+		return 1;
+
+	std::string layout = files[0].substr(0, files[0].find_last_of('.')) + ".atlas";
+	if (!saveBMP(files[0], pixels) || !saveAtlasLayout(layout, atlas)) {
+		fprintf(stderr, "Cannot write %s\n", files[0].c_str());
+		return 1;
+	}
+	long long used = 0;
+	for (const Image& image : images)
+		used += (long long)image.width * image.height;
+	printf("Packed %zu textures into %dx%d (%.0f%% used), %d mip levels\n", images.size(),
+	       atlas.width, atlas.height, 100.0 * used / (double(atlas.width) * atlas.height), atlas.mipLevels());
+	return 0;
+}
@@ -0,0 +1,147 @@
+#include "uniforms.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+struct BlockMember {
+	const char* declaration;
+	const char* name;
+	size_t offset;
+};
+
+#define NPR_BLOCK_MEMBER(type, name) { #type " " #name ";\n", #name, offsetof(Block, name) },
+
+template <typename Block> struct BlockLayout;
+
+template <> struct BlockLayout<FrameBlock> {
+	typedef FrameBlock Block;
+	static std::vector<BlockMember> members() { return { NPR_FRAME_BLOCK(NPR_BLOCK_MEMBER) }; }
+};
+
+template <> struct BlockLayout<MaterialBlock> {
+	typedef MaterialBlock Block;
+	static std::vector<BlockMember> members() { return { NPR_MATERIAL_BLOCK(NPR_BLOCK_MEMBER) }; }
+};
+
+template <> struct BlockLayout<StyleBlock> {
+	typedef StyleBlock Block;
+	static std::vector<BlockMember> members() { return { NPR_STYLE_BLOCK(NPR_BLOCK_MEMBER) }; }
+};
+
+#undef NPR_BLOCK_MEMBER
+
+struct BlockInfo {
+	const char* name;
+	size_t size;
+	std::vector<BlockMember> members;
+};
+
+const std::vector<BlockInfo>& blocks()
+{
+	// In UniformBlock order.
+	static const std::vector<BlockInfo> blocks = {
+		{ "Frame", sizeof(FrameBlock), BlockLayout<FrameBlock>::members() },
+		{ "Material", sizeof(MaterialBlock), BlockLayout<MaterialBlock>::members() },
+		{ "Style", sizeof(StyleBlock), BlockLayout<StyleBlock>::members() },
+	};
+	return blocks;
+}
+
+}
+
+std::string uniformBlockSource()
+{
+	std::string source;
+	for (const BlockInfo& block : blocks()) {
+		source += std::string("layout(std140) uniform ") + block.name + " {\n";
+		for (const BlockMember& member : block.members)
+			source += std::string("\t") + member.declaration;
+		source += "};\n";
+	}
+	return source;
+}
+
+bool bindUniformBlocks(GLuint program)
+{
+	bool matches = true;
+	for (size_t i = 0; i < blocks().size(); i++) {
+		const BlockInfo& block = blocks()[i];
+		GLuint index = glGetUniformBlockIndex(program, block.name);
+		if (index == GL_INVALID_INDEX)
+			continue;
+		glUniformBlockBinding(program, index, i);
+
+		// std140 is fixed, but a wrong alignas would only show up as
+		// garbage on screen, so check what the driver says.
+		for (const BlockMember& member : block.members) {
+			GLuint uniform = GL_INVALID_INDEX;
+			glGetUniformIndices(program, 1, &member.name, &uniform);
+			if (uniform == GL_INVALID_INDEX)
+				continue;
+			GLint offset = -1;
+			glGetActiveUniformsiv(program, 1, &uniform, GL_UNIFORM_OFFSET, &offset);
+			if (offset != GLint(member.offset)) {
+				printf("Uniform %s.%s is at %d in the shader but %zu in the struct\n",
+				       block.name, member.name, offset, member.offset);
+				matches = false;
+			}
+		}
+	}
+	return matches;
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	if (buffer_)
+		glDeleteBuffers(1, &buffer_);
+}
+
+void UniformBuffer::create()
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	size_t size = 0;
+	for (size_t i = 0; i < blocks().size(); i++) {
+		offsets_[i] = size;
+		size += (blocks()[i].size + alignment - 1) / alignment * alignment;
+	}
+	shadow_.assign(size, 0);
+
+	glGenBuffers(1, &buffer_);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+	glBufferData(GL_UNIFORM_BUFFER, size, shadow_.data(), GL_DYNAMIC_DRAW);
+	for (size_t i = 0; i < blocks().size(); i++)
+		glBindBufferRange(GL_UNIFORM_BUFFER, i, buffer_, offsets_[i], blocks()[i].size);
+}
+
+void UniformBuffer::update(UniformBlock block, const void* data)
+{
+	unsigned char* copy = shadow_.data() + offsets_[block];
+	size_t size = blocks()[block].size;
+	if (memcmp(copy, data, size) != 0) {
+		memcpy(copy, data, size);
+		dirty_[block] = true;
+	}
+}
+
+size_t UniformBuffer::flush()
+{
+	// The blocks are few and small, so one upload spanning every dirty one
+	// beats one call each even if a clean block in between goes along.
+	size_t begin = shadow_.size(), end = 0;
+	for (size_t i = 0; i < kNumUniformBlocks; i++) {
+		if (!dirty_[i])
+			continue;
+		begin = std::min(begin, offsets_[i]);
+		end = std::max(end, offsets_[i] + blocks()[i].size);
+		dirty_[i] = false;
+	}
+	if (begin >= end)
+		return 0;
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+	glBufferSubData(GL_UNIFORM_BUFFER, begin, end - begin, shadow_.data() + begin);
+	return end - begin;
+}
@@ -0,0 +1,116 @@
+#ifndef NPR_UNIFORMS_H
+#define NPR_UNIFORMS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/*
+ * The scene's uniform blocks, each listed once as (type, name). The C++
+ * structs below and the GLSL declarations ProgramCache puts in front of
+ * the shaders are both generated from these, so they can't drift apart.
+ * Types are limited to ones whose std140 layout the alignas below
+ * reproduces: mat4, vec4, vec3, vec2, float and int, no arrays.
+ */
+
+// Camera and light; the one model on screen rides along. viewport_size is
+// in pixels.
+#define NPR_FRAME_BLOCK(X) \
+	X(mat4, projection) \
+	X(mat4, view) \
+	X(mat4, model) \
+	X(vec4, light_position) \
+	X(vec3, camera_position) \
+	X(vec2, viewport_size)
+
+#define NPR_MATERIAL_BLOCK(X) \
+	X(vec4, diffuse_color) \
+	X(vec4, ambient_color) \
+	X(vec4, specular_color) \
+	X(float, ka) \
+	X(float, kd) \
+	X(float, ks) \
+	X(float, shininess)
+
+// Everything the cel, gooch, hatching and outline styles read; edge_* is
+// the screen-space outline, silhouette_width and crease_angle (degrees)
+// the silhouette lines.
+#define NPR_STYLE_BLOCK(X) \
+	X(vec4, light_color) \
+	X(vec4, warm_color) \
+	X(vec4, cool_color) \
+	X(vec4, outline_color) \
+	X(float, warm_amount) \
+	X(float, cool_amount) \
+	X(int, num_colors) \
+	X(int, tam_tones) \
+	X(float, hatch_scale) \
+	X(float, outline_size) \
+	X(float, edge_width) \
+	X(float, edge_threshold) \
+	X(float, silhouette_width) \
+	X(float, crease_angle)
+
+#define NPR_STD140_mat4 alignas(16) glm::mat4
+#define NPR_STD140_vec4 alignas(16) glm::vec4
+#define NPR_STD140_vec3 alignas(16) glm::vec3
+#define NPR_STD140_vec2 alignas(8) glm::vec2
+#define NPR_STD140_float float
+#define NPR_STD140_int int
+#define NPR_STD140_MEMBER(type, name) NPR_STD140_##type name;
+
+// Value-initialize these ({}) so the padding compares equal.
+struct FrameBlock { NPR_FRAME_BLOCK(NPR_STD140_MEMBER) };
+struct MaterialBlock { NPR_MATERIAL_BLOCK(NPR_STD140_MEMBER) };
+struct StyleBlock { NPR_STYLE_BLOCK(NPR_STD140_MEMBER) };
+
+// Also the binding points.
+enum UniformBlock {
+	kFrameBlock,
+	kMaterialBlock,
+	kStyleBlock,
+	kNumUniformBlocks
+};
+
+// GLSL declarations of every block, std140.
+std::string uniformBlockSource();
+
+// Points the program's blocks at their binding points. Returns false and
+// says which member if the driver laid one out differently from the struct.
+bool bindUniformBlocks(GLuint program);
+
+/*
+ * One buffer holding every block at its own aligned offset, bound for the
+ * whole run. set() only compares against what was last uploaded; flush()
+ * sends the dirty blocks in a single glBufferSubData, nothing if the panel
+ * didn't change anything.
+ */
+class UniformBuffer {
+public:
+	UniformBuffer() = default;
+	~UniformBuffer();
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	void create();
+
+	void set(const FrameBlock& block) { update(kFrameBlock, &block); }
+	void set(const MaterialBlock& block) { update(kMaterialBlock, &block); }
+	void set(const StyleBlock& block) { update(kStyleBlock, &block); }
+
+	// Returns how many bytes went out.
+	size_t flush();
+
+private:
+	void update(UniformBlock block, const void* data);
+
+	GLuint buffer_ = 0;
+	size_t offsets_[kNumUniformBlocks] = {};
+	bool dirty_[kNumUniformBlocks] = {};
+	// What the buffer holds, laid out like it.
+	std::vector<unsigned char> shadow_;
+};
+
+#endif
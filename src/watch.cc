@@ -0,0 +1,126 @@
+#include "watch.h"
+#include "config.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace {
+
+// The directory part of path, resolved so different spellings of the
+// same file compare equal.
+bool splitPath(const std::string& path, std::string& directory, std::string& name)
+{
+	size_t slash = path.rfind('/');
+	std::string parent = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+	name = slash == std::string::npos ? path : path.substr(slash + 1);
+	char* resolved = realpath(parent.c_str(), nullptr);
+	if (!resolved)
+		return false;
+	directory = resolved;
+	free(resolved);
+	return !name.empty();
+}
+
+}
+
+FileWatcher::FileWatcher()
+{
+	inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_ < 0 || pipe(wake_) != 0) {
+		printf("File watching is unavailable, hot reload is off\n");
+		return;
+	}
+	thread_ = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher()
+{
+	if (thread_.joinable()) {
+		char quit = 0;
+		if (write(wake_[1], &quit, 1) != 1)
+			perror("write");
+		thread_.join();
+	}
+	for (int fd : { inotify_, wake_[0], wake_[1] })
+		if (fd >= 0)
+			close(fd);
+}
+
+bool FileWatcher::watch(const std::string& path)
+{
+	std::string directory, name;
+	if (!thread_.joinable() || !splitPath(path, directory, name))
+		return false;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<std::string>& paths = files_[directory + "/" + name];
+	if (std::find(paths.begin(), paths.end(), path) != paths.end())
+		return true;
+	bool watched = false;
+	for (const auto& entry : directories_)
+		watched = watched || entry.second == directory;
+	if (!watched) {
+		int wd = inotify_add_watch(inotify_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (wd < 0) {
+			files_.erase(directory + "/" + name);
+			return false;
+		}
+		directories_[wd] = directory;
+	}
+	paths.push_back(path);
+	return true;
+}
+
+std::vector<std::string> FileWatcher::changed()
+{
+	std::vector<std::string> paths;
+	auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto it = pending_.begin(); it != pending_.end();) {
+		if (std::chrono::duration<double>(now - it->second).count() < kReloadDelay) {
+			++it;
+			continue;
+		}
+		const std::vector<std::string>& names = files_[it->first];
+		paths.insert(paths.end(), names.begin(), names.end());
+		it = pending_.erase(it);
+	}
+	return paths;
+}
+
+void FileWatcher::run()
+{
+	alignas(struct inotify_event) char buffer[4096];
+	while (true) {
+		pollfd fds[2] = { { inotify_, POLLIN, 0 }, { wake_[0], POLLIN, 0 } };
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		if (fds[1].revents)
+			return;
+
+		ssize_t length;
+		while ((length = read(inotify_, buffer, sizeof(buffer))) > 0) {
+			auto now = std::chrono::steady_clock::now();
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (char* p = buffer; p < buffer + length;) {
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+				p += sizeof(inotify_event) + event->len;
+				auto directory = directories_.find(event->wd);
+				if (directory == directories_.end() || event->len == 0)
+					continue;
+				// Every event pushes the file's deadline back.
+				std::string file = directory->second + "/" + event->name;
+				if (files_.count(file))
+					pending_[file] = now;
+			}
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef NPR_WATCH_H
+#define NPR_WATCH_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Watches files for changes with inotify on a background thread. The
+ * directories are watched rather than the files, so editors that save by
+ * writing a new file and renaming it over the old one are seen too.
+ * Bursts of events are merged: a file is reported once it has been quiet
+ * for kReloadDelay seconds.
+ */
+class FileWatcher {
+public:
+	FileWatcher();
+	~FileWatcher();
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// Reports changes to path, under the same name. False if it can't be
+	// watched, e.g. it only exists in an asset pack.
+	bool watch(const std::string& path);
+
+	// Files that changed and have settled since the last call.
+	std::vector<std::string> changed();
+
+private:
+	void run();
+
+	int inotify_ = -1;
+	int wake_[2] = { -1, -1 };
+	std::thread thread_;
+
+	std::mutex mutex_;
+	std::map<int, std::string> directories_;                 // watch -> directory
+	std::map<std::string, std::vector<std::string>> files_;  // directory/name -> paths
+	std::map<std::string, std::chrono::steady_clock::time_point> pending_;
+};
+
+#endif